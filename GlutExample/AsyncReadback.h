@@ -0,0 +1,114 @@
+#pragma once
+
+#include <functional>
+
+#include "GLState.h"
+
+// Non-blocking framebuffer readback.
+// glReadPixels goes into a ring of pixel buffer objects guarded by fences, so the read is queued
+// behind the frame instead of stalling it. A readback is mapped once its fence signaled, normally
+// a few frames later, and handed to OnReady while mapped; the pointer is only valid during the call.
+// Rows are bottom-up RGBA8 as OpenGL returns them.
+class AsyncReadback
+{
+public:
+	static const int RingSize = 3;
+
+	// Pixels is NULL if the buffer could not be mapped
+	std::function<void(const unsigned char* Pixels, int Width, int Height, unsigned int Frame)> OnReady;
+
+	AsyncReadback()
+	{
+		glGenBuffers(RingSize, PBOs);
+		for (int i = 0; i < RingSize; i++)
+		{
+			Fences[i] = 0;
+			Sizes[i] = 0;
+		}
+	}
+
+	~AsyncReadback()
+	{
+		for (int i = 0; i < RingSize; i++)
+		{
+			if (Fences[i] != 0)
+				glDeleteSync(Fences[i]);
+		}
+		GLState::DeleteBuffers(RingSize, PBOs);
+	}
+
+	// queue a read of the bound read framebuffer
+	// ------------------------------------------------------------------------
+	void Read(int Width, int Height, unsigned int Frame)
+	{
+		int Slot = Next % RingSize;
+		// the slot was filled RingSize reads ago, normally long finished
+		Resolve(Slot, true);
+
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, PBOs[Slot]);
+		size_t Size = (size_t)Width * Height * 4;
+		if (Sizes[Slot] != Size)
+		{
+			glBufferData(GL_PIXEL_PACK_BUFFER, Size, NULL, GL_STREAM_READ);
+			Sizes[Slot] = Size;
+		}
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		Fences[Slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		Widths[Slot] = Width;
+		Heights[Slot] = Height;
+		Frames[Slot] = Frame;
+		++Next;
+	}
+
+	// hand every finished read to OnReady, oldest first, never waits for the GPU
+	// ------------------------------------------------------------------------
+	void Poll()
+	{
+		for (int i = 0; i < RingSize; i++)
+		{
+			if (!Resolve((Next + i) % RingSize, false))
+				break;
+		}
+	}
+
+	// wait for and hand over every outstanding read
+	void Flush()
+	{
+		for (int i = 0; i < RingSize; i++)
+			Resolve((Next + i) % RingSize, true);
+	}
+
+private:
+	unsigned int PBOs[RingSize];
+	GLsync Fences[RingSize];
+	size_t Sizes[RingSize];
+	int Widths[RingSize];
+	int Heights[RingSize];
+	unsigned int Frames[RingSize];
+	unsigned int Next = 0;
+
+	// false if the read is still in flight
+	bool Resolve(int Slot, bool bWait)
+	{
+		if (Fences[Slot] == 0)
+			return true;
+
+		GLenum Status = glClientWaitSync(Fences[Slot], GL_SYNC_FLUSH_COMMANDS_BIT, bWait ? 1000000000 : 0);
+		if (Status == GL_TIMEOUT_EXPIRED)
+			return false;
+		glDeleteSync(Fences[Slot]);
+		Fences[Slot] = 0;
+
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, PBOs[Slot]);
+		const unsigned char* Pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, Sizes[Slot], GL_MAP_READ_BIT);
+		if (OnReady)
+			OnReady(Pixels, Widths[Slot], Heights[Slot], Frames[Slot]);
+		if (Pixels != NULL)
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return true;
+	}
+};
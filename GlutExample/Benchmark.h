@@ -0,0 +1,114 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// scene content of a benchmark run
+enum ScenePreset {
+	SCENE_CUBES,     // the ten textured cubes and four lamps of the demo
+	SCENE_LAMPS,     // many unlit lamp cubes, cheap shading and lots of draws
+	SCENE_INSTANCES, // many lit cubes, draw and shading bound
+	SCENE_COUNT
+};
+
+const char* const ScenePresetNames[SCENE_COUNT] = { "cubes", "lamps", "instances" };
+
+// Reproducible inputs for benchmark runs: a scripted head trajectory in place of the tracker,
+// a fixed simulation step and scene layouts generated from a fixed seed, so two runs of the
+// same build submit exactly the same frames.
+class BenchmarkScript
+{
+public:
+	// simulation step per frame, replaces the measured deltaTime
+	float FixedDeltaTime = 1.f / 60.f;
+
+	// viewing position the head sways around, cm in tracker space
+	glm::vec3 HeadCenter = glm::vec3(0.f, 0.f, 160.f);
+	float EyeSeparation = 6.f;
+
+	static bool ParseScene(const char* Name, ScenePreset& Scene)
+	{
+		for (int i = 0; i < SCENE_COUNT; i++)
+		{
+			if (strcmp(Name, ScenePresetNames[i]) == 0)
+			{
+				Scene = (ScenePreset)i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// tracked eyes for a frame: the head follows a Lissajous path sideways, up and towards the screen
+	// ------------------------------------------------------------------------
+	void EyesAt(int Frame, glm::vec3& LeftEye, glm::vec3& RightEye) const
+	{
+		const float TwoPi = 6.28318530718f;
+		float Time = Frame * FixedDeltaTime;
+
+		glm::vec3 Head = HeadCenter + glm::vec3(
+			10.f * std::sin(TwoPi * 0.25f * Time),
+			5.f * std::sin(TwoPi * 0.4f * Time),
+			20.f * std::sin(TwoPi * 0.1f * Time));
+
+		LeftEye = Head - glm::vec3(EyeSeparation / 2.f, 0.f, 0.f);
+		RightEye = Head + glm::vec3(EyeSeparation / 2.f, 0.f, 0.f);
+	}
+
+	// cube and lamp positions of a preset, the cubes preset keeps the demo layout passed in
+	// ------------------------------------------------------------------------
+	static void BuildScene(ScenePreset Scene, std::vector<glm::vec3>& Cubes, std::vector<glm::vec3>& Lamps)
+	{
+		if (Scene == SCENE_LAMPS)
+			BuildInstances(2048, Lamps);
+		else if (Scene == SCENE_INSTANCES)
+			BuildInstances(8192, Cubes);
+	}
+
+	// Count objects scattered through the scene box, the same layout for the same count
+	// ------------------------------------------------------------------------
+	static void BuildInstances(int Count, std::vector<glm::vec3>& Positions, unsigned int Seed = 0x2545F491u)
+	{
+		Positions.clear();
+		Positions.reserve(Count);
+		for (int i = 0; i < Count; i++)
+			Positions.push_back(RandomPosition(Seed));
+	}
+
+	// scattered point lights, each with a saturated random colour
+	// ------------------------------------------------------------------------
+	static void BuildLights(int Count, std::vector<glm::vec3>& Positions, std::vector<glm::vec3>& Colors)
+	{
+		unsigned int Seed = 0x9E3779B9u;
+
+		Positions.clear();
+		Colors.clear();
+		for (int i = 0; i < Count; i++)
+		{
+			Positions.push_back(RandomPosition(Seed));
+			glm::vec3 Color(Random(Seed), Random(Seed), Random(Seed));
+			Colors.push_back(Color / std::max(Color.r, std::max(Color.g, std::max(Color.b, 0.001f))));
+		}
+	}
+
+private:
+	// numerical recipes LCG, identical on every platform unlike rand()
+	static float Random(unsigned int& Seed)
+	{
+		Seed = Seed * 1664525u + 1013904223u;
+		return (Seed >> 8) / 16777216.f;
+	}
+
+	// inside the box the demo cubes span, stretched deeper into the screen
+	static glm::vec3 RandomPosition(unsigned int& Seed)
+	{
+		float x = Random(Seed) * 40.f - 20.f;
+		float y = Random(Seed) * 20.f - 10.f;
+		float z = Random(Seed) * -60.f + 2.f;
+		return glm::vec3(x, y, z);
+	}
+};
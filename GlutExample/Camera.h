@@ -12,13 +12,31 @@
 
 // http://www.binarytides.com/udp-socket-programming-in-winsock/
 #include <stdio.h>
-#include <winsock2.h>
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <mutex>
 
+#include "Timer.h"
 
+#ifdef _WIN32
+#include <winsock2.h>
 #pragma comment(lib,"ws2_32.lib") //Winsock Library
+typedef int socklen_t;
+#else
+// POSIX sockets behind the few winsock names used below
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#define WSAGetLastError() errno
+#define WSACleanup()
+#endif
+
 #define SERVER "127.0.0.1"  //ip address of udp server
 #define BUFLEN 512  //Max length of buffer
 #define PORT 6768   //The port on which to listen for incoming data
@@ -59,7 +77,7 @@ public:
 
 	int SoketID;
 	struct sockaddr_in si_other;
-	int slen = sizeof(si_other);
+	socklen_t slen = sizeof(si_other);
 	char UDPbuf[BUFLEN];
 
 	std::atomic_bool bIsUDPThreadRunning;
@@ -69,6 +87,11 @@ public:
 	glm::vec3 LeftEye = glm::vec3(-3.f, 0.f, 160.f);
 	glm::vec3 RightEye = glm::vec3(3.f, 0.f, 160.f);
 
+	// guards LeftEye/RightEye against the UDP thread, sequence counts received poses
+	std::mutex PoseMutex;
+	std::atomic_uint PoseSequence;
+	double PoseTimestamp = 0.0;
+
 	float deltaPackageTime = 0.0f;
 	float lastPackage = 0.0f;
 
@@ -83,6 +106,17 @@ public:
 
 		SoketID = 0;
 		bIsUDPThreadRunning = false;
+		PoseSequence = 0;
+	}
+
+	// Consistent copy of the latest eye pose together with its sequence number and arrival time
+	void GetEyes(glm::vec3& OutLeftEye, glm::vec3& OutRightEye, unsigned int& OutSequence, double& OutTimestamp)
+	{
+		std::lock_guard<std::mutex> Lock(PoseMutex);
+		OutLeftEye = LeftEye;
+		OutRightEye = RightEye;
+		OutSequence = PoseSequence;
+		OutTimestamp = PoseTimestamp;
 	}
 
 	glm::mat4 MylookAtRH
@@ -200,7 +234,7 @@ public:
 		//start communication
 		while (bIsUDPThreadRunning == true)
 		{
-			float currentPackage = glfwGetTime();
+			float currentPackage = GetTime();
 			deltaPackageTime = currentPackage - lastPackage;
 			lastPackage = currentPackage;
 			//std::cout
@@ -228,6 +262,7 @@ public:
 	//  Listen Cameras UDP packages
 	void ListenCamerasUDP()
 	{
+#ifdef _WIN32
 		WSADATA wsa;
 
 		//Initialise winsock
@@ -238,6 +273,7 @@ public:
 			exit(EXIT_FAILURE);
 		}
 		printf("Initialised.\n");
+#endif
 
 		//create socket
 		if ((SoketID = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == SOCKET_ERROR)
@@ -250,9 +286,9 @@ public:
 		memset((char *)&si_other, 0, sizeof(si_other));
 		si_other.sin_family = AF_INET;
 		si_other.sin_port = htons(PORT);
-		si_other.sin_addr.S_un.S_addr = inet_addr(SERVER);
+		si_other.sin_addr.s_addr = inet_addr(SERVER);
 
-		if (bind(SoketID, (SOCKADDR *)&si_other, sizeof(SOCKADDR_IN)) == SOCKET_ERROR)
+		if (bind(SoketID, (struct sockaddr *)&si_other, sizeof(si_other)) == SOCKET_ERROR)
 		{
 			printf("socket() failed with error code : %d", WSAGetLastError());
 			exit(EXIT_FAILURE);
@@ -343,8 +379,14 @@ public:
 		std::string PositionRightString = BufferString.substr(PositionRightStart, PositionRightCount);
 
 
-		LeftEye = ConvertCoordToVector(PositionLeftString);
-		RightEye = ConvertCoordToVector(PositionRightString);
+		glm::vec3 NewLeftEye = ConvertCoordToVector(PositionLeftString);
+		glm::vec3 NewRightEye = ConvertCoordToVector(PositionRightString);
+
+		std::lock_guard<std::mutex> Lock(PoseMutex);
+		LeftEye = NewLeftEye;
+		RightEye = NewRightEye;
+		PoseTimestamp = GetTime();
+		++PoseSequence;
 	}
 
 /*************************MATRIX CALC/*************************/
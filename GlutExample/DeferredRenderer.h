@@ -0,0 +1,302 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+
+#include "DrawCounter.h"
+#include "GLState.h"
+#include "LightClusters.h"
+#include "Shader.h"
+#include "ShaderBatch.h"
+#include "ShadowMaps.h"
+#include "UniformBlocks.h"
+
+// texture units of the G-buffer in the lighting passes, around the light buffers of LightTextureUnit
+enum GBufferTextureUnit {
+	GBUFFER_UNIT_ALBEDO_SPECULAR = 0,
+	GBUFFER_UNIT_NORMAL = 1,
+	GBUFFER_UNIT_DEPTH = 6
+};
+
+// Deferred shading for one eye at a time, next to the forward path of RenderCubes.
+// The geometry pass writes a compact G-buffer of 12 bytes a pixel: RGBA8 albedo with the specular
+// intensity in alpha, an RG16 octahedral normal and depth, from which positions are rebuilt.
+// Shade then lights it into the framebuffer and viewport the eye was going to: one fullscreen
+// pass for the directional and spot light, shadowed by the ShadowMaps bound with it, and every point light as an instance of a cube over its
+// range, added where it covers the screen. The point lights are read from the LightClusters
+// buffer, which is uploaded once per frame at most, so both eyes only differ in their camera.
+// One G-buffer is reused by both eyes.
+class DeferredRenderer
+{
+public:
+	static const int BytesPerPixel = 12;
+
+	unsigned int FBO = 0;
+	unsigned int AlbedoSpecularTexture = 0;
+	unsigned int NormalTexture = 0;
+	unsigned int DepthTexture = 0;
+	int Width = 0;
+	int Height = 0;
+
+	// geometry pass program, draw with it between BeginGeometry and Shade
+	Shader* GeometryShader;
+	int GeometryModelLocation;
+	int GeometryNormalMatrixLocation;
+
+	// count the fragments the light volumes shade (waits for the GPU, for benchmarks only)
+	bool bCountLightFragments = false;
+	unsigned long long LightFragments = 0;
+
+	// the programs are built with the rest of Shaders, CacheUniforms once they were submitted
+	DeferredRenderer(ShaderBatch& Shaders)
+	{
+		GeometryShader = Shaders.Add("../resources/shaders/Main.vertex.glsl", "../resources/shaders/DeferredGeometry.fragment.glsl");
+		DirectionalShader = Shaders.Add("../resources/shaders/Fullscreen.vertex.glsl", "../resources/shaders/DeferredDirectional.fragment.glsl");
+		ShadowedDirectionalShader = Shaders.Add("../resources/shaders/Fullscreen.vertex.glsl", "../resources/shaders/DeferredDirectional.fragment.glsl", nullptr, "#define SHADOWS 1");
+		PointLightShader = Shaders.Add("../resources/shaders/DeferredPointLight.vertex.glsl", "../resources/shaders/DeferredPointLight.fragment.glsl");
+
+		glGenVertexArrays(1, &EmptyVAO);
+		LoadVolume();
+		glGenQueries(1, &FragmentQuery);
+	}
+
+	~DeferredRenderer()
+	{
+		Release();
+		glDeleteQueries(1, &FragmentQuery);
+		GLState::DeleteVertexArrays(1, &EmptyVAO);
+		GLState::DeleteVertexArrays(1, &VolumeVAO);
+		GLState::DeleteBuffers(1, &VolumeVBO);
+		GLState::DeleteBuffers(1, &VolumeEBO);
+		delete GeometryShader;
+		delete DirectionalShader;
+		delete ShadowedDirectionalShader;
+		delete PointLightShader;
+	}
+
+	// ------------------------------------------------------------------------
+	void CacheUniforms()
+	{
+		GeometryShader->bindUniformBlock("Camera", UBO_CAMERA);
+		GeometryShader->use();
+		GeometryShader->setInt("diffuseMap", 0);
+		GeometryShader->setInt("specularMap", 1);
+		GeometryModelLocation = GeometryShader->uniform("model");
+		GeometryNormalMatrixLocation = GeometryShader->uniform("normalMatrix");
+
+		// the lighting passes read the G-buffer and the point lights
+		for (Shader* Program : { DirectionalShader, ShadowedDirectionalShader, PointLightShader })
+		{
+			Program->bindUniformBlock("Camera", UBO_CAMERA);
+			Program->bindUniformBlock("Lights", UBO_LIGHTS);
+			Program->bindUniformBlock("Material", UBO_MATERIAL);
+			Program->use();
+			Program->setInt("gAlbedoSpecular", GBUFFER_UNIT_ALBEDO_SPECULAR);
+			Program->setInt("gNormal", GBUFFER_UNIT_NORMAL);
+			Program->setInt("gDepth", GBUFFER_UNIT_DEPTH);
+			Program->setInt("pointLightData", LIGHT_UNIT_DATA);
+		}
+		ShadowedDirectionalShader->bindUniformBlock("Shadows", UBO_SHADOWS);
+		ShadowedDirectionalShader->use();
+		ShadowedDirectionalShader->setInt("dirShadowMap", SHADOW_UNIT_CASCADES);
+		ShadowedDirectionalShader->setInt("spotShadowMap", SHADOW_UNIT_SPOT);
+		GLState::UseProgram(0);
+		DirectionalLocations.Load(DirectionalShader);
+		ShadowedDirectionalLocations.Load(ShadowedDirectionalShader);
+		PointLightLocations.Load(PointLightShader);
+	}
+
+	// remember the eye's framebuffer and viewport, then bind the cleared G-buffer in their size
+	// ------------------------------------------------------------------------
+	void BeginGeometry()
+	{
+		Target = GLState::BoundDrawFramebuffer();
+		GLState::CurrentViewport(TargetViewport);
+		Resize(TargetViewport[2], TargetViewport[3]);
+
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, FBO);
+		GLState::Viewport(0, 0, Width, Height);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		GeometryShader->use();
+	}
+
+	// light the G-buffer into the eye's framebuffer and viewport, ViewProjection being the eye's;
+	// bShadows samples the shadow maps the caller bound
+	// ------------------------------------------------------------------------
+	void Shade(const glm::mat4& ViewProjection, int PointLights, bool bShadows)
+	{
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, Target);
+		GLState::Viewport(TargetViewport[0], TargetViewport[1], TargetViewport[2], TargetViewport[3]);
+
+		GLState::BindTexture(GBUFFER_UNIT_ALBEDO_SPECULAR, AlbedoSpecularTexture);
+		GLState::BindTexture(GBUFFER_UNIT_NORMAL, NormalTexture);
+		GLState::BindTexture(GBUFFER_UNIT_DEPTH, DepthTexture);
+		glm::mat4 InverseViewProjection = glm::inverse(ViewProjection);
+
+		// directional and spot light everywhere, the depth goes along unconditionally
+		Shader* Directional = bShadows ? ShadowedDirectionalShader : DirectionalShader;
+		const LightingUniforms& Locations = bShadows ? ShadowedDirectionalLocations : DirectionalLocations;
+		Directional->use();
+		Directional->setMat4(Locations.InverseViewProjection, InverseViewProjection);
+		Directional->setVec2(Locations.ViewportOrigin, (float)TargetViewport[0], (float)TargetViewport[1]);
+		glDepthFunc(GL_ALWAYS);
+		GLState::BindVertexArray(EmptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		DrawCounter::Count(1);
+		glDepthFunc(GL_LESS);
+		DrawCounter::CountCalls(2);
+
+		if (PointLights <= 0)
+			return;
+
+		// point lights are added on top; the back faces of their volumes are drawn without depth
+		// test so a volume the eye is inside still covers the screen
+		PointLightShader->use();
+		PointLightShader->setMat4(PointLightLocations.InverseViewProjection, InverseViewProjection);
+		PointLightShader->setVec2(PointLightLocations.ViewportOrigin, (float)TargetViewport[0], (float)TargetViewport[1]);
+		GLState::Disable(GL_DEPTH_TEST);
+		GLState::Enable(GL_BLEND);
+		GLState::Enable(GL_CULL_FACE);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glCullFace(GL_FRONT);
+		DrawCounter::CountCalls(2);
+		if (bCountLightFragments)
+			glBeginQuery(GL_SAMPLES_PASSED, FragmentQuery);
+
+		GLState::BindVertexArray(VolumeVAO);
+		glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, PointLights);
+		DrawCounter::Count(12ull * PointLights);
+
+		if (bCountLightFragments)
+		{
+			glEndQuery(GL_SAMPLES_PASSED);
+			GLuint64 Fragments;
+			glGetQueryObjectui64v(FragmentQuery, GL_QUERY_RESULT, &Fragments);
+			LightFragments = Fragments;
+		}
+		glCullFace(GL_BACK);
+		DrawCounter::CountCalls();
+		GLState::Disable(GL_CULL_FACE);
+		GLState::Disable(GL_BLEND);
+		GLState::Enable(GL_DEPTH_TEST);
+	}
+
+	// bytes of one G-buffer, written once and read at least once per eye
+	long long Bytes() const
+	{
+		return (long long)Width * Height * BytesPerPixel;
+	}
+
+private:
+	Shader* DirectionalShader;
+	Shader* ShadowedDirectionalShader;
+	Shader* PointLightShader;
+
+	struct LightingUniforms
+	{
+		int InverseViewProjection, ViewportOrigin;
+
+		void Load(const Shader* Program)
+		{
+			InverseViewProjection = Program->uniform("inverseViewProjection");
+			ViewportOrigin = Program->uniform("viewportOrigin");
+		}
+	};
+	LightingUniforms DirectionalLocations;
+	LightingUniforms ShadowedDirectionalLocations;
+	LightingUniforms PointLightLocations;
+
+	unsigned int EmptyVAO;
+	unsigned int VolumeVAO, VolumeVBO, VolumeEBO;
+	unsigned int FragmentQuery;
+
+	unsigned int Target = 0;
+	int TargetViewport[4];
+
+	// unit cube around the origin, 8 corners shared by 12 triangles facing out
+	// ------------------------------------------------------------------------
+	void LoadVolume()
+	{
+		const float Corners[] = {
+			-0.5f, -0.5f, -0.5f,   0.5f, -0.5f, -0.5f,   0.5f,  0.5f, -0.5f,  -0.5f,  0.5f, -0.5f,
+			-0.5f, -0.5f,  0.5f,   0.5f, -0.5f,  0.5f,   0.5f,  0.5f,  0.5f,  -0.5f,  0.5f,  0.5f
+		};
+		const unsigned short Triangles[] = {
+			0, 2, 1,  0, 3, 2,  // -z
+			4, 5, 6,  4, 6, 7,  // +z
+			0, 4, 7,  0, 7, 3,  // -x
+			1, 2, 6,  1, 6, 5,  // +x
+			0, 1, 5,  0, 5, 4,  // -y
+			3, 7, 6,  3, 6, 2   // +y
+		};
+
+		glGenVertexArrays(1, &VolumeVAO);
+		glGenBuffers(1, &VolumeVBO);
+		glGenBuffers(1, &VolumeEBO);
+		GLState::BindVertexArray(VolumeVAO);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VolumeVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Corners), Corners, GL_STATIC_DRAW);
+		GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, VolumeEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Triangles), Triangles, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+	}
+
+	// (re)allocate the G-buffer, does nothing when the size is unchanged
+	// ------------------------------------------------------------------------
+	void Resize(int width, int height)
+	{
+		if (FBO != 0 && width == Width && height == Height)
+			return;
+
+		Release();
+
+		Width = width;
+		Height = height;
+
+		glGenFramebuffers(1, &FBO);
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+		AlbedoSpecularTexture = CreateTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, AlbedoSpecularTexture, 0);
+		NormalTexture = CreateTexture(GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, NormalTexture, 0);
+		DepthTexture = CreateTexture(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, DepthTexture, 0);
+
+		const GLenum Attachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, Attachments);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: G-buffer " << Width << "x" << Height << " is not complete!" << std::endl;
+
+		GLState::BindTexture(0, 0);
+	}
+
+	// G-buffer texels are fetched one to one, never filtered
+	unsigned int CreateTexture(GLenum InternalFormat, GLenum Format, GLenum Type)
+	{
+		unsigned int Texture;
+		glGenTextures(1, &Texture);
+		GLState::BindTexture(0, Texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, InternalFormat, Width, Height, 0, Format, Type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return Texture;
+	}
+
+	void Release()
+	{
+		if (FBO != 0)
+		{
+			GLState::DeleteFramebuffers(1, &FBO);
+			GLState::DeleteTextures(1, &AlbedoSpecularTexture);
+			GLState::DeleteTextures(1, &NormalTexture);
+			GLState::DeleteTextures(1, &DepthTexture);
+			FBO = AlbedoSpecularTexture = NormalTexture = DepthTexture = 0;
+		}
+	}
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+// Draw calls, triangles and GL calls submitted since the last reset.
+// Every draw site reports here, as do the shader and uniform buffer wrappers for the calls
+// they issue, so benchmark runs can print what a frame actually submitted. State changes that
+// GLState found redundant and never issued are counted separately.
+struct DrawCounter
+{
+	unsigned int DrawCalls = 0;
+	unsigned long long Triangles = 0;
+	unsigned long long GLCalls = 0;
+	unsigned long long FilteredCalls = 0;
+
+	static DrawCounter& Frame()
+	{
+		static DrawCounter Counter;
+		return Counter;
+	}
+
+	static void Count(unsigned long long Triangles)
+	{
+		++Frame().DrawCalls;
+		Frame().Triangles += Triangles;
+		++Frame().GLCalls;
+	}
+
+	static void CountCalls(unsigned int Calls = 1)
+	{
+		Frame().GLCalls += Calls;
+	}
+
+	static void CountFiltered(unsigned int Calls = 1)
+	{
+		Frame().FilteredCalls += Calls;
+	}
+
+	static void Reset()
+	{
+		Frame() = DrawCounter();
+	}
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+
+#include "DrawCounter.h"
+#include "RenderTarget.h"
+#include "Shader.h"
+#include "ShaderBatch.h"
+
+// Gaze-centred foveated rendering for one eye at a time.
+// The eye is shaded twice: a reduced resolution periphery covering the whole frustum and a
+// full resolution inset around the gaze point, cut out of the same frustum. Both are then
+// composited into the eye viewport with a soft fall-off at the inset border.
+class FoveatedRenderer
+{
+public:
+	// radius of the full resolution region, in fractions of the eye height
+	float FoveaRadius = 0.25f;
+	// width of the blend band at the border of the region, same units
+	float FoveaFalloff = 0.08f;
+	// resolution scale of the periphery
+	float PeripheryScale = 0.5f;
+
+	RenderTarget* Periphery;
+	RenderTarget* Inset;
+
+	// inset rectangle in NDC: x0, y0, x1, y1
+	glm::vec4 InsetRect;
+
+	// the program is built with the rest of Shaders, CacheUniforms once it was submitted
+	FoveatedRenderer(ShaderBatch& Shaders)
+	{
+		Periphery = new RenderTarget(1, 1);
+		Inset = new RenderTarget(1, 1);
+		CompositeShader = Shaders.Add("../resources/shaders/Fullscreen.vertex.glsl", "../resources/shaders/Foveated.fragment.glsl");
+		glGenVertexArrays(1, &EmptyVAO);
+	}
+
+	~FoveatedRenderer()
+	{
+		GLState::DeleteVertexArrays(1, &EmptyVAO);
+		delete CompositeShader;
+		delete Periphery;
+		delete Inset;
+	}
+
+	// ------------------------------------------------------------------------
+	void CacheUniforms()
+	{
+		// texture units never change, set them once
+		CompositeShader->use();
+		CompositeShader->setInt("periphery", 0);
+		CompositeShader->setInt("inset", 1);
+		GLState::UseProgram(0);
+
+		InsetRectLocation = CompositeShader->uniform("insetRect");
+		GazeLocation = CompositeShader->uniform("gaze");
+		AspectLocation = CompositeShader->uniform("aspect");
+		RadiusLocation = CompositeShader->uniform("radius");
+		FalloffLocation = CompositeShader->uniform("falloff");
+	}
+
+	// size the targets for an eye and place the inset around the gaze point
+	// ------------------------------------------------------------------------
+	void Begin(int EyeWidth, int EyeHeight, glm::vec2 GazeNDC)
+	{
+		Aspect = (float)EyeWidth / (float)EyeHeight;
+		Gaze = GazeNDC;
+
+		Periphery->Resize(std::max(1, (int)(EyeWidth * PeripheryScale)), std::max(1, (int)(EyeHeight * PeripheryScale)));
+
+		// half extent of the inset in NDC, the fovea circle is inscribed into it
+		glm::vec2 HalfSize = glm::min(glm::vec2(2.f * FoveaRadius / Aspect, 2.f * FoveaRadius), glm::vec2(1.f));
+		glm::vec2 Center = glm::clamp(GazeNDC, glm::vec2(-1.f) + HalfSize, glm::vec2(1.f) - HalfSize);
+		InsetRect = glm::vec4(Center - HalfSize, Center + HalfSize);
+
+		Inset->Resize(std::max(1, (int)(EyeWidth * HalfSize.x)), std::max(1, (int)(EyeHeight * HalfSize.y)));
+	}
+
+	// restrict an eye projection to the inset rectangle
+	// ------------------------------------------------------------------------
+	glm::mat4 InsetProjection(const glm::mat4& Projection) const
+	{
+		glm::vec2 Size = glm::vec2(InsetRect.z - InsetRect.x, InsetRect.w - InsetRect.y);
+		glm::vec2 Center = glm::vec2(InsetRect.x + InsetRect.z, InsetRect.y + InsetRect.w) / 2.f;
+
+		glm::mat4 Crop;
+		Crop = glm::scale(Crop, glm::vec3(2.f / Size.x, 2.f / Size.y, 1.f));
+		Crop = glm::translate(Crop, glm::vec3(-Center, 0.f));
+		return Crop * Projection;
+	}
+
+	// blend periphery and inset into the currently bound framebuffer/viewport
+	// ------------------------------------------------------------------------
+	void Composite()
+	{
+		GLState::Disable(GL_DEPTH_TEST);
+
+		CompositeShader->use();
+		CompositeShader->setVec4(InsetRectLocation, InsetRect * 0.5f + 0.5f);
+		CompositeShader->setVec2(GazeLocation, Gaze * 0.5f + 0.5f);
+		CompositeShader->setFloat(AspectLocation, Aspect);
+		CompositeShader->setFloat(RadiusLocation, FoveaRadius);
+		CompositeShader->setFloat(FalloffLocation, FoveaFalloff);
+
+		GLState::BindTexture(0, Periphery->ColorTexture);
+		GLState::BindTexture(1, Inset->ColorTexture);
+
+		GLState::BindVertexArray(EmptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		DrawCounter::Count(1);
+
+		GLState::Enable(GL_DEPTH_TEST);
+	}
+
+	// pixels shaded by the scene passes of one eye
+	// ------------------------------------------------------------------------
+	long long ShadedPixels() const
+	{
+		return (long long)Periphery->Width * Periphery->Height + (long long)Inset->Width * Inset->Height;
+	}
+
+private:
+	Shader* CompositeShader;
+	unsigned int EmptyVAO;
+	int InsetRectLocation, GazeLocation, AspectLocation, RadiusLocation, FalloffLocation;
+	float Aspect = 1.f;
+	glm::vec2 Gaze;
+};
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <SOIL.h>
+
+#include "AsyncReadback.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Asynchronous frame capture.
+// Frames are read back through AsyncReadback, so the read never stalls the frame. A finished
+// readback is copied into one of a fixed number of staging buffers and encoded to disk by a
+// pool of worker threads, started with the first staged frame so an idle capture costs no
+// threads. If the encoders fall behind and no staging buffer is free the frame is dropped and
+// counted, memory never grows past the pool. SOIL keeps its last result in a global, so the
+// workers convert in parallel but write one file at a time.
+class FrameCapture
+{
+public:
+	enum Format {
+		FORMAT_TGA,
+		FORMAT_BMP
+	};
+
+	Format OutputFormat = FORMAT_TGA;
+	// file name prefix, the frame number and extension are appended
+	std::string Prefix = "capture_";
+
+	// Workers 0 picks one per spare hardware thread
+	FrameCapture(int Workers = 0, int StagingBuffers = 8)
+	{
+		Readback.OnReady = [this](const unsigned char* Pixels, int Width, int Height, unsigned int Frame) { Stage(Pixels, Width, Height, Frame); };
+
+		Staging.resize(StagingBuffers);
+		for (int i = 0; i < StagingBuffers; i++)
+			FreeStaging.push_back(i);
+
+		if (Workers <= 0)
+			Workers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+		WorkerCount = Workers;
+	}
+
+	~FrameCapture()
+	{
+		Finish();
+
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			bStop = true;
+		}
+		JobReady.notify_all();
+		for (std::thread& Thread : Threads)
+			Thread.join();
+	}
+
+	static bool ParseFormat(const char* Name, Format& Result)
+	{
+		if (strcmp(Name, "tga") == 0)
+			Result = FORMAT_TGA;
+		else if (strcmp(Name, "bmp") == 0)
+			Result = FORMAT_BMP;
+		else
+			return false;
+		return true;
+	}
+
+	// queue a readback of the bound read framebuffer, call after the frame was drawn
+	// ------------------------------------------------------------------------
+	void Capture(int Width, int Height)
+	{
+		Readback.Read(Width, Height, Captured++);
+	}
+
+	// hand every finished readback to the encoders, never waits for the GPU
+	void Poll()
+	{
+		Readback.Poll();
+	}
+
+	// resolve all readbacks and wait until everything is on disk
+	// ------------------------------------------------------------------------
+	void Finish()
+	{
+		Readback.Flush();
+
+		std::unique_lock<std::mutex> Lock(Mutex);
+		JobDone.wait(Lock, [this]() { return Jobs.empty() && Busy == 0; });
+	}
+
+	void Report()
+	{
+		int Done = Encoded;
+		std::cout << "Frame capture: " << Captured << " captured, " << Done << " written, " << Dropped << " dropped"
+			<< ", encode " << (Done > 0 ? EncodeMicroseconds / 1000.0 / Done : 0.0) << "ms/frame on "
+			<< Threads.size() << " threads" << std::endl;
+	}
+
+private:
+	struct Job
+	{
+		int Buffer;
+		int Width;
+		int Height;
+		unsigned int Frame;
+	};
+
+	AsyncReadback Readback;
+
+	// staging buffers and encoder queue, shared with the workers
+	std::vector<std::vector<unsigned char>> Staging;
+	std::vector<int> FreeStaging;
+	std::deque<Job> Jobs;
+	int Busy = 0;
+	bool bStop = false;
+	std::mutex Mutex;
+	std::condition_variable JobReady;
+	std::condition_variable JobDone;
+	std::vector<std::thread> Threads;
+	int WorkerCount;
+	// held around every SOIL call of the workers
+	std::mutex SaveMutex;
+
+	unsigned int Captured = 0;
+	unsigned int Dropped = 0;
+	std::atomic_int Encoded{ 0 };
+	std::atomic_llong EncodeMicroseconds{ 0 };
+
+	// copy a finished readback into a staging buffer and queue it for encoding
+	void Stage(const unsigned char* Pixels, int Width, int Height, unsigned int Frame)
+	{
+		if (Pixels == NULL)
+		{
+			std::cout << "ERROR::CAPTURE:: Failed to map readback of frame " << Frame << std::endl;
+			++Dropped;
+			return;
+		}
+
+		int Buffer = -1;
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			if (!FreeStaging.empty())
+			{
+				Buffer = FreeStaging.back();
+				FreeStaging.pop_back();
+			}
+		}
+		if (Buffer < 0)
+		{
+			++Dropped;
+			return;
+		}
+
+		// only Stage starts workers, and it runs on the thread that polls
+		if (Threads.empty())
+		{
+			for (int i = 0; i < WorkerCount; i++)
+				Threads.push_back(std::thread([this]() { RunWorker(); }));
+		}
+
+		size_t Size = (size_t)Width * Height * 4;
+		Staging[Buffer].resize(Size);
+		memcpy(Staging[Buffer].data(), Pixels, Size);
+
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			Job NewJob = { Buffer, Width, Height, Frame };
+			Jobs.push_back(NewJob);
+		}
+		JobReady.notify_one();
+	}
+
+	void RunWorker()
+	{
+		// RGB rows flipped to top-down, what the stb writers expect
+		std::vector<unsigned char> Image;
+
+		while (true)
+		{
+			Job Current;
+			{
+				std::unique_lock<std::mutex> Lock(Mutex);
+				JobReady.wait(Lock, [this]() { return bStop || !Jobs.empty(); });
+				if (Jobs.empty())
+					return;
+				Current = Jobs.front();
+				Jobs.pop_front();
+				++Busy;
+			}
+
+			std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+			const unsigned char* Source = Staging[Current.Buffer].data();
+			Image.resize((size_t)Current.Width * Current.Height * 3);
+			for (int y = 0; y < Current.Height; y++)
+			{
+				const unsigned char* Row = Source + (size_t)(Current.Height - 1 - y) * Current.Width * 4;
+				unsigned char* Out = &Image[(size_t)y * Current.Width * 3];
+				for (int x = 0; x < Current.Width; x++)
+				{
+					Out[x * 3 + 0] = Row[x * 4 + 0];
+					Out[x * 3 + 1] = Row[x * 4 + 1];
+					Out[x * 3 + 2] = Row[x * 4 + 2];
+				}
+			}
+
+			// the staging buffer can be reused as soon as the pixels are converted
+			{
+				std::lock_guard<std::mutex> Lock(Mutex);
+				FreeStaging.push_back(Current.Buffer);
+			}
+
+			char Path[512];
+			snprintf(Path, sizeof(Path), "%s%06u.%s", Prefix.c_str(), Current.Frame, OutputFormat == FORMAT_BMP ? "bmp" : "tga");
+			int Saved;
+			{
+				std::lock_guard<std::mutex> Lock(SaveMutex);
+				Saved = SOIL_save_image(Path, OutputFormat == FORMAT_BMP ? SOIL_SAVE_TYPE_BMP : SOIL_SAVE_TYPE_TGA, Current.Width, Current.Height, 3, Image.data());
+			}
+			if (!Saved)
+				std::cout << "ERROR::CAPTURE::FILE_NOT_SUCCESFULLY_WRITTEN " << Path << std::endl;
+
+			EncodeMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count();
+			++Encoded;
+
+			{
+				std::lock_guard<std::mutex> Lock(Mutex);
+				--Busy;
+			}
+			JobDone.notify_all();
+		}
+	}
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+// the project defines NOMINMAX and WIN32_LEAN_AND_MEAN, so std::min and std::max stay usable
+#include <windows.h>
+// WIN32_LEAN_AND_MEAN leaves it out of windows.h
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib") // timeBeginPeriod
+#endif
+
+// Frame pacer on an absolute schedule.
+// Deadlines advance by a fixed period instead of being measured from when the frame work started,
+// so scheduler latency does not accumulate into drift. Each wait sleeps coarsely up to a margin
+// before the deadline and spins the rest; the margin follows the measured sleep overshoot.
+// In adaptive mode the display's vblank paces the swap and the wait only moves the start of the
+// frame as late as possible before the next vblank, using the measured frame work time.
+class FramePacer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// target rate, 0 disables pacing
+	double TargetFPS = 0.0;
+	// align to vblank instead of a free running schedule
+	bool bAdaptive = false;
+	// display refresh rate, used as the vblank period estimate until swaps were measured
+	double RefreshRate = 60.0;
+
+	FramePacer()
+	{
+#ifdef _WIN32
+		// default timer resolution is ~15.6ms, far too coarse for the sleep phase
+		timeBeginPeriod(1);
+#endif
+		Epoch = Clock::now();
+		NextDeadline = LastSwap = ReportTime = Now();
+	}
+
+	~FramePacer()
+	{
+#ifdef _WIN32
+		timeEndPeriod(1);
+#endif
+	}
+
+	double Now() const
+	{
+		return std::chrono::duration<double>(Clock::now() - Epoch).count();
+	}
+
+	// number of vblanks per frame the swap chain should wait in adaptive mode
+	// ------------------------------------------------------------------------
+	int SwapInterval() const
+	{
+		if (!bAdaptive || TargetFPS <= 0.0)
+			return 0;
+		return std::max(1, (int)std::floor(RefreshRate / TargetFPS + 0.5));
+	}
+
+	// block until the frame is due to start
+	// ------------------------------------------------------------------------
+	void Wait()
+	{
+		if (TargetFPS <= 0.0)
+		{
+			FrameStart = Now();
+			return;
+		}
+
+		double Period = 1.0 / TargetFPS;
+		if (bAdaptive)
+		{
+			// start as late as possible while still finishing before the vblank we are aiming for
+			double VBlankPeriod = (RefreshPeriod > 0.0 ? RefreshPeriod : 1.0 / RefreshRate) * SwapInterval();
+			NextDeadline = LastSwap + VBlankPeriod - (FrameWork + SafetyMargin);
+		}
+		else
+		{
+			NextDeadline += Period;
+		}
+
+		double CurrentTime = Now();
+		// more than a frame behind: resynchronize instead of bursting frames to catch up
+		if (CurrentTime > NextDeadline + Period)
+			NextDeadline = CurrentTime;
+
+		double SleepUntil = NextDeadline - SpinMargin;
+		if (SleepUntil > CurrentTime)
+		{
+			std::this_thread::sleep_for(std::chrono::duration<double>(SleepUntil - CurrentTime));
+
+			// track how late the OS wakes us up and keep the spin margin above it
+			double Overshoot = std::max(0.0, Now() - SleepUntil);
+			SleepOvershoot += (Overshoot - SleepOvershoot) * 0.1;
+			SpinMargin = std::min(std::max(SleepOvershoot * 2.0, MinSpinMargin), MaxSpinMargin);
+		}
+
+		while (Now() < NextDeadline)
+			std::this_thread::yield();
+
+		FrameStart = Now();
+	}
+
+	// call right before swapping, the frame work is done
+	// ------------------------------------------------------------------------
+	void FrameSubmitted()
+	{
+		double Work = Now() - FrameStart;
+		FrameWork += (Work - FrameWork) * 0.1;
+	}
+
+	// call right after the swap returned
+	// ------------------------------------------------------------------------
+	void FrameSwapped()
+	{
+		double CurrentTime = Now();
+		double Interval = CurrentTime - LastSwap;
+		LastSwap = CurrentTime;
+
+		// with a blocking swap the return time is the vblank, use it to refine the refresh period
+		if (bAdaptive && SwapInterval() > 0 && Interval > 0.0)
+		{
+			double Measured = Interval / SwapInterval();
+			double Nominal = 1.0 / RefreshRate;
+			if (std::abs(Measured - Nominal) < Nominal * 0.1)
+				RefreshPeriod = RefreshPeriod > 0.0 ? RefreshPeriod + (Measured - RefreshPeriod) * 0.05 : Measured;
+		}
+
+		if (Interval > 0.0)
+		{
+			++Frames;
+			IntervalSum += Interval;
+			IntervalSquaredSum += Interval * Interval;
+			IntervalMin = std::min(IntervalMin, Interval);
+			IntervalMax = std::max(IntervalMax, Interval);
+			if (TargetFPS > 0.0)
+				DeadlineError += std::abs(Interval - (bAdaptive ? SwapInterval() / RefreshRate : 1.0 / TargetFPS));
+		}
+	}
+
+	// print frame interval jitter once per second
+	// ------------------------------------------------------------------------
+	void Report()
+	{
+		double CurrentTime = Now();
+		if (CurrentTime - ReportTime < 1.0 || Frames == 0)
+			return;
+
+		double Mean = IntervalSum / Frames;
+		double Variance = std::max(0.0, IntervalSquaredSum / Frames - Mean * Mean);
+		std::cout << "FPS: " << Frames
+			<< " interval mean " << Mean * 1000.0 << "ms"
+			<< " stddev " << std::sqrt(Variance) * 1000.0 << "ms"
+			<< " min " << IntervalMin * 1000.0 << "ms"
+			<< " max " << IntervalMax * 1000.0 << "ms";
+		if (TargetFPS > 0.0)
+			std::cout << " target error " << DeadlineError / Frames * 1000.0 << "ms"
+				<< " spin margin " << SpinMargin * 1000.0 << "ms";
+		std::cout << std::endl;
+
+		RestartReport();
+	}
+
+	// forget the statistics so far, the next report covers the second from now
+	void RestartReport()
+	{
+		ReportTime = Now();
+		Frames = 0;
+		IntervalSum = IntervalSquaredSum = DeadlineError = 0.0;
+		IntervalMin = 1.0e9;
+		IntervalMax = 0.0;
+	}
+
+private:
+	Clock::time_point Epoch;
+
+	double NextDeadline;
+	double FrameStart = 0.0;
+	double LastSwap;
+
+	double SleepOvershoot = 0.001;
+	double SpinMargin = 0.002;
+	const double MinSpinMargin = 0.0002;
+	const double MaxSpinMargin = 0.004;
+
+	double FrameWork = 0.0;
+	const double SafetyMargin = 0.002;
+	double RefreshPeriod = 0.0;
+
+	// jitter statistics since the last report
+	double ReportTime;
+	int Frames = 0;
+	double IntervalSum = 0.0;
+	double IntervalSquaredSum = 0.0;
+	double IntervalMin = 1.0e9;
+	double IntervalMax = 0.0;
+	double DeadlineError = 0.0;
+};
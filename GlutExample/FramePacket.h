@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+#include "LightCuller.h"
+#include "UniformBlocks.h"
+
+// Everything the eyes of a frame are rendered from, built once per frame by the prepare stage
+// before either eye is submitted. The submit stage only reads it through a const pointer, and the
+// next frame is prepared into another packet, so preparing and submitting share no mutable state.
+struct FramePacket
+{
+	// counts up with every prepared packet
+	unsigned int Number = 0;
+
+	// tracker pose the frame is rendered for, eyes in cm in tracker space
+	unsigned int PoseSequence = 0;
+	double PoseTimestamp = 0.0;
+	glm::vec3 LeftEye;
+	glm::vec3 RightEye;
+	glm::vec3 MiddleEye;
+
+	// what one eye sees, the left eye is Eyes[0]
+	struct Eye
+	{
+		glm::mat4 Projection;
+		glm::mat4 View;
+		// eye position relative to the camera, in units
+		glm::vec3 ViewPointOffset;
+	};
+	Eye Eyes[2];
+
+	// directional and spot light, for the Lights block
+	LightsBlock Lights;
+	// distance at which the spot light's attenuation drops it below visibility
+	float SpotLightRange = 0.f;
+
+	// position and uniform scale, rotation, model and world bounds of each container
+	std::vector<glm::vec4> CubePlacements;
+	std::vector<glm::quat> CubeRotations;
+	std::vector<glm::mat4> CubeModels;
+	std::vector<ObjectBounds> CubeBounds;
+	// changes whenever the containers were placed differently, the shadow casters only compare this
+	unsigned int CubesVersion = 0;
+};
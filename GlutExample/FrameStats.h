@@ -0,0 +1,287 @@
+#pragma once
+
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// CPU spans recorded per frame
+enum FramePhase {
+	PHASE_POSE_FETCH,
+	PHASE_FRAME_PREPARE,
+	PHASE_LEFT_EYE,
+	PHASE_RIGHT_EYE,
+	PHASE_SWAP,
+	PHASE_COUNT
+};
+
+const char* const FramePhaseNames[PHASE_COUNT] = { "pose_fetch", "frame_prepare", "left_eye", "right_eye", "swap" };
+
+// Frame-time telemetry: CPU frame time, CPU phase spans and GPU frame time per frame, kept in a fixed
+// ring so recording never allocates. Percentiles are computed over a rolling window of the newest frames.
+// GPU time comes from GL_TIMESTAMP query pairs that are collected a few frames later without stalling;
+// a frame whose result is still pending when its query comes round again keeps no GPU time rather
+// than being waited on. Timestamps rather than GL_TIME_ELAPSED so passes inside the frame can still
+// use elapsed queries.
+class FrameStats
+{
+public:
+	static const int Capacity = 4096;
+
+	struct FrameRecord
+	{
+		unsigned int Frame;
+		double CPUFrame;
+		double Phases[PHASE_COUNT];
+		double GPU; // negative until the query result arrived
+	};
+
+	// frames the percentiles are computed over
+	int Window = 600;
+
+	FrameStats()
+	{
+		Epoch = Clock::now();
+		glGenQueries(QueryCount * 2, &Queries[0][0]);
+	}
+
+	~FrameStats()
+	{
+		glDeleteQueries(QueryCount * 2, &Queries[0][0]);
+	}
+
+	double Now() const
+	{
+		return std::chrono::duration<double>(Clock::now() - Epoch).count();
+	}
+
+	// ------------------------------------------------------------------------
+	void BeginFrame()
+	{
+		CollectGPU(FrameNumber % QueryCount);
+
+		FrameRecord& Record = Records[FrameNumber % Capacity];
+		Record.Frame = FrameNumber;
+		Record.CPUFrame = 0.0;
+		Record.GPU = -1.0;
+		for (int i = 0; i < PHASE_COUNT; i++)
+		{
+			Record.Phases[i] = 0.0;
+			PhaseStart[i] = 0.0;
+		}
+
+		FrameStart = Now();
+
+		// the previous user of this query was resolved or dropped by CollectGPU
+		int Query = FrameNumber % QueryCount;
+		QueryFrame[Query] = FrameNumber;
+		bQueryPending[Query] = true;
+		glQueryCounter(Queries[Query][0], GL_TIMESTAMP);
+	}
+
+	void EndFrame()
+	{
+		Records[FrameNumber % Capacity].CPUFrame = Now() - FrameStart;
+		++FrameNumber;
+	}
+
+	// call once the GPU work of the frame was submitted, before the swap
+	void EndGPU()
+	{
+		glQueryCounter(Queries[FrameNumber % QueryCount][1], GL_TIMESTAMP);
+	}
+
+	// phases accumulate if they are entered several times a frame
+	void BeginPhase(FramePhase Phase)
+	{
+		PhaseStart[Phase] = Now();
+	}
+
+	void EndPhase(FramePhase Phase)
+	{
+		Records[FrameNumber % Capacity].Phases[Phase] += Now() - PhaseStart[Phase];
+	}
+
+	// print p50/p95/p99/max of the rolling window
+	// ------------------------------------------------------------------------
+	void Report()
+	{
+		std::cout << "Frame stats over " << std::min<unsigned int>(FrameNumber, Window) << " frames (p50/p95/p99/max ms):" << std::endl;
+		PrintPercentiles("cpu_frame", -1);
+		for (int i = 0; i < PHASE_COUNT; i++)
+			PrintPercentiles(FramePhaseNames[i], i);
+		PrintPercentiles("gpu_frame", PHASE_COUNT);
+		if (DroppedGPU > 0)
+			std::cout << "  gpu_frame: " << DroppedGPU << " frames without a result" << std::endl;
+	}
+
+	// p50/p95/p99/max in seconds over every frame still in the ring, false if none was recorded
+	// Metric -1 is the CPU frame, PHASE_COUNT the GPU frame, anything else a phase
+	// ------------------------------------------------------------------------
+	bool Summary(int Metric, double Result[4])
+	{
+		int Count = Gather(FirstFrame(), Metric);
+		if (Count == 0)
+			return false;
+
+		Result[0] = Percentile(Count, 0.50);
+		Result[1] = Percentile(Count, 0.95);
+		Result[2] = Percentile(Count, 0.99);
+		Result[3] = *std::max_element(Sorted, Sorted + Count);
+		return true;
+	}
+
+	// wait for the GPU and resolve every outstanding query, for a final report
+	void Flush()
+	{
+		glFinish();
+		CollectGPU();
+	}
+
+	// write every frame still in the ring
+	// ------------------------------------------------------------------------
+	void ExportCSV(const std::string& Path)
+	{
+		std::ofstream File(Path);
+		if (!File)
+		{
+			std::cout << "ERROR::FRAMESTATS::FILE_NOT_SUCCESFULLY_WRITTEN " << Path << std::endl;
+			return;
+		}
+
+		File << "frame,cpu_frame_ms";
+		for (int i = 0; i < PHASE_COUNT; i++)
+			File << "," << FramePhaseNames[i] << "_ms";
+		File << ",gpu_frame_ms\n";
+
+		for (unsigned int Frame = FirstFrame(); Frame < FrameNumber; Frame++)
+		{
+			const FrameRecord& Record = Records[Frame % Capacity];
+			File << Record.Frame << "," << Record.CPUFrame * 1000.0;
+			for (int i = 0; i < PHASE_COUNT; i++)
+				File << "," << Record.Phases[i] * 1000.0;
+			File << ",";
+			if (Record.GPU >= 0.0)
+				File << Record.GPU * 1000.0;
+			File << "\n";
+		}
+		std::cout << "Frame stats written to " << Path << std::endl;
+	}
+
+	void ExportJSON(const std::string& Path)
+	{
+		std::ofstream File(Path);
+		if (!File)
+		{
+			std::cout << "ERROR::FRAMESTATS::FILE_NOT_SUCCESFULLY_WRITTEN " << Path << std::endl;
+			return;
+		}
+
+		File << "{\n  \"frames\": [\n";
+		for (unsigned int Frame = FirstFrame(); Frame < FrameNumber; Frame++)
+		{
+			const FrameRecord& Record = Records[Frame % Capacity];
+			File << "    {\"frame\": " << Record.Frame << ", \"cpu_frame_ms\": " << Record.CPUFrame * 1000.0;
+			for (int i = 0; i < PHASE_COUNT; i++)
+				File << ", \"" << FramePhaseNames[i] << "_ms\": " << Record.Phases[i] * 1000.0;
+			File << ", \"gpu_frame_ms\": ";
+			if (Record.GPU >= 0.0)
+				File << Record.GPU * 1000.0;
+			else
+				File << "null";
+			File << "}" << (Frame + 1 < FrameNumber ? "," : "") << "\n";
+		}
+		File << "  ]\n}\n";
+		std::cout << "Frame stats written to " << Path << std::endl;
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point Epoch;
+
+	FrameRecord Records[Capacity];
+	unsigned int FrameNumber = 0;
+	double FrameStart = 0.0;
+	double PhaseStart[PHASE_COUNT];
+
+	// enough queries in flight that results are normally available when the slot is reused
+	static const int QueryCount = 4;
+	unsigned int Queries[QueryCount][2];
+	unsigned int QueryFrame[QueryCount];
+	bool bQueryPending[QueryCount] = { false, false, false, false };
+	// frames whose query was reused before its result arrived
+	unsigned int DroppedGPU = 0;
+
+	// scratch for percentile selection
+	double Sorted[Capacity];
+
+	unsigned int FirstFrame() const
+	{
+		return FrameNumber > (unsigned int)Capacity ? FrameNumber - Capacity : 0;
+	}
+
+	// resolve the queries whose results arrived; Reuse, the query the starting frame takes, is given up
+	// if it is still pending
+	void CollectGPU(int Reuse = -1)
+	{
+		for (int i = 0; i < QueryCount; i++)
+		{
+			if (!bQueryPending[i])
+				continue;
+
+			GLint Available = 0;
+			glGetQueryObjectiv(Queries[i][1], GL_QUERY_RESULT_AVAILABLE, &Available);
+			if (!Available)
+			{
+				if (i == Reuse)
+				{
+					bQueryPending[i] = false;
+					++DroppedGPU;
+				}
+				continue;
+			}
+
+			GLuint64 Begin, End;
+			glGetQueryObjectui64v(Queries[i][0], GL_QUERY_RESULT, &Begin);
+			glGetQueryObjectui64v(Queries[i][1], GL_QUERY_RESULT, &End);
+			if (FrameNumber - QueryFrame[i] < (unsigned int)Capacity)
+				Records[QueryFrame[i] % Capacity].GPU = (End - Begin) / 1.0e9;
+			bQueryPending[i] = false;
+		}
+	}
+
+	// copy a metric of the frames from Begin on into Sorted, returns how many have a value
+	int Gather(unsigned int Begin, int Metric)
+	{
+		int Count = 0;
+		for (unsigned int Frame = Begin; Frame < FrameNumber; Frame++)
+		{
+			const FrameRecord& Record = Records[Frame % Capacity];
+			double Value = Metric < 0 ? Record.CPUFrame : (Metric == PHASE_COUNT ? Record.GPU : Record.Phases[Metric]);
+			if (Value >= 0.0)
+				Sorted[Count++] = Value;
+		}
+		return Count;
+	}
+
+	void PrintPercentiles(const char* Name, int Metric)
+	{
+		unsigned int Begin = FrameNumber > (unsigned int)Window ? FrameNumber - Window : 0;
+		int Count = Gather(std::max(Begin, FirstFrame()), Metric);
+		if (Count == 0)
+			return;
+
+		std::cout << "  " << Name << ": " << Percentile(Count, 0.50) * 1000.0
+			<< " / " << Percentile(Count, 0.95) * 1000.0
+			<< " / " << Percentile(Count, 0.99) * 1000.0
+			<< " / " << *std::max_element(Sorted, Sorted + Count) * 1000.0 << std::endl;
+	}
+
+	double Percentile(int Count, double Fraction)
+	{
+		int Index = std::min(Count - 1, (int)(Fraction * Count));
+		std::nth_element(Sorted, Sorted + Index, Sorted + Count);
+		return Sorted[Index];
+	}
+};
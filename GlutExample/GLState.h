@@ -0,0 +1,277 @@
+#pragma once
+
+#include "DrawCounter.h"
+
+// Shadow copy of the GL state the renderer changes, so redundant changes never reach the driver.
+// Render code binds programs, vertex arrays, textures, buffers and framebuffers, sets the viewport
+// and toggles capabilities through here instead of calling GL directly. Every issued call is
+// counted in DrawCounter::GLCalls and every filtered one in DrawCounter::FilteredCalls.
+// Objects must be deleted through here too, a recycled name would otherwise look already bound.
+// Code that changes state behind its back has to call Invalidate afterwards.
+class GLState
+{
+public:
+	static const int TextureUnits = 16;
+
+	// ------------------------------------------------------------------------
+	static void UseProgram(unsigned int Program)
+	{
+		State& S = Get();
+		if (Issue(S.Program != Program))
+		{
+			glUseProgram(Program);
+			S.Program = Program;
+		}
+	}
+
+	static void BindVertexArray(unsigned int VAO)
+	{
+		State& S = Get();
+		if (Issue(S.VertexArray != VAO))
+		{
+			glBindVertexArray(VAO);
+			S.VertexArray = VAO;
+		}
+	}
+
+	// 2D, 2D array or buffer texture on a unit, selects the unit only if the binding has to change
+	// ------------------------------------------------------------------------
+	static void BindTexture(int Unit, unsigned int Texture, GLenum Target = GL_TEXTURE_2D)
+	{
+		State& S = Get();
+		unsigned int& Bound = S.Textures[Target == GL_TEXTURE_BUFFER ? 1 : Target == GL_TEXTURE_2D_ARRAY ? 2 : 0][Unit];
+		if (!Issue(Bound != Texture))
+			return;
+		if (Issue(S.ActiveUnit != Unit))
+		{
+			glActiveTexture(GL_TEXTURE0 + Unit);
+			S.ActiveUnit = Unit;
+		}
+		glBindTexture(Target, Texture);
+		Bound = Texture;
+	}
+
+	// array, uniform, pixel pack and texture buffers are shadowed; element buffers belong to the vertex
+	// array, so they are passed straight through like other targets, but still counted
+	// ------------------------------------------------------------------------
+	static void BindBuffer(GLenum Target, unsigned int Buffer)
+	{
+		int Slot = BufferSlot(Target);
+		if (Issue(Slot < 0 || Get().Buffers[Slot] != Buffer))
+		{
+			glBindBuffer(Target, Buffer);
+			if (Slot >= 0)
+				Get().Buffers[Slot] = Buffer;
+		}
+	}
+
+	// glBindBufferRange also changes the generic binding of the target
+	static void BindBufferRange(GLenum Target, unsigned int Index, unsigned int Buffer, GLintptr Offset, GLsizeiptr Size)
+	{
+		glBindBufferRange(Target, Index, Buffer, Offset, Size);
+		DrawCounter::CountCalls();
+		int Slot = BufferSlot(Target);
+		if (Slot >= 0)
+			Get().Buffers[Slot] = Buffer;
+	}
+
+	// GL_FRAMEBUFFER sets both the draw and the read binding
+	// ------------------------------------------------------------------------
+	static void BindFramebuffer(GLenum Target, unsigned int FBO)
+	{
+		State& S = Get();
+		bool bDraw = Target != GL_READ_FRAMEBUFFER;
+		bool bRead = Target != GL_DRAW_FRAMEBUFFER;
+		if (!Issue((bDraw && S.DrawFramebuffer != FBO) || (bRead && S.ReadFramebuffer != FBO)))
+			return;
+		glBindFramebuffer(Target, FBO);
+		if (bDraw)
+			S.DrawFramebuffer = FBO;
+		if (bRead)
+			S.ReadFramebuffer = FBO;
+	}
+
+	static void Viewport(int x, int y, int Width, int Height)
+	{
+		State& S = Get();
+		if (Issue(S.Viewport[0] != x || S.Viewport[1] != y || S.Viewport[2] != Width || S.Viewport[3] != Height))
+		{
+			glViewport(x, y, Width, Height);
+			S.Viewport[0] = x;
+			S.Viewport[1] = y;
+			S.Viewport[2] = Width;
+			S.Viewport[3] = Height;
+		}
+	}
+
+	// what BindFramebuffer and Viewport last set, for passes that render elsewhere and come back
+	// ------------------------------------------------------------------------
+	static unsigned int BoundDrawFramebuffer()
+	{
+		return Get().DrawFramebuffer;
+	}
+
+	static void CurrentViewport(int Viewport[4])
+	{
+		for (int i = 0; i < 4; i++)
+			Viewport[i] = Get().Viewport[i];
+	}
+
+	// ------------------------------------------------------------------------
+	static void Enable(GLenum Capability)
+	{
+		SetEnabled(Capability, true);
+	}
+
+	static void Disable(GLenum Capability)
+	{
+		SetEnabled(Capability, false);
+	}
+
+	static void SetEnabled(GLenum Capability, bool bEnabled)
+	{
+		State& S = Get();
+		int Slot = CapabilitySlot(Capability);
+		if (!Issue(Slot < 0 || S.Enabled[Slot] != (bEnabled ? 1 : 0)))
+			return;
+		if (bEnabled)
+			glEnable(Capability);
+		else
+			glDisable(Capability);
+		if (Slot >= 0)
+			S.Enabled[Slot] = bEnabled ? 1 : 0;
+	}
+
+	// delete objects and forget them wherever they were bound
+	// ------------------------------------------------------------------------
+	static void DeleteProgram(unsigned int Program)
+	{
+		glDeleteProgram(Program);
+		if (Get().Program == Program)
+			Get().Program = Unknown;
+	}
+
+	static void DeleteVertexArrays(int Count, const unsigned int* VAOs)
+	{
+		glDeleteVertexArrays(Count, VAOs);
+		for (int i = 0; i < Count; i++)
+		{
+			if (Get().VertexArray == VAOs[i])
+				Get().VertexArray = Unknown;
+		}
+	}
+
+	static void DeleteTextures(int Count, const unsigned int* Textures)
+	{
+		glDeleteTextures(Count, Textures);
+		for (int i = 0; i < Count; i++)
+		{
+			for (unsigned int* Units : Get().Textures)
+			{
+				for (int Unit = 0; Unit < TextureUnits; Unit++)
+				{
+					if (Units[Unit] == Textures[i])
+						Units[Unit] = Unknown;
+				}
+			}
+		}
+	}
+
+	static void DeleteBuffers(int Count, const unsigned int* Buffers)
+	{
+		glDeleteBuffers(Count, Buffers);
+		for (int i = 0; i < Count; i++)
+		{
+			for (unsigned int& Bound : Get().Buffers)
+			{
+				if (Bound == Buffers[i])
+					Bound = Unknown;
+			}
+		}
+	}
+
+	static void DeleteFramebuffers(int Count, const unsigned int* FBOs)
+	{
+		glDeleteFramebuffers(Count, FBOs);
+		for (int i = 0; i < Count; i++)
+		{
+			if (Get().DrawFramebuffer == FBOs[i])
+				Get().DrawFramebuffer = Unknown;
+			if (Get().ReadFramebuffer == FBOs[i])
+				Get().ReadFramebuffer = Unknown;
+		}
+	}
+
+	// forget everything, the next change of each state is issued again
+	static void Invalidate()
+	{
+		Get() = State();
+	}
+
+private:
+	static const unsigned int Unknown = 0xFFFFFFFFu;
+
+	// capabilities whose state is shadowed, others are always issued
+	static int CapabilitySlot(GLenum Capability)
+	{
+		switch (Capability)
+		{
+		case GL_DEPTH_TEST: return 0;
+		case GL_BLEND: return 1;
+		case GL_CULL_FACE: return 2;
+		case GL_SCISSOR_TEST: return 3;
+		case GL_STENCIL_TEST: return 4;
+		case GL_FRAMEBUFFER_SRGB: return 5;
+		default: return -1;
+		}
+	}
+
+	struct State
+	{
+		unsigned int Program = Unknown;
+		unsigned int VertexArray = Unknown;
+		int ActiveUnit = -1;
+		// 2D, buffer and 2D array textures per unit
+		unsigned int Textures[3][TextureUnits];
+		// array, uniform, pixel pack, texture
+		unsigned int Buffers[4] = { Unknown, Unknown, Unknown, Unknown };
+		unsigned int DrawFramebuffer = Unknown;
+		unsigned int ReadFramebuffer = Unknown;
+		int Viewport[4] = { -1, -1, -1, -1 };
+		int Enabled[6] = { -1, -1, -1, -1, -1, -1 };
+
+		State()
+		{
+			for (int i = 0; i < TextureUnits; i++)
+				Textures[0][i] = Textures[1][i] = Textures[2][i] = Unknown;
+		}
+	};
+
+	static State& Get()
+	{
+		static State Current;
+		return Current;
+	}
+
+	static int BufferSlot(GLenum Target)
+	{
+		switch (Target)
+		{
+		case GL_ARRAY_BUFFER: return 0;
+		case GL_UNIFORM_BUFFER: return 1;
+		case GL_PIXEL_PACK_BUFFER: return 2;
+		case GL_TEXTURE_BUFFER: return 3;
+		default: return -1;
+		}
+	}
+
+	// count a state change as issued or filtered, returns whether it has to be issued
+	static bool Issue(bool bChanged)
+	{
+		if (bChanged)
+			DrawCounter::CountCalls();
+		else
+			DrawCounter::CountFiltered();
+		return bChanged;
+	}
+};
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Scoped GPU pass timing on GL_TIMESTAMP query pools.
+// Every scope writes a timestamp at its begin and end together with the CPU time at the same
+// points. Query pools are cycled over several frames so results are only read once the GPU has
+// passed them; a frame whose results are still pending when its pool comes round again is dropped
+// rather than waited on. GPU timestamps are mapped onto the CPU clock, so CPU and GPU spans of a
+// frame line up on one timeline.
+class GpuProfiler
+{
+public:
+	static const int FramesInFlight = 3;
+	static const int MaxScopes = 64;
+	static const int HistoryFrames = 120;
+
+	struct Scope
+	{
+		const char* Name;
+		int Depth;
+		double CPUBegin, CPUEnd;
+		double GPUBegin, GPUEnd;
+	};
+
+	struct FrameTimeline
+	{
+		unsigned int Frame;
+		int ScopeCount;
+		Scope Scopes[MaxScopes];
+	};
+
+	GpuProfiler()
+	{
+		Epoch = Clock::now();
+		glGenQueries(FramesInFlight * MaxScopes * 2, &Queries[0][0][0]);
+		Calibrate();
+	}
+
+	~GpuProfiler()
+	{
+		glDeleteQueries(FramesInFlight * MaxScopes * 2, &Queries[0][0][0]);
+	}
+
+	double Now() const
+	{
+		return std::chrono::duration<double>(Clock::now() - Epoch).count();
+	}
+
+	// ------------------------------------------------------------------------
+	void BeginFrame()
+	{
+		Slot = FrameNumber % FramesInFlight;
+		if (bPending[Slot])
+			Collect(Slot);
+
+		Frames[Slot].Frame = FrameNumber;
+		Frames[Slot].ScopeCount = 0;
+		Depth = 0;
+
+		// GL and CPU clocks drift apart slowly, re-anchor now and then
+		if (FrameNumber % 600 == 0)
+			Calibrate();
+	}
+
+	void EndFrame()
+	{
+		bPending[Slot] = true;
+		++FrameNumber;
+
+		// pick up whatever else finished already
+		for (int i = 0; i < FramesInFlight; i++)
+		{
+			if (i != Slot && bPending[i] && Available(i))
+				Collect(i);
+		}
+	}
+
+	// returns the scope index to hand back to End
+	// ------------------------------------------------------------------------
+	int Begin(const char* Name)
+	{
+		FrameTimeline& Timeline = Frames[Slot];
+		if (Timeline.ScopeCount >= MaxScopes)
+			return -1;
+
+		int Index = Timeline.ScopeCount++;
+		Scope& S = Timeline.Scopes[Index];
+		S.Name = Name;
+		S.Depth = Depth++;
+		S.CPUBegin = Now();
+		glQueryCounter(Queries[Slot][Index][0], GL_TIMESTAMP);
+		return Index;
+	}
+
+	void End(int Index)
+	{
+		if (Index < 0)
+			return;
+
+		glQueryCounter(Queries[Slot][Index][1], GL_TIMESTAMP);
+		LastQuery[Slot] = Queries[Slot][Index][1];
+		Frames[Slot].Scopes[Index].CPUEnd = Now();
+		--Depth;
+	}
+
+	// print the newest resolved frame as one CPU/GPU timeline
+	// ------------------------------------------------------------------------
+	void PrintTimeline()
+	{
+		if (ResolvedCount == 0)
+			return;
+
+		const FrameTimeline& Timeline = History[(ResolvedCount - 1) % HistoryFrames];
+		if (Timeline.ScopeCount == 0)
+			return;
+
+		double Origin = Timeline.Scopes[0].CPUBegin;
+		std::cout << "GPU timeline of frame " << Timeline.Frame << ", " << DroppedFrames << " frames dropped"
+			<< " (ms from frame start: cpu begin-end | gpu begin-end = gpu time):" << std::endl;
+		for (int i = 0; i < Timeline.ScopeCount; i++)
+		{
+			const Scope& S = Timeline.Scopes[i];
+			std::cout << "  " << std::string(S.Depth * 2, ' ') << S.Name << ": "
+				<< (S.CPUBegin - Origin) * 1000.0 << "-" << (S.CPUEnd - Origin) * 1000.0 << " | "
+				<< (S.GPUBegin - Origin) * 1000.0 << "-" << (S.GPUEnd - Origin) * 1000.0 << " = "
+				<< (S.GPUEnd - S.GPUBegin) * 1000.0 << std::endl;
+		}
+	}
+
+	// write the resolved history in the Chrome trace event format (chrome://tracing)
+	// ------------------------------------------------------------------------
+	void ExportTrace(const std::string& Path)
+	{
+		std::ofstream File(Path);
+		if (!File)
+		{
+			std::cout << "ERROR::GPUPROFILER::FILE_NOT_SUCCESFULLY_WRITTEN " << Path << std::endl;
+			return;
+		}
+
+		File << "{\"traceEvents\": [\n";
+		bool bFirst = true;
+		unsigned int First = ResolvedCount > (unsigned int)HistoryFrames ? ResolvedCount - HistoryFrames : 0;
+		for (unsigned int f = First; f < ResolvedCount; f++)
+		{
+			const FrameTimeline& Timeline = History[f % HistoryFrames];
+			for (int i = 0; i < Timeline.ScopeCount; i++)
+			{
+				const Scope& S = Timeline.Scopes[i];
+				for (int Track = 0; Track < 2; Track++)
+				{
+					double Begin = Track == 0 ? S.CPUBegin : S.GPUBegin;
+					double End = Track == 0 ? S.CPUEnd : S.GPUEnd;
+					File << (bFirst ? "" : ",\n") << "{\"name\": \"" << S.Name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << Track
+						<< ", \"ts\": " << Begin * 1.0e6 << ", \"dur\": " << (End - Begin) * 1.0e6
+						<< ", \"args\": {\"frame\": " << Timeline.Frame << "}}";
+					bFirst = false;
+				}
+			}
+		}
+		File << "\n]}\n";
+		std::cout << "GPU timeline written to " << Path << std::endl;
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point Epoch;
+
+	unsigned int Queries[FramesInFlight][MaxScopes][2];
+	FrameTimeline Frames[FramesInFlight];
+	bool bPending[FramesInFlight] = { false, false, false };
+	// last timestamp written in each pool, nested scopes end out of index order
+	unsigned int LastQuery[FramesInFlight];
+	int Slot = 0;
+	int Depth = 0;
+	unsigned int FrameNumber = 0;
+
+	// resolved frames, newest at ResolvedCount - 1
+	FrameTimeline History[HistoryFrames];
+	unsigned int ResolvedCount = 0;
+	unsigned int DroppedFrames = 0;
+
+	// CPU seconds = GPU nanoseconds * 1e-9 + ClockOffset
+	double ClockOffset = 0.0;
+
+	void Calibrate()
+	{
+		GLint64 GPUTime;
+		glGetInteger64v(GL_TIMESTAMP, &GPUTime);
+		ClockOffset = Now() - GPUTime / 1.0e9;
+	}
+
+	bool Available(int Index)
+	{
+		int Count = Frames[Index].ScopeCount;
+		if (Count == 0)
+			return true;
+
+		// queries complete in order, the last one written covers the frame
+		GLint Result = 0;
+		glGetQueryObjectiv(LastQuery[Index], GL_QUERY_RESULT_AVAILABLE, &Result);
+		return Result != 0;
+	}
+
+	void Collect(int Index)
+	{
+		bPending[Index] = false;
+		if (!Available(Index))
+		{
+			++DroppedFrames;
+			return;
+		}
+
+		FrameTimeline& Timeline = Frames[Index];
+		for (int i = 0; i < Timeline.ScopeCount; i++)
+		{
+			GLuint64 Begin, End;
+			glGetQueryObjectui64v(Queries[Index][i][0], GL_QUERY_RESULT, &Begin);
+			glGetQueryObjectui64v(Queries[Index][i][1], GL_QUERY_RESULT, &End);
+			Timeline.Scopes[i].GPUBegin = Begin / 1.0e9 + ClockOffset;
+			Timeline.Scopes[i].GPUEnd = End / 1.0e9 + ClockOffset;
+		}
+
+		History[ResolvedCount % HistoryFrames] = Timeline;
+		++ResolvedCount;
+	}
+};
+
+// RAII helper: times the enclosing block on the GPU and CPU
+class GpuScope
+{
+public:
+	GpuScope(GpuProfiler* Profiler, const char* Name) : Profiler(Profiler)
+	{
+		Index = Profiler->Begin(Name);
+	}
+
+	~GpuScope()
+	{
+		Profiler->End(Index);
+	}
+
+private:
+	GpuProfiler* Profiler;
+	int Index;
+};
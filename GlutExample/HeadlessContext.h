@@ -0,0 +1,119 @@
+#pragma once
+
+#include <iostream>
+
+#ifdef _WIN32
+#include <GLFW/glfw3.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// OpenGL 3.3 core context without a window or monitor, for benchmarking on display-less machines.
+// Linux uses an EGL surfaceless context (Mesa EGL_MESA_platform_surfaceless); Windows has no
+// surfaceless path, so a hidden 1x1 GLFW window only provides the context there. Only the Windows
+// path is built by the Visual Studio project; the project has no Linux build.
+// All rendering goes to framebuffer objects; the default framebuffer is never used.
+class HeadlessContext
+{
+public:
+	~HeadlessContext()
+	{
+		Destroy();
+	}
+
+	// create the context and make it current, false on failure
+	// ------------------------------------------------------------------------
+	bool Create()
+	{
+#ifdef _WIN32
+		if (!glfwInit())
+		{
+			std::cout << "ERROR::HEADLESS:: glfwInit failed" << std::endl;
+			return false;
+		}
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+		HiddenWindow = glfwCreateWindow(1, 1, "Headless", NULL, NULL);
+		if (HiddenWindow == NULL)
+		{
+			std::cout << "ERROR::HEADLESS:: Failed to create hidden GLFW window" << std::endl;
+			glfwTerminate();
+			return false;
+		}
+		glfwMakeContextCurrent(HiddenWindow);
+		return true;
+#else
+		PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (eglGetPlatformDisplayEXT != NULL)
+			Display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (Display == EGL_NO_DISPLAY)
+			Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint Major, Minor;
+		if (Display == EGL_NO_DISPLAY || !eglInitialize(Display, &Major, &Minor))
+		{
+			std::cout << "ERROR::HEADLESS:: eglInitialize failed: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+			return false;
+		}
+
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			std::cout << "ERROR::HEADLESS:: EGL has no desktop OpenGL" << std::endl;
+			return false;
+		}
+
+		const EGLint ContextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		// EGL_KHR_no_config_context + EGL_KHR_surfaceless_context: no surface, no config
+		Context = eglCreateContext(Display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, ContextAttributes);
+		if (Context == EGL_NO_CONTEXT)
+		{
+			std::cout << "ERROR::HEADLESS:: eglCreateContext failed: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+			return false;
+		}
+
+		if (!eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context))
+		{
+			std::cout << "ERROR::HEADLESS:: eglMakeCurrent failed: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	void Destroy()
+	{
+#ifdef _WIN32
+		if (HiddenWindow != NULL)
+		{
+			glfwDestroyWindow(HiddenWindow);
+			glfwTerminate();
+			HiddenWindow = NULL;
+		}
+#else
+		if (Context != EGL_NO_CONTEXT)
+		{
+			eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(Display, Context);
+			eglTerminate(Display);
+			Context = EGL_NO_CONTEXT;
+		}
+#endif
+	}
+
+private:
+#ifdef _WIN32
+	GLFWwindow* HiddenWindow = NULL;
+#else
+	EGLDisplay Display = EGL_NO_DISPLAY;
+	EGLContext Context = EGL_NO_CONTEXT;
+#endif
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "DrawCounter.h"
+#include "GLState.h"
+
+// Per instance vertex attributes of one vertex array, for drawing every object of a kind with a
+// single instanced draw. Fill Data, then Upload sends it whole; the old storage is orphaned first,
+// so the driver never waits for draws still reading last frame's instances. Attribute declares an
+// attribute with a divisor of 1 on the bound vertex array. GL 3.3 has no base instance, so a draw
+// of a later run of instances points the attributes at it with Rebase.
+template <typename T>
+class InstanceBuffer
+{
+public:
+	std::vector<T> Data;
+
+	InstanceBuffer()
+	{
+		glGenBuffers(1, &Buffer);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, Buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(T), NULL, GL_STREAM_DRAW);
+	}
+
+	~InstanceBuffer()
+	{
+		GLState::DeleteBuffers(1, &Buffer);
+	}
+
+	// Components floats, or ints when bInteger, at Offset in each instance; the vertex array has to be bound
+	// ------------------------------------------------------------------------
+	void Attribute(unsigned int Location, int Components, size_t Offset, bool bInteger = false)
+	{
+		Attributes.push_back({ Location, Components, Offset, bInteger });
+		GLState::BindBuffer(GL_ARRAY_BUFFER, Buffer);
+		Point(Attributes.back(), Base);
+		glEnableVertexAttribArray(Location);
+		glVertexAttribDivisor(Location, 1);
+	}
+
+	// ------------------------------------------------------------------------
+	void Upload()
+	{
+		size_t Size = Data.size() * sizeof(T);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, Buffer);
+		glBufferData(GL_ARRAY_BUFFER, std::max(Size, sizeof(T)), NULL, GL_STREAM_DRAW);
+		if (Size > 0)
+			glBufferSubData(GL_ARRAY_BUFFER, 0, Size, Data.data());
+		DrawCounter::CountCalls(2);
+	}
+
+	// instance 0 of the following draws is First; the vertex array has to be bound
+	// ------------------------------------------------------------------------
+	void Rebase(size_t First)
+	{
+		if (First == Base)
+			return;
+		GLState::BindBuffer(GL_ARRAY_BUFFER, Buffer);
+		for (const AttributeSlot& Slot : Attributes)
+			Point(Slot, First);
+		Base = First;
+	}
+
+private:
+	struct AttributeSlot
+	{
+		unsigned int Location;
+		int Components;
+		size_t Offset;
+		bool bInteger;
+	};
+
+	unsigned int Buffer;
+	std::vector<AttributeSlot> Attributes;
+	// instance the attributes point at
+	size_t Base = 0;
+
+	static void Point(const AttributeSlot& Slot, size_t First)
+	{
+		const void* Pointer = (const void*)(First * sizeof(T) + Slot.Offset);
+		if (Slot.bInteger)
+			glVertexAttribIPointer(Slot.Location, Slot.Components, GL_INT, sizeof(T), Pointer);
+		else
+			glVertexAttribPointer(Slot.Location, Slot.Components, GL_FLOAT, GL_FALSE, sizeof(T), Pointer);
+		DrawCounter::CountCalls();
+	}
+};
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <xmmintrin.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "DrawCounter.h"
+#include "GLState.h"
+#include "Timer.h"
+#include "UniformBlocks.h"
+#include "WorkerPool.h"
+
+// texture units of the light buffers, after the diffuse and specular maps
+enum LightTextureUnit {
+	LIGHT_UNIT_DATA = 2,
+	LIGHT_UNIT_GRID = 3,
+	LIGHT_UNIT_INDICES = 4,
+	LIGHT_UNIT_DRAW_LISTS = 5
+};
+
+// Point lights of the scene and their assignment to a view space cluster grid.
+// Lights is the scene's point light list: edit it, then call Upload, which sends it to a buffer
+// texture (4 texels per light, laid out like PointLightBlock) only when it changed, so both eyes
+// share one upload. Build bins the lights into TilesX x TilesY screen tiles times Slices
+// exponential depth slices for one eye's camera. The slices are binned in parallel on the worker
+// pool, each light tested against 4 tile planes at a time with SSE, and the result goes to two
+// more buffer textures: an offset and count per cluster and the light indices of all clusters
+// back to back. The grid layout must match Clusters.include.glsl.
+class LightClusters
+{
+public:
+	static const int TilesX = 16;
+	static const int TilesY = 9;
+	static const int Slices = 24;
+	static const int Count = TilesX * TilesY * Slices;
+	// indices are 16 bit
+	static const int MaxLights = 65536;
+
+	// Range is filled in by Upload
+	std::vector<PointLightBlock> Lights;
+	// the lights' ranges again, as an array for the culling loops
+	std::vector<float> Ranges;
+
+	// last Build, and the sum of every Build
+	struct BuildStats
+	{
+		int Builds = 0;
+		unsigned int References = 0;
+		unsigned int MaxPerCluster = 0;
+		double Milliseconds = 0.0;
+	};
+	BuildStats Last;
+	BuildStats Total;
+
+	LightClusters(WorkerPool& Workers) : Workers(Workers)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			glGenBuffers(1, &Buffers[i]);
+			glGenTextures(1, &Textures[i]);
+			GLState::BindBuffer(GL_TEXTURE_BUFFER, Buffers[i]);
+			// never empty, a buffer texture without storage is incomplete
+			glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		}
+		const GLenum Formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+		for (int i = 0; i < 3; i++)
+		{
+			GLState::BindTexture(LIGHT_UNIT_DATA + i, Textures[i], GL_TEXTURE_BUFFER);
+			glTexBuffer(GL_TEXTURE_BUFFER, Formats[i], Buffers[i]);
+		}
+	}
+
+	~LightClusters()
+	{
+		GLState::DeleteTextures(3, Textures);
+		GLState::DeleteBuffers(3, Buffers);
+	}
+
+	// range where a light's brightest channel falls below 1/256: solve
+	// (ambient + diffuse + specular) / (constant + linear d + quadratic d^2) = 1/256 for d;
+	// 0 for a light that is below it already at d = 0, a black one included
+	// ------------------------------------------------------------------------
+	template <typename Light>
+	static float Range(const Light& Source)
+	{
+		glm::vec3 Color = Source.Ambient + Source.Diffuse + Source.Specular;
+		float Brightest = std::max(Color.r, std::max(Color.g, Color.b));
+		if (256.0f * Brightest <= Source.Constant)
+			return 0.0f;
+		float C = Source.Constant - 256.0f * Brightest;
+		if (Source.Quadratic <= 0.0f)
+			return Source.Linear > 0.0f ? -C / Source.Linear : 1.0e30f;
+		return (-Source.Linear + std::sqrt(Source.Linear * Source.Linear - 4.0f * Source.Quadratic * C)) / (2.0f * Source.Quadratic);
+	}
+
+	// send Lights to the GPU if they differ from the last upload
+	// ------------------------------------------------------------------------
+	void Upload()
+	{
+		if (Lights.size() > MaxLights)
+		{
+			std::cout << "ERROR::LIGHTCLUSTERS:: " << Lights.size() << " point lights, only the first " << MaxLights << " are used" << std::endl;
+			Lights.resize(MaxLights);
+		}
+		// the shaders cut each light off at its range
+		for (PointLightBlock& Light : Lights)
+			Light.Range = Range(Light);
+		if (Lights.size() == Uploaded.size() && (Lights.empty() || memcmp(Lights.data(), Uploaded.data(), Lights.size() * sizeof(PointLightBlock)) == 0))
+			return;
+
+		GLState::BindBuffer(GL_TEXTURE_BUFFER, Buffers[0]);
+		glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(Lights.size() * sizeof(PointLightBlock), 16), Lights.empty() ? NULL : Lights.data(), GL_STATIC_DRAW);
+		DrawCounter::CountCalls();
+		Uploaded = Lights;
+		++LightsVersion;
+
+		// positions and ranges as structure of arrays, padded to whole SSE registers
+		size_t Padded = (Lights.size() + 3) & ~(size_t)3;
+		Ranges.resize(Lights.size());
+		for (int Axis = 0; Axis < 3; Axis++)
+			Positions[Axis].assign(Padded, 0.0f);
+		for (size_t i = 0; i < Lights.size(); i++)
+		{
+			Ranges[i] = Lights[i].Range;
+			for (int Axis = 0; Axis < 3; Axis++)
+				Positions[Axis][i] = Lights[i].Position[Axis];
+		}
+	}
+
+	// bin the lights for a camera and upload the grid, a no-op if nothing changed since the last call
+	// ------------------------------------------------------------------------
+	void Build(const glm::mat4& Projection, const glm::mat4& View)
+	{
+		if (BuiltVersion == LightsVersion && Projection == BuiltProjection && View == BuiltView)
+			return;
+		double Start = GetTime();
+
+		if (Projection != BuiltProjection)
+			SetupPlanes(Projection);
+		BuiltProjection = Projection;
+		BuiltView = View;
+		BuiltVersion = LightsVersion;
+
+		TransformLights(View);
+
+		// a handful of lights is binned faster than the pool wakes up
+		std::function<void(int)> Job = [this](int Slice) { BinSlice(Slice); };
+		if (Lights.size() >= 64)
+			Workers.Run(Slices, Job);
+		else
+		{
+			for (int Slice = 0; Slice < Slices; Slice++)
+				BinSlice(Slice);
+		}
+
+		// slices are consecutive in the grid, their index lists are simply appended
+		Grid.resize(Count * 2);
+		Indices.clear();
+		Last.MaxPerCluster = 0;
+		for (int Slice = 0; Slice < Slices; Slice++)
+		{
+			const SliceBin& Bin = Bins[Slice];
+			unsigned int Base = (unsigned int)Indices.size();
+			for (int Tile = 0; Tile < TilesX * TilesY; Tile++)
+			{
+				int Cluster = Slice * TilesX * TilesY + Tile;
+				Grid[Cluster * 2] = Base + Bin.Offsets[Tile];
+				Grid[Cluster * 2 + 1] = Bin.Counts[Tile];
+				Last.MaxPerCluster = std::max(Last.MaxPerCluster, Bin.Counts[Tile]);
+			}
+			Indices.insert(Indices.end(), Bin.Indices.begin(), Bin.Indices.end());
+		}
+		if (Indices.empty())
+			Indices.push_back(0);
+
+		// orphan both, the previous eye's grid may still be in use
+		GLState::BindBuffer(GL_TEXTURE_BUFFER, Buffers[1]);
+		glBufferData(GL_TEXTURE_BUFFER, Grid.size() * sizeof(unsigned int), Grid.data(), GL_STREAM_DRAW);
+		GLState::BindBuffer(GL_TEXTURE_BUFFER, Buffers[2]);
+		glBufferData(GL_TEXTURE_BUFFER, Indices.size() * sizeof(unsigned short), Indices.data(), GL_STREAM_DRAW);
+		DrawCounter::CountCalls(2);
+
+		Last.Builds = 1;
+		Last.References = (unsigned int)Indices.size();
+		Last.Milliseconds = (GetTime() - Start) * 1000.0;
+		Total.Builds++;
+		Total.References += Last.References;
+		Total.MaxPerCluster = std::max(Total.MaxPerCluster, Last.MaxPerCluster);
+		Total.Milliseconds += Last.Milliseconds;
+	}
+
+	// changes whenever Upload sent a different set of lights
+	int Version() const
+	{
+		return LightsVersion;
+	}
+
+	// forget the last camera, the next Build bins again
+	void Invalidate()
+	{
+		BuiltVersion = -1;
+	}
+
+	// light data, grid and index buffers on their texture units
+	// ------------------------------------------------------------------------
+	void Bind() const
+	{
+		for (int i = 0; i < 3; i++)
+			GLState::BindTexture(LIGHT_UNIT_DATA + i, Textures[i], GL_TEXTURE_BUFFER);
+	}
+
+private:
+	WorkerPool& Workers;
+	unsigned int Buffers[3];
+	unsigned int Textures[3];
+
+	std::vector<PointLightBlock> Uploaded;
+	int LightsVersion = 0;
+	int BuiltVersion = -1;
+	glm::mat4 BuiltProjection = glm::mat4(0.0f);
+	glm::mat4 BuiltView;
+
+	// world and view space light positions, structure of arrays
+	std::vector<float> Positions[3];
+	std::vector<float> ViewPositions[3];
+	std::vector<unsigned char> FirstSlice;
+	std::vector<unsigned char> LastSlice;
+
+	// tile boundary planes through the eye, unit normals pointing towards higher tiles;
+	// column planes have no y and row planes no x component
+	static const int ColumnGroups = (TilesX + 1 + 3) / 4;
+	static const int RowGroups = (TilesY + 1 + 3) / 4;
+	alignas(16) float ColumnX[ColumnGroups * 4];
+	alignas(16) float ColumnZ[ColumnGroups * 4];
+	alignas(16) float RowY[RowGroups * 4];
+	alignas(16) float RowZ[RowGroups * 4];
+
+	// lights of one slice, ordered by tile
+	struct SliceBin
+	{
+		std::vector<unsigned int> Pairs;
+		std::vector<unsigned short> Indices;
+		unsigned int Counts[TilesX * TilesY];
+		unsigned int Offsets[TilesX * TilesY];
+	};
+	SliceBin Bins[Slices];
+
+	std::vector<unsigned int> Grid;
+	std::vector<unsigned short> Indices;
+
+	// view depth where slice Slice begins: the first starts at the eye, the last never ends.
+	// Depth d falls into slice log(d / SliceNear) * Slices / log(SliceFar / SliceNear).
+	// ------------------------------------------------------------------------
+	struct SliceTable
+	{
+		float Starts[Slices + 1];
+
+		SliceTable()
+		{
+			const float SliceNear = 0.5f;
+			const float SliceFar = 100.0f;
+			Starts[0] = 0.0f;
+			for (int i = 1; i < Slices; i++)
+				Starts[i] = SliceNear * std::pow(SliceFar / SliceNear, (float)i / Slices);
+			Starts[Slices] = 1.0e30f;
+		}
+	};
+
+	static float SliceStart(int Slice)
+	{
+		static const SliceTable Table;
+		return Table.Starts[Slice];
+	}
+
+	static int SliceOf(float Depth)
+	{
+		int Slice = 0;
+		while (Slice < Slices - 1 && Depth >= SliceStart(Slice + 1))
+			Slice++;
+		return Slice;
+	}
+
+	// The projection maps view space x to NDC as (P00 x + P20 z) / -z, so the plane where NDC x
+	// equals n is P00 x + (P20 + n) z = 0; rows likewise with P11 and P21.
+	// ------------------------------------------------------------------------
+	void SetupPlanes(const glm::mat4& Projection)
+	{
+		for (int i = 0; i < ColumnGroups * 4; i++)
+		{
+			float Ndc = -1.0f + 2.0f * std::min(i, TilesX) / TilesX;
+			glm::vec2 Normal = glm::normalize(glm::vec2(Projection[0][0], Projection[2][0] + Ndc));
+			ColumnX[i] = Normal.x;
+			ColumnZ[i] = Normal.y;
+		}
+		for (int i = 0; i < RowGroups * 4; i++)
+		{
+			float Ndc = -1.0f + 2.0f * std::min(i, TilesY) / TilesY;
+			glm::vec2 Normal = glm::normalize(glm::vec2(Projection[1][1], Projection[2][1] + Ndc));
+			RowY[i] = Normal.x;
+			RowZ[i] = Normal.y;
+		}
+	}
+
+	// view space positions four lights at a time, and the slices each light can reach
+	// ------------------------------------------------------------------------
+	void TransformLights(const glm::mat4& View)
+	{
+		size_t Padded = Positions[0].size();
+		for (int Axis = 0; Axis < 3; Axis++)
+			ViewPositions[Axis].resize(Padded);
+		for (int Row = 0; Row < 3; Row++)
+		{
+			__m128 M0 = _mm_set1_ps(View[0][Row]);
+			__m128 M1 = _mm_set1_ps(View[1][Row]);
+			__m128 M2 = _mm_set1_ps(View[2][Row]);
+			__m128 M3 = _mm_set1_ps(View[3][Row]);
+			for (size_t i = 0; i < Padded; i += 4)
+			{
+				__m128 Result = _mm_add_ps(_mm_mul_ps(M0, _mm_loadu_ps(&Positions[0][i])), _mm_mul_ps(M1, _mm_loadu_ps(&Positions[1][i])));
+				Result = _mm_add_ps(Result, _mm_add_ps(_mm_mul_ps(M2, _mm_loadu_ps(&Positions[2][i])), M3));
+				_mm_storeu_ps(&ViewPositions[Row][i], Result);
+			}
+		}
+
+		FirstSlice.resize(Lights.size());
+		LastSlice.resize(Lights.size());
+		for (size_t i = 0; i < Lights.size(); i++)
+		{
+			float Depth = -ViewPositions[2][i];
+			// no range or entirely behind the eye: an empty slice range
+			if (Ranges[i] <= 0.0f || Depth + Ranges[i] <= 0.0f)
+			{
+				FirstSlice[i] = 1;
+				LastSlice[i] = 0;
+				continue;
+			}
+			FirstSlice[i] = (unsigned char)SliceOf(Depth - Ranges[i]);
+			LastSlice[i] = (unsigned char)SliceOf(Depth + Ranges[i]);
+		}
+	}
+
+	// tiles between consecutive planes a sphere overlaps, as a bit mask: tile i lies above plane i
+	// and below plane i + 1. Four signed plane distances per SSE operation.
+	// ------------------------------------------------------------------------
+	static unsigned int TileMask(const float* NormalA, const float* NormalZ, int Groups, int Tiles, float A, float Z, float Radius)
+	{
+		__m128 CenterA = _mm_set1_ps(A);
+		__m128 CenterZ = _mm_set1_ps(Z);
+		__m128 Positive = _mm_set1_ps(Radius);
+		__m128 Negative = _mm_set1_ps(-Radius);
+		unsigned int Above = 0;
+		unsigned int Below = 0;
+		for (int Group = 0; Group < Groups; Group++)
+		{
+			__m128 Distance = _mm_add_ps(_mm_mul_ps(_mm_load_ps(NormalA + Group * 4), CenterA), _mm_mul_ps(_mm_load_ps(NormalZ + Group * 4), CenterZ));
+			Above |= (unsigned int)_mm_movemask_ps(_mm_cmpgt_ps(Distance, Negative)) << (Group * 4);
+			Below |= (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(Distance, Positive)) << (Group * 4);
+		}
+		return Above & (Below >> 1) & ((1u << Tiles) - 1);
+	}
+
+	// every light reaching one slice, sorted into its tiles
+	// ------------------------------------------------------------------------
+	void BinSlice(int Slice)
+	{
+		SliceBin& Bin = Bins[Slice];
+		Bin.Pairs.clear();
+		float Start = SliceStart(Slice);
+		float End = SliceStart(Slice + 1);
+
+		for (size_t i = 0; i < Lights.size(); i++)
+		{
+			if (Slice < FirstSlice[i] || Slice > LastSlice[i])
+				continue;
+
+			// the part of the sphere inside the slice lies within a smaller sphere around the
+			// closest point of the slice
+			float Depth = -ViewPositions[2][i];
+			float Nearest = std::min(std::max(Depth, Start), End);
+			float Offset = Depth - Nearest;
+			float Radius = std::sqrt(std::max(Ranges[i] * Ranges[i] - Offset * Offset, 0.0f));
+
+			unsigned int Columns = TileMask(ColumnX, ColumnZ, ColumnGroups, TilesX, ViewPositions[0][i], -Nearest, Radius);
+			unsigned int Rows = TileMask(RowY, RowZ, RowGroups, TilesY, ViewPositions[1][i], -Nearest, Radius);
+			for (int y = 0; y < TilesY; y++)
+			{
+				if ((Rows & (1u << y)) == 0)
+					continue;
+				for (int x = 0; x < TilesX; x++)
+				{
+					if (Columns & (1u << x))
+						Bin.Pairs.push_back((unsigned int)(y * TilesX + x) | ((unsigned int)i << 16));
+				}
+			}
+		}
+
+		// counting sort by tile
+		memset(Bin.Counts, 0, sizeof(Bin.Counts));
+		for (unsigned int Pair : Bin.Pairs)
+			Bin.Counts[Pair & 0xFFFF]++;
+		unsigned int Offset = 0;
+		for (int Tile = 0; Tile < TilesX * TilesY; Tile++)
+		{
+			Bin.Offsets[Tile] = Offset;
+			Offset += Bin.Counts[Tile];
+		}
+		Bin.Indices.resize(Bin.Pairs.size());
+		unsigned int Next[TilesX * TilesY];
+		memcpy(Next, Bin.Offsets, sizeof(Next));
+		for (unsigned int Pair : Bin.Pairs)
+			Bin.Indices[Next[Pair & 0xFFFF]++] = (unsigned short)(Pair >> 16);
+	}
+};
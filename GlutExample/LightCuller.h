@@ -0,0 +1,228 @@
+#pragma once
+
+#include <xmmintrin.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "DrawCounter.h"
+#include "GLState.h"
+#include "LightClusters.h"
+#include "Timer.h"
+#include "WorkerPool.h"
+
+// world space bounding box of an object, center and half size
+struct ObjectBounds
+{
+	glm::vec3 Center;
+	glm::vec3 Extent;
+};
+
+// Point light lists per object, from testing every light's range sphere against the object's
+// bounding box on the CPU. The lights are kept sorted by x as a structure of arrays, so an object
+// only visits the run of lights whose x can reach it, four sphere tests per SSE operation, and
+// the objects are spread over the worker pool. Lists are rebuilt only when the lights or the
+// bounds changed; they also go to a buffer texture of 16 bit indices for draws whose list is
+// looked up in the shader.
+class LightCuller
+{
+public:
+	// a run of Indices
+	struct List
+	{
+		unsigned int Offset;
+		unsigned int Count;
+	};
+	std::vector<List> Lists;
+	std::vector<unsigned short> Indices;
+
+	// last Cull, and the sum of every Cull
+	struct CullStats
+	{
+		int Culls = 0;
+		unsigned int References = 0;
+		double Milliseconds = 0.0;
+	};
+	CullStats Last;
+	CullStats Total;
+
+	LightCuller(WorkerPool& Workers) : Workers(Workers)
+	{
+		glGenBuffers(1, &Buffer);
+		glGenTextures(1, &Texture);
+		GLState::BindBuffer(GL_TEXTURE_BUFFER, Buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		GLState::BindTexture(LIGHT_UNIT_DRAW_LISTS, Texture, GL_TEXTURE_BUFFER);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, Buffer);
+	}
+
+	~LightCuller()
+	{
+		GLState::DeleteTextures(1, &Texture);
+		GLState::DeleteBuffers(1, &Buffer);
+	}
+
+	// box around a unit cube drawn with Model
+	// ------------------------------------------------------------------------
+	static ObjectBounds CubeBounds(const glm::mat4& Model)
+	{
+		ObjectBounds Bounds;
+		Bounds.Center = glm::vec3(Model[3]);
+		for (int Axis = 0; Axis < 3; Axis++)
+			Bounds.Extent[Axis] = 0.5f * (std::abs(Model[0][Axis]) + std::abs(Model[1][Axis]) + std::abs(Model[2][Axis]));
+		return Bounds;
+	}
+
+	// lists of the lights reaching each object, a no-op if nothing changed since the last call
+	// ------------------------------------------------------------------------
+	void Cull(const LightClusters& Lights, const std::vector<ObjectBounds>& Objects)
+	{
+		bool bLightsChanged = Lights.Version() != CulledVersion;
+		if (!bLightsChanged && Objects.size() == Culled.size() && (Objects.empty() || memcmp(Objects.data(), Culled.data(), Objects.size() * sizeof(ObjectBounds)) == 0))
+			return;
+		double Start = GetTime();
+
+		if (bLightsChanged)
+			SortLights(Lights);
+		CulledVersion = Lights.Version();
+		Culled = Objects;
+
+		// a few hundred objects per job, the pool only for more than one job
+		int Jobs = std::min((int)Objects.size() / 256 + 1, 64);
+		JobLists.resize(Jobs);
+		Lists.resize(Objects.size());
+		Workers.Run(Jobs, [&](int Job)
+		{
+			size_t First = Objects.size() * Job / Jobs;
+			size_t End = Objects.size() * (Job + 1) / Jobs;
+			std::vector<unsigned short>& Out = JobLists[Job];
+			Out.clear();
+			for (size_t i = First; i < End; i++)
+			{
+				Lists[i].Offset = (unsigned int)Out.size();
+				CullObject(Objects[i], Out);
+				Lists[i].Count = (unsigned int)Out.size() - Lists[i].Offset;
+			}
+		});
+
+		// job results are in object order, append them and move the offsets along
+		Indices.clear();
+		for (int Job = 0; Job < Jobs; Job++)
+		{
+			unsigned int Base = (unsigned int)Indices.size();
+			for (size_t i = Objects.size() * Job / Jobs; i < Objects.size() * (Job + 1) / Jobs; i++)
+				Lists[i].Offset += Base;
+			Indices.insert(Indices.end(), JobLists[Job].begin(), JobLists[Job].end());
+		}
+
+		GLState::BindBuffer(GL_TEXTURE_BUFFER, Buffer);
+		glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(Indices.size() * sizeof(unsigned short), 16), Indices.empty() ? NULL : Indices.data(), GL_STREAM_DRAW);
+		DrawCounter::CountCalls();
+
+		Last.Culls = 1;
+		Last.References = (unsigned int)Indices.size();
+		Last.Milliseconds = (GetTime() - Start) * 1000.0;
+		Total.Culls++;
+		Total.References += Last.References;
+		Total.Milliseconds += Last.Milliseconds;
+	}
+
+	// forget the last result, the next Cull runs again
+	void Invalidate()
+	{
+		CulledVersion = -1;
+	}
+
+	// changes whenever a Cull rebuilt the lists
+	int Version() const
+	{
+		return Total.Culls;
+	}
+
+	// index buffer of the lists on its texture unit
+	void Bind() const
+	{
+		GLState::BindTexture(LIGHT_UNIT_DRAW_LISTS, Texture, GL_TEXTURE_BUFFER);
+	}
+
+private:
+	WorkerPool& Workers;
+	unsigned int Buffer;
+	unsigned int Texture;
+
+	int CulledVersion = -1;
+	std::vector<ObjectBounds> Culled;
+	std::vector<std::vector<unsigned short>> JobLists;
+
+	// lights sorted by x, structure of arrays padded to whole SSE registers with lights that
+	// reach nothing
+	std::vector<float> X, Y, Z, RangeSquared;
+	std::vector<unsigned short> Index;
+	size_t Count = 0;
+	float MaxRange = 0.0f;
+
+	void SortLights(const LightClusters& Lights)
+	{
+		Count = Lights.Lights.size();
+		std::vector<unsigned short> Order(Count);
+		std::iota(Order.begin(), Order.end(), (unsigned short)0);
+		std::sort(Order.begin(), Order.end(), [&](unsigned short a, unsigned short b) { return Lights.Lights[a].Position.x < Lights.Lights[b].Position.x; });
+
+		size_t Padded = (Count + 3) & ~(size_t)3;
+		X.assign(Padded, 1.0e30f);
+		Y.assign(Padded, 0.0f);
+		Z.assign(Padded, 0.0f);
+		RangeSquared.assign(Padded, -1.0f);
+		Index.assign(Padded, 0);
+		MaxRange = 0.0f;
+		for (size_t i = 0; i < Count; i++)
+		{
+			const PointLightBlock& Light = Lights.Lights[Order[i]];
+			X[i] = Light.Position.x;
+			Y[i] = Light.Position.y;
+			Z[i] = Light.Position.z;
+			// a light without range reaches nothing, like the padding
+			RangeSquared[i] = Lights.Ranges[Order[i]] > 0.0f ? Lights.Ranges[Order[i]] * Lights.Ranges[Order[i]] : -1.0f;
+			Index[i] = Order[i];
+			MaxRange = std::max(MaxRange, Lights.Ranges[Order[i]]);
+		}
+	}
+
+	// lights whose range sphere touches the box: the distance from the light to the box is the
+	// length of max(|light - center| - extent, 0)
+	// ------------------------------------------------------------------------
+	void CullObject(const ObjectBounds& Bounds, std::vector<unsigned short>& Out) const
+	{
+		// only lights within the largest range of the box in x can reach it
+		size_t First = std::lower_bound(X.begin(), X.begin() + Count, Bounds.Center.x - Bounds.Extent.x - MaxRange) - X.begin();
+		size_t End = std::upper_bound(X.begin() + First, X.begin() + Count, Bounds.Center.x + Bounds.Extent.x + MaxRange) - X.begin();
+		First &= ~(size_t)3;
+
+		const __m128 SignBit = _mm_set1_ps(-0.0f);
+		const __m128 Zero = _mm_setzero_ps();
+		__m128 CenterX = _mm_set1_ps(Bounds.Center.x);
+		__m128 CenterY = _mm_set1_ps(Bounds.Center.y);
+		__m128 CenterZ = _mm_set1_ps(Bounds.Center.z);
+		__m128 ExtentX = _mm_set1_ps(Bounds.Extent.x);
+		__m128 ExtentY = _mm_set1_ps(Bounds.Extent.y);
+		__m128 ExtentZ = _mm_set1_ps(Bounds.Extent.z);
+		for (size_t i = First; i < End; i += 4)
+		{
+			__m128 DX = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(SignBit, _mm_sub_ps(_mm_loadu_ps(&X[i]), CenterX)), ExtentX), Zero);
+			__m128 DY = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(SignBit, _mm_sub_ps(_mm_loadu_ps(&Y[i]), CenterY)), ExtentY), Zero);
+			__m128 DZ = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(SignBit, _mm_sub_ps(_mm_loadu_ps(&Z[i]), CenterZ)), ExtentZ), Zero);
+			__m128 Distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(DX, DX), _mm_mul_ps(DY, DY)), _mm_mul_ps(DZ, DZ));
+			int Hits = _mm_movemask_ps(_mm_cmple_ps(Distance, _mm_loadu_ps(&RangeSquared[i])));
+			for (; Hits != 0; Hits &= Hits - 1)
+			{
+				int Lane = Hits & 1 ? 0 : Hits & 2 ? 1 : Hits & 4 ? 2 : 3;
+				Out.push_back(Index[i + Lane]);
+			}
+		}
+	}
+};
@@ -17,14 +17,105 @@
 #include "Camera.h"
 #include "FileSystem.h"
 #include "Shader.h"
+#include "FramePacer.h"
+#include "FrameStats.h"
+#include "GpuProfiler.h"
+#include "RenderTarget.h"
+#include "StereoReprojection.h"
+#include "DeferredRenderer.h"
+#include "FoveatedRenderer.h"
+#include "HeadlessContext.h"
+#include "Timer.h"
+#include "Benchmark.h"
+#include "DrawCounter.h"
+#include "GLState.h"
+#include "FrameCapture.h"
+#include "VideoRecorder.h"
+#include "UniformBlocks.h"
+#include "ShaderWatcher.h"
+#include "ShadowMaps.h"
+#include "ShaderBatch.h"
+#include "ShaderVariants.h"
+#include "WorkerPool.h"
+#include "LightClusters.h"
+#include "LightCuller.h"
+#include "NormalMatrices.h"
+#include "FramePacket.h"
+#include "InstanceBuffer.h"
+#include "PackedMesh.h"
 
 #include <iostream>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// command line settings
+struct AppOptions
+{
+	// render into framebuffer objects without a window or monitor
+	bool bHeadless = false;
+	// headless framebuffer size, both eyes side by side
+	int Width = 5120;
+	int Height = 1440;
+	// stop after this many frames, 0 runs until the window is closed
+	int Frames = 0;
+	// scripted eyes, fixed time step and a JSON report instead of the live tracker
+	bool bBenchmark = false;
+	// scene to render, the plain stereo path only draws the debug point without one
+	bool bRenderScene = false;
+	ScenePreset Scene = SCENE_CUBES;
+	// write every frame to disk from the first one on
+	bool bCapture = false;
+	FrameCapture::Format CaptureFormat = FrameCapture::FORMAT_TGA;
+	// record the side-by-side output to this Y4M file from the first frame on
+	std::string RecordPath;
+	// point lights scattered through the scene, 0 keeps the four of the demo
+	int PointLights = 0;
+	// shade the containers deferred instead of forward from the first frame on
+	bool bDeferred = false;
+	// directional and spot light shadows
+	bool bShadows = true;
+	// frame rate the pacer holds, 0 leaves the frames unpaced
+	double FrameLimit = 0.0;
+	// containers and lamps drawn instanced instead of one draw per object
+	bool bInstanced = true;
+	// write the frame stats files on exit as well, F7 writes them any time
+	bool bExportStats = false;
+};
+
+// feature bits of the lighting shader variants, see the switches in Main.fragment.glsl
+enum LightingFeature {
+	// number of point lights, 0 to 4
+	LIGHTING_POINT_LIGHTS = 0x7,
+	LIGHTING_DIR_LIGHT = 0x8,
+	LIGHTING_SPOT_LIGHT = 0x10,
+	LIGHTING_SPECULAR_MAP = 0x20,
+	// point lights looked up per fragment in the light clusters, for scenes with many lights
+	LIGHTING_CLUSTERED = 0x40,
+	// every point light per fragment, reference for the cluster benchmark
+	LIGHTING_EVERY_POINT_LIGHT = 0x80,
+	// the draw's culled point lights, looked up in the list buffer, for more than 4 of them
+	LIGHTING_LIGHT_LIST = 0x100,
+	// directional and spot light shadow lookups
+	LIGHTING_SHADOWS = 0x200,
+	// normal matrix inverted per vertex, reference for the normal matrix benchmark
+	LIGHTING_VERTEX_INVERSE = 0x400,
+	// placement and point lights per instance, for the instanced container draws
+	LIGHTING_INSTANCED = 0x800,
+	LIGHTING_ALL = 4 | LIGHTING_DIR_LIGHT | LIGHTING_SPOT_LIGHT | LIGHTING_SPECULAR_MAP
+};
 
 class App
 {
 public:
-	App();
+	App(const AppOptions& Options);
 	~App();
 
 	void Start();
@@ -36,19 +127,86 @@ private:
 	void LoadCubes();
 	void LoadLight();
 	void LoadDebugPoint();
+	void UploadLampInstances();
 
+	void CubePlacement(unsigned int Index, glm::vec4& PositionScale, glm::quat& Rotation) const;
+	bool BuildCubeDraws();
+	const std::vector<glm::mat3>& FrameCubeNormals();
 	void RenderCubes();
+	void RenderCubesInstanced();
+	void RenderCubesDeferred();
+	void RenderShadowMaps();
 	void RenderLight();
 	void RenderDebugPoint();
+	void RenderScene();
+	void RenderEyeScene();
+	void RenderEyeSceneTo(RenderTarget& Target);
+
+	void RenderReprojectedStereo();
+	void BenchmarkReprojection();
+
+	void RenderEyesOffscreen();
+	void PresentWithLatestPose();
+	void RestartLateWarpReport();
+
+	glm::vec2 GazePointNDC();
+	void RenderFoveatedEye(bool IsLeftEye, int x, int y, int width, int height);
+	void RenderFoveatedStereo();
+	void BenchmarkFoveation();
+
+	unsigned int LightingVariantFor(const ObjectBounds& Bounds, const LightCuller::List& Listed, glm::ivec4& PointLights) const;
+	void BenchmarkLightingVariants();
+
+	void BuildPointLights(int Count);
+	void BenchmarkClusteredLighting();
+	void BenchmarkDeferredShading();
+	void BenchmarkNormalMatrices();
+	void BenchmarkInstancing();
+	void BenchmarkVertexFormat();
 
 private:
 	static void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 	static void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 	static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+	static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 	static void processInput(GLFWwindow *window);
 	static unsigned int loadTexture(const char *path);
+	void FetchPose();
+	void PrepareFrame();
+	void PrepareEyes(FramePacket& Packet);
+	void PrepareScene(FramePacket& Packet);
+	void ExportStats();
+	void SetupEye(bool IsLeftEye);
 	void MainRender(bool IsLeftEye);
+	bool ShouldClose();
+	void PresentHeadless();
+	void ReportBenchmark(double Seconds);
+	void CacheUniforms();
+	void ReloadShaders();
+	void UpdateCameraBlock();
+	void ToggleRecording(const std::string& Path);
 private:
+	AppOptions Options;
+	int FramesRendered = 0;
+
+	// headless: the context has no default framebuffer, the screen is this target instead
+	HeadlessContext* Headless = nullptr;
+	RenderTarget* HeadlessTarget = nullptr;
+	GLsync HeadlessFences[2] = { 0, 0 };
+
+	// benchmark run inputs
+	BenchmarkScript Script;
+
+	// asynchronous capture of the presented frames
+	FrameCapture* Capture;
+	bool bCapturing = false;
+
+	// continuous Y4M recording of the presented frames
+	VideoRecorder* Recorder;
+
+	// rebuilds the scene shaders when their files change, off in benchmarks
+	ShaderWatcher* ShaderFiles = nullptr;
+
 	// settings
 	unsigned int SCR_WIDTH;
 	unsigned int SCR_HEIGHT;
@@ -86,7 +244,13 @@ private:
 	// timing
 	float deltaTime = 0.0f;
 	float lastFrame = 0.0f;
-	double FrameLimit = 0.0;
+	FramePacer Pacer;
+	// frame interval report once a second, always on while pacing
+	bool bPacerReport = false;
+	FrameStats* Stats;
+	bool bExportStats = false;
+	GpuProfiler* Profiler;
+	bool bExportTimeline = false;
 
 	// lighting
 	glm::vec3 lightPos = glm::vec3(1.2f, 1.0f, 2.0f);
@@ -94,14 +258,162 @@ private:
 	unsigned int diffuseMap;
 	unsigned int specularMap;
 
-	Shader* lightingShader;
 	Shader* lampShader;
+	Shader* lampInstancedShader;
 	Shader* DebugPointShader;
 
+	// uniform handles, resolved once after the shaders are linked
+	struct TransformUniforms
+	{
+		int Projection, View, Model;
+
+		void Load(const Shader* Program)
+		{
+			Projection = Program->uniform("projection");
+			View = Program->uniform("view");
+			Model = Program->uniform("model");
+		}
+	};
+
+	struct LightingUniforms
+	{
+		int Model, NormalMatrix, PointLightIndices, DrawLightRange;
+
+		void Load(const Shader* Program)
+		{
+			Model = Program->uniform("model");
+			NormalMatrix = Program->uniform("normalMatrix");
+			PointLightIndices = Program->uniform("pointLightIndices");
+			DrawLightRange = Program->uniform("drawLightRange");
+		}
+	};
+
+	// the lighting shader specialized per LightingFeature mask, picked per draw
+	ShaderVariants<LightingUniforms>* LightingShaders;
+	// -1 picks per draw, a mask forces that variant everywhere (variant benchmark)
+	int ForcedLightingVariant = -1;
+	bool bRunLightingBenchmark = false;
+
+	// point lights of the scene and their per eye clusters, binned on the worker threads
+	WorkerPool* Workers;
+	LightClusters* Clusters;
+	bool bRunClusterBenchmark = false;
+	// point lights reaching each container, from the bounds in the frame packet
+	LightCuller* Culler;
+
+	// G-buffer path for the containers, shared by both eyes
+	DeferredRenderer* Deferred;
+	bool bDeferred = false;
+	bool bRunDeferredBenchmark = false;
+
+	// light space depth of the containers, rendered once per frame before the eyes
+	ShadowMaps* Shadows;
+	bool bShadows = true;
+	// packet the maps were last fitted to, 0 before the first
+	unsigned int ShadowMapsFrame = 0;
+
+	// the frame being submitted, from PrepareFrame; the other packet is where the next one is prepared
+	FramePacket Packets[2];
+	const FramePacket* Frame = nullptr;
+
+	// normal matrices of the containers, batched once per frame by the first draw that takes them;
+	// instances carry no model, so the instanced path never pays for them
+	NormalMatrices CubeNormals;
+	std::vector<glm::mat3> CubeNormalMatrices;
+	unsigned int CubeNormalsFrame = 0;
+	bool bRunNormalMatrixBenchmark = false;
+
+	struct CubeDraw
+	{
+		unsigned int Variant;
+		glm::ivec4 PointLights;
+		// offset and count in the culled light lists
+		glm::ivec2 LightList;
+		// index into the frame's containers
+		unsigned int Object;
+
+		bool operator<(const CubeDraw& Other) const { return Variant < Other.Variant; }
+	};
+	std::vector<CubeDraw> CubeDraws;
+
+	// containers and lamps from instance buffers, one draw per lighting variant and eye
+	bool bInstanced = true;
+	bool bRunInstancingBenchmark = false;
+	bool bRunVertexFormatBenchmark = false;
+	struct CubeInstance
+	{
+		glm::vec4 PositionScale;
+		glm::quat Rotation;
+		glm::ivec4 PointLights;
+		glm::ivec2 LightList;
+	};
+	InstanceBuffer<CubeInstance>* CubeInstances;
+	InstanceBuffer<glm::vec3>* LampInstances;
+	InstanceBuffer<CubeInstance>* CreateCubeInstances();
+	// a run of CubeInstances drawn with one lighting variant
+	struct InstanceGroup
+	{
+		unsigned int Variant;
+		unsigned int First;
+		unsigned int Count;
+	};
+	std::vector<InstanceGroup> CubeInstanceGroups;
+	bool bCubeInstancesClustered = false;
+	// what CubeInstances were built from, both eyes of a frame share them
+	unsigned int CubeInstancesFrame = 0;
+	int CubeInstancesForcedVariant = -1;
+	int CubeInstancesCullVersion = -1;
+	bool bCubeInstancesShadows = false;
+
+	// size of the lamp cubes
+	const float LampScale = 0.2f;
+	int LampModelLocation;
+	int LampIndexLocation;
+	int LampLightsLocation;
+	TransformUniforms DebugPointLocations;
+
+	// std140 blocks shared by the lighting and lamp shaders, uploaded only when they change
+	UniformBlock<CameraBlock>* CameraUniforms;
+	UniformBlock<LightsBlock>* LightUniforms;
+	UniformBlock<MaterialBlock>* MaterialUniforms;
+
+	// stereo reprojection: render the left eye only and synthesize the right one from its depth
+	bool bStereoReprojection = false;
+	bool bRunReprojectionBenchmark = false;
+	StereoReprojection* Reprojection;
+	RenderTarget* SourceEyeTarget;
+	RenderTarget* WarpTarget;
+
+	// late warp: eyes go offscreen and are reprojected right before the swap if a newer pose arrived
+	bool bLateWarp = false;
+	RenderTarget* EyeTargets[2];
+	glm::mat4 EyeViewProjection[2];
+	// warp timer queries in flight, with the report window each was issued in or -1 while free
+	static const int LateWarpQueryCount = 4;
+	unsigned int LateWarpQueries[LateWarpQueryCount];
+	int LateWarpQueryWindow[LateWarpQueryCount] = { -1, -1, -1, -1 };
+
+	// late warp statistics, reported once per second
+	int LateWarpWindow = 0;
+	int LateWarpFrames = 0;
+	int LateWarpWarped = 0;
+	double LateWarpRenderedPoseAge = 0.0;
+	double LateWarpPresentedPoseAge = 0.0;
+	// GPU time of the warps whose queries came back, and how many did
+	double LateWarpGPUTime = 0.0;
+	int LateWarpGPUSamples = 0;
+	double LateWarpReportTime = 0.0;
+
+	// foveated rendering around the projected gaze point
+	bool bFoveated = false;
+	bool bRunFoveationBenchmark = false;
+	FoveatedRenderer* Foveation;
+
 // Geometry
 private:
 	// set up vertex data (and buffer(s)) and configure vertex attributes
 	// ------------------------------------------------------------------
+	// the cube as a triangle list, LoadCubes packs and indexes it into CubeMesh
 	float CubeVertices[288] = {
 		// positions          // normals           // texture coords
 		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
@@ -162,7 +474,7 @@ private:
 	};
 
 	// positions all containers
-	glm::vec3 cubePositions[10] = {
+	std::vector<glm::vec3> cubePositions = {
 		glm::vec3(0.0f,  0.05f,  2.0f),
 		glm::vec3(2.0f,  5.0f, -15.0f),
 		glm::vec3(-1.5f, -2.2f, -2.5f),
@@ -174,6 +486,8 @@ private:
 		glm::vec3(1.5f,  0.2f, -1.5f),
 		glm::vec3(-1.3f,  1.0f, -1.5f)
 	};
+	// counts up whenever cubePositions change, so the shadow maps know their casters moved
+	unsigned int CubesVersion = 0;
 	// positions of the point lights
 	glm::vec3 pointLightPositions[4] = {
 		glm::vec3(0.7f,  3.2f,  -2.0f),
@@ -181,6 +495,8 @@ private:
 		glm::vec3(-4.0f,  2.0f, -12.0f),
 		glm::vec3(0.0f,  2.0f, 3.0f)
 	};
+	// lamp cubes drawn, the point lights unless a scene preset adds more
+	std::vector<glm::vec3> LampPositions;
 
 // GLFW
 private:
@@ -199,22 +515,14 @@ private:
 
 // Eye Tracking data
 private:
+	unsigned int RenderPoseSequence = 0;
+	double RenderPoseTimestamp = 0.0;
 	glm::vec3 LeftEye;
 	glm::vec3 RightEye;
-	glm::vec3 MiddleEye;
-
-// Parralax scale
-private:
-	glm::vec3 LeftEyeScaled;
-	glm::vec3 RightEyeScaled;
-	float width_cm_scaled;
-	float height_cm_scaled;
 
 // Eye coords
 private:
 	glm::vec3 EyeViewPointOffset_inUnits;
-	glm::vec3 FacePosOriginal;
-	glm::vec3 EyeSeparation;
 
 // Matrices
 private:
@@ -223,8 +531,11 @@ private:
 
 // OpenGl buffers
 private:
-	unsigned int cubeVBO, DebugPointVBO;
+	unsigned int DebugPointVBO;
+	PackedMesh* CubeMesh;
 	unsigned int lightVAO, cubeVAO, DebugPointVAO;
+	// the cube's vertices plus the instance buffers
+	unsigned int lightInstancedVAO, cubeInstancedVAO;
 	unsigned int DebugPointEBO;
 
 };
@@ -232,110 +543,312 @@ private:
 // Set global pointer
 App* App::app = nullptr;
 
-App::App()
+App::App(const AppOptions& Options) : Options(Options)
 {
 	// Set Global poiter first
 	app = this;
 
 
-	// start listening UDP packages
+	// start listening UDP packages, benchmarks run on a scripted trajectory instead and headless
+	// runs keep the default eyes, neither takes the tracker's port
 	camera = new Camera(glm::vec3(0.0f, 0.0f, 100.0f / 100.f));
-	camera->ListenCamerasUDP();
+	if (!Options.bBenchmark && !Options.bHeadless)
+		camera->ListenCamerasUDP();
+
+	LampPositions.assign(pointLightPositions, pointLightPositions + 4);
+	BenchmarkScript::BuildScene(Options.Scene, cubePositions, LampPositions);
+	++CubesVersion;
+
+	if (Options.bHeadless)
+	{
+		// no window system: a bare context, the screen is an offscreen target of the requested size
+		Headless = new HeadlessContext();
+		if (!Headless->Create())
+		{
+			std::cout << "Failed to create headless OpenGL context" << std::endl;
+			exit(-1);
+		}
+
+		SCR_WIDTH = CurrentWidth = Options.Width;
+		SCR_HEIGHT = CurrentHeight = Options.Height;
+		lastX = SCR_WIDTH / 2.0f;
+		lastY = SCR_HEIGHT / 2.0f;
+		window = NULL;
+
+		Pacer.TargetFPS = Options.FrameLimit;
+		Pacer.RefreshRate = 60.0;
+
+		glewExperimental = GL_TRUE;
+		// GLEW's GLX display lookup fails without an X server, the function pointers load regardless
+		glewInit();
+		glGetError();
 
-	// glfw: initialize and configure
-	// ------------------------------
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_AUTO_ICONIFY, GLFW_FALSE);
+		HeadlessTarget = new RenderTarget(CurrentWidth, CurrentHeight);
+		RenderTarget::ScreenFramebuffer() = HeadlessTarget->FBO;
+		RenderTarget::BindScreen();
+		GLState::Viewport(0, 0, CurrentWidth, CurrentHeight);
 
-	glfwSwapInterval(0);
+		std::cout << "Headless rendering " << CurrentWidth << "x" << CurrentHeight << " (" << glGetString(GL_RENDERER) << ")" << std::endl;
+	}
+	else
+	{
+		// glfw: initialize and configure
+		// ------------------------------
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_AUTO_ICONIFY, GLFW_FALSE);
+
+		glfwSwapInterval(0);
 
 
 #ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-	// read data about monitor
-	PrimaryMonitor = glfwGetPrimaryMonitor();
-	Monitors = glfwGetMonitors(&MonitorsCount);
-	DimencoMonitor = Monitors[MonitorsCount - 1];
-	DimencoMonitorMode = glfwGetVideoMode(PrimaryMonitor);
+		// read data about monitor
+		PrimaryMonitor = glfwGetPrimaryMonitor();
+		Monitors = glfwGetMonitors(&MonitorsCount);
+		DimencoMonitor = Monitors[MonitorsCount - 1];
+		DimencoMonitorMode = glfwGetVideoMode(PrimaryMonitor);
 
-	// Setup settings sizes
-	SCR_WIDTH = CurrentWidth = DimencoMonitorMode->width;
-	SCR_HEIGHT = CurrentHeight = DimencoMonitorMode->height;
+		// Setup settings sizes
+		SCR_WIDTH = CurrentWidth = DimencoMonitorMode->width;
+		SCR_HEIGHT = CurrentHeight = DimencoMonitorMode->height;
 
-	// camera sizes
-	lastX = SCR_WIDTH / 2.0f;
-	lastY = SCR_HEIGHT / 2.0f;
+		// camera sizes
+		lastX = SCR_WIDTH / 2.0f;
+		lastY = SCR_HEIGHT / 2.0f;
 
 
-	// glfw window creation
-	// --------------------
+		// glfw window creation
+		// --------------------
 
-	//window = glfwCreateWindow(DimencoMonitorMode->width, DimencoMonitorMode->height, "LearnOpenGL", NULL, NULL); // windowed
+		//window = glfwCreateWindow(DimencoMonitorMode->width, DimencoMonitorMode->height, "LearnOpenGL", NULL, NULL); // windowed
 	
-	// "Windowed full screen" windows
-	//glfwWindowHint(GLFW_RED_BITS, DimencoMonitorMode->redBits);
-	//glfwWindowHint(GLFW_GREEN_BITS, DimencoMonitorMode->greenBits);
-	//glfwWindowHint(GLFW_BLUE_BITS, DimencoMonitorMode->blueBits);
-	//glfwWindowHint(GLFW_REFRESH_RATE, DimencoMonitorMode->refreshRate);
-	//window = glfwCreateWindow(DimencoMonitorMode->width, DimencoMonitorMode->height, "LearnOpenGL", DimencoMonitor, NULL);
+		// "Windowed full screen" windows
+		//glfwWindowHint(GLFW_RED_BITS, DimencoMonitorMode->redBits);
+		//glfwWindowHint(GLFW_GREEN_BITS, DimencoMonitorMode->greenBits);
+		//glfwWindowHint(GLFW_BLUE_BITS, DimencoMonitorMode->blueBits);
+		//glfwWindowHint(GLFW_REFRESH_RATE, DimencoMonitorMode->refreshRate);
+		//window = glfwCreateWindow(DimencoMonitorMode->width, DimencoMonitorMode->height, "LearnOpenGL", DimencoMonitor, NULL);
 
-	// Full screen windows
-	window = glfwCreateWindow(DimencoMonitorMode->width, DimencoMonitorMode->height, "LearnOpenGL", PrimaryMonitor, NULL);
+		// Full screen windows
+		window = glfwCreateWindow(DimencoMonitorMode->width, DimencoMonitorMode->height, "LearnOpenGL", PrimaryMonitor, NULL);
 
-	if (window == NULL)
-	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		exit(-1);
-	}
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
+		if (window == NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			exit(-1);
+		}
+		glfwMakeContextCurrent(window);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		if (!Options.bBenchmark)
+		{
+			glfwSetCursorPosCallback(window, mouse_callback);
+			glfwSetScrollCallback(window, scroll_callback);
+		}
+		glfwSetKeyCallback(window, key_callback);
 
-	// tell GLFW to capture our mouse
-	//glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		// frame pacing
+		Pacer.TargetFPS = Options.FrameLimit;
+		Pacer.RefreshRate = DimencoMonitorMode->refreshRate;
+		glfwSwapInterval(Pacer.SwapInterval());
 
-	// Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
-	glewExperimental = GL_TRUE;
-	// Initialize GLEW to setup the OpenGL Function pointers
-	glewInit();
+		// tell GLFW to capture our mouse
+		//glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+		// Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
+		glewExperimental = GL_TRUE;
+		// Initialize GLEW to setup the OpenGL Function pointers
+		glewInit();
+	}
 
 	// configure global opengl state
 	// -----------------------------
-	glEnable(GL_DEPTH_TEST);
+	GLState::Enable(GL_DEPTH_TEST);
 
 	// build and compile our shader zprogram
+	// all programs are submitted at once and completed when first needed, so the driver compiles
+	// them in parallel while the rest of startup runs
 	// ------------------------------------
-	lightingShader = new Shader("../resources/shaders/Main.vertex.glsl", "../resources/shaders/Main.fragment.glsl");
-	lampShader = new Shader("../resources/shaders/Lamp.vertex.glsl", "../resources/shaders/Lamp.fragment.glsl");
-	DebugPointShader = new Shader("../resources/shaders/DebugPoint.vertex.glsl", "../resources/shaders/DebugPoint.fragment.glsl");
+	ShaderBatch StartupShaders;
+	LightingShaders = new ShaderVariants<LightingUniforms>("../resources/shaders/Main.vertex.glsl", "../resources/shaders/Main.fragment.glsl");
+	LightingShaders->Defines = [](unsigned int Mask)
+	{
+		std::ostringstream Defines;
+		Defines << "#define NR_POINT_LIGHTS " << (Mask & LIGHTING_POINT_LIGHTS) << "\n";
+		Defines << "#define DIR_LIGHT " << ((Mask & LIGHTING_DIR_LIGHT) ? 1 : 0) << "\n";
+		Defines << "#define SPOT_LIGHT " << ((Mask & LIGHTING_SPOT_LIGHT) ? 1 : 0) << "\n";
+		Defines << "#define SPECULAR_MAP " << ((Mask & LIGHTING_SPECULAR_MAP) ? 1 : 0) << "\n";
+		Defines << "#define CLUSTERED " << ((Mask & LIGHTING_CLUSTERED) ? 1 : 0) << "\n";
+		Defines << "#define EVERY_POINT_LIGHT " << ((Mask & LIGHTING_EVERY_POINT_LIGHT) ? 1 : 0) << "\n";
+		Defines << "#define LIGHT_LIST " << ((Mask & LIGHTING_LIGHT_LIST) ? 1 : 0) << "\n";
+		Defines << "#define SHADOWS " << ((Mask & LIGHTING_SHADOWS) ? 1 : 0) << "\n";
+		Defines << "#define VERTEX_INVERSE " << ((Mask & LIGHTING_VERTEX_INVERSE) ? 1 : 0) << "\n";
+		Defines << "#define INSTANCED " << ((Mask & LIGHTING_INSTANCED) ? 1 : 0);
+		return Defines.str();
+	};
+	LightingShaders->Configure = [](Shader* Program)
+	{
+		Program->bindUniformBlock("Camera", UBO_CAMERA);
+		Program->bindUniformBlock("Lights", UBO_LIGHTS);
+		Program->bindUniformBlock("Material", UBO_MATERIAL);
+		Program->bindUniformBlock("Shadows", UBO_SHADOWS);
+		Program->use();
+		Program->setInt("diffuseMap", 0);
+		Program->setInt("specularMap", 1);
+		Program->setInt("pointLightData", LIGHT_UNIT_DATA);
+		Program->setInt("clusterGrid", LIGHT_UNIT_GRID);
+		Program->setInt("clusterLights", LIGHT_UNIT_INDICES);
+		Program->setInt("drawLights", LIGHT_UNIT_DRAW_LISTS);
+		Program->setInt("dirShadowMap", SHADOW_UNIT_CASCADES);
+		Program->setInt("spotShadowMap", SHADOW_UNIT_SPOT);
+	};
+	// every variant the scene can pick with the shadows as configured, the rest compile on first
+	// use; without a scene or when it is shaded deferred the forward containers are never drawn
+	if (Options.bRenderScene && !Options.bDeferred)
+	{
+		unsigned int Lit = LIGHTING_DIR_LIGHT | LIGHTING_SPECULAR_MAP | (Options.bInstanced ? LIGHTING_INSTANCED : 0)
+			| (Options.bShadows ? LIGHTING_SHADOWS : 0);
+		for (unsigned int PointLights = 0; PointLights <= 4; PointLights++)
+		{
+			LightingShaders->Preload(PointLights | Lit, StartupShaders);
+			LightingShaders->Preload(PointLights | Lit | LIGHTING_SPOT_LIGHT, StartupShaders);
+		}
+		if (Options.PointLights > 4)
+		{
+			for (unsigned int Lookup : { LIGHTING_LIGHT_LIST, LIGHTING_CLUSTERED })
+			{
+				LightingShaders->Preload(Lookup | Lit, StartupShaders);
+				LightingShaders->Preload(Lookup | Lit | LIGHTING_SPOT_LIGHT, StartupShaders);
+			}
+		}
+	}
+	lampShader = StartupShaders.Add("../resources/shaders/Lamp.vertex.glsl", "../resources/shaders/Lamp.fragment.glsl");
+	lampInstancedShader = StartupShaders.Add("../resources/shaders/Lamp.vertex.glsl", "../resources/shaders/Lamp.fragment.glsl", nullptr, "#define INSTANCED 1");
+	DebugPointShader = StartupShaders.Add("../resources/shaders/DebugPoint.vertex.glsl", "../resources/shaders/DebugPoint.fragment.glsl");
+	StartupShaders.Submit();
+
+	// the camera changes per eye and pass, give it enough slots to never overwrite in-flight data
+	CameraUniforms = new UniformBlock<CameraBlock>(UBO_CAMERA, 64);
+	LightUniforms = new UniformBlock<LightsBlock>(UBO_LIGHTS);
+	MaterialUniforms = new UniformBlock<MaterialBlock>(UBO_MATERIAL);
+
+	Workers = new WorkerPool();
+	Clusters = new LightClusters(*Workers);
+	Culler = new LightCuller(*Workers);
+	Deferred = new DeferredRenderer(StartupShaders);
+	bDeferred = Options.bDeferred;
+	bShadows = Options.bShadows;
+	bInstanced = Options.bInstanced;
+	BuildPointLights(Options.PointLights);
+	// every scattered light gets a lamp, unless the scene is all lamps anyway
+	if (Options.PointLights > 0 && Options.Scene != SCENE_LAMPS)
+	{
+		LampPositions.clear();
+		for (const PointLightBlock& Light : Clusters->Lights)
+			LampPositions.push_back(Light.Position);
+	}
 
 	// Load Geometry and textures
 	LoadCubes();
 	LoadLight();
 	LoadDebugPoint();
+	UploadLampInstances();
+	Shadows = new ShadowMaps(*CubeMesh, StartupShaders);
+
+	// Offscreen eyes for reprojection
+	Reprojection = new StereoReprojection(StartupShaders);
+	SourceEyeTarget = new RenderTarget(CurrentWidth / 2, CurrentHeight);
+	WarpTarget = new RenderTarget(CurrentWidth / 2, CurrentHeight);
+	EyeTargets[0] = new RenderTarget(CurrentWidth / 2, CurrentHeight);
+	EyeTargets[1] = new RenderTarget(CurrentWidth / 2, CurrentHeight);
+	glGenQueries(LateWarpQueryCount, LateWarpQueries);
+
+	Foveation = new FoveatedRenderer(StartupShaders);
+	// the renderers' programs compile alongside the first batch
+	StartupShaders.Submit();
+
+	Stats = new FrameStats();
+	Profiler = new GpuProfiler();
+
+	Capture = new FrameCapture();
+	Capture->OutputFormat = Options.CaptureFormat;
+	bCapturing = Options.bCapture;
+
+	Recorder = new VideoRecorder();
+	if (!Options.RecordPath.empty())
+		ToggleRecording(Options.RecordPath);
+
+	if (!Options.bBenchmark)
+		ShaderFiles = new ShaderWatcher("../resources/shaders");
+
+	// link status is first needed here, after everything else was set up
+	CacheUniforms();
+	StartupShaders.Finish();
+
+	// every program is built by now, cold on the first launch and warm once the binary cache is filled
+	StartupShaders.Report();
+	ShaderCache::Report();
 }
 
 App::~App()
 {
 	// optional: de-allocate all resources once they've outlived their purpose:
 	// ------------------------------------------------------------------------
-	glDeleteVertexArrays(1, &cubeVAO);
-	glDeleteVertexArrays(1, &lightVAO);
-	glDeleteBuffers(1, &cubeVBO);
-	glDeleteBuffers(1, &DebugPointVBO);
-	glDeleteVertexArrays(1, &DebugPointVAO);
-	glDeleteBuffers(1, &DebugPointEBO);
-
-	// glfw: terminate, clearing all previously allocated GLFW resources.
-	// ------------------------------------------------------------------
-	glfwTerminate();
+	GLState::DeleteVertexArrays(1, &cubeVAO);
+	GLState::DeleteVertexArrays(1, &lightVAO);
+	GLState::DeleteVertexArrays(1, &cubeInstancedVAO);
+	GLState::DeleteVertexArrays(1, &lightInstancedVAO);
+	delete CubeInstances;
+	delete LampInstances;
+	delete CubeMesh;
+	GLState::DeleteBuffers(1, &DebugPointVBO);
+	GLState::DeleteVertexArrays(1, &DebugPointVAO);
+	GLState::DeleteBuffers(1, &DebugPointEBO);
+
+	delete SourceEyeTarget;
+	delete WarpTarget;
+	delete Reprojection;
+	delete EyeTargets[0];
+	delete EyeTargets[1];
+	glDeleteQueries(LateWarpQueryCount, LateWarpQueries);
+	delete Foveation;
+	delete Stats;
+	delete Profiler;
+	delete Capture;
+	delete Recorder;
+	delete ShaderFiles;
+	delete LightingShaders;
+	delete CameraUniforms;
+	delete LightUniforms;
+	delete MaterialUniforms;
+	delete Deferred;
+	delete Shadows;
+	delete Culler;
+	delete Clusters;
+	delete Workers;
+
+	if (Headless != nullptr)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			if (HeadlessFences[i] != 0)
+				glDeleteSync(HeadlessFences[i]);
+		}
+		RenderTarget::ScreenFramebuffer() = 0;
+		delete HeadlessTarget;
+		delete Headless;
+	}
+	else
+	{
+		// glfw: terminate, clearing all previously allocated GLFW resources.
+		// ------------------------------------------------------------------
+		glfwTerminate();
+	}
 
 	// Close cameras udp connection
 	camera->CloseCamerasUDP();
@@ -343,20 +856,20 @@ App::~App()
 
 void App::LoadCubes()
 {
-	// first, configure the cube's VAO (and VBO)
-	glGenBuffers(1, &cubeVBO);
-	glGenVertexArrays(1, &cubeVAO);
+	// first, configure the cube's VAO: the triangle list merged into indexed, packed vertices
+	CubeMesh = new PackedMesh(CubeVertices, 36);
+	if (Options.bBenchmark)
+		CubeMesh->Report("Cube");
 
-	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(CubeVertices), CubeVertices, GL_STATIC_DRAW);
+	glGenVertexArrays(1, &cubeVAO);
+	GLState::BindVertexArray(cubeVAO);
+	CubeMesh->Attributes();
 
-	glBindVertexArray(cubeVAO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
+	// the same vertices with each container's placement and lights per instance
+	glGenVertexArrays(1, &cubeInstancedVAO);
+	GLState::BindVertexArray(cubeInstancedVAO);
+	CubeMesh->Attributes();
+	CubeInstances = CreateCubeInstances();
 
 	// load textures (we now use a utility function to keep the code more organized)
 	// -----------------------------------------------------------------------------
@@ -366,21 +879,38 @@ void App::LoadCubes()
 
 void App::LoadLight()
 {
-	// second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
+	// second, configure the light's VAO (the mesh stays the same; the light object is also a 3D cube)
 	glGenVertexArrays(1, &lightVAO);
-	glBindVertexArray(lightVAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-	// note that we update the lamp's position attribute's stride to reflect the updated buffer data
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+	GLState::BindVertexArray(lightVAO);
+	// the lamp only reads the position
+	CubeMesh->Attributes(true);
+
+	// and with every lamp's position per instance
+	glGenVertexArrays(1, &lightInstancedVAO);
+	GLState::BindVertexArray(lightInstancedVAO);
+	CubeMesh->Attributes(true);
+	LampInstances = new InstanceBuffer<glm::vec3>();
+	LampInstances->Attribute(3, 3, 0);
+}
 
+// instance buffer with the container attributes on the bound vertex array
+// ------------------------------------------------------------------------
+InstanceBuffer<App::CubeInstance>* App::CreateCubeInstances()
+{
+	InstanceBuffer<CubeInstance>* Instances = new InstanceBuffer<CubeInstance>();
+	Instances->Attribute(3, 4, offsetof(CubeInstance, PositionScale));
+	Instances->Attribute(4, 4, offsetof(CubeInstance, Rotation));
+	Instances->Attribute(5, 4, offsetof(CubeInstance, PointLights), true);
+	Instances->Attribute(6, 2, offsetof(CubeInstance, LightList), true);
+	return Instances;
+}
 
-	// shader configuration
-	// --------------------
-	lightingShader->use();
-	lightingShader->setInt("material.diffuse", 0);
-	lightingShader->setInt("material.specular", 1);
+// lamp positions to their instance buffer, after LampPositions changed
+// ------------------------------------------------------------------------
+void App::UploadLampInstances()
+{
+	LampInstances->Data = LampPositions;
+	LampInstances->Upload();
 }
 
 void App::LoadDebugPoint()
@@ -389,19 +919,19 @@ void App::LoadDebugPoint()
 	glGenVertexArrays(1, &DebugPointVAO);
 	glGenBuffers(1, &DebugPointVBO);
 	glGenBuffers(1, &DebugPointEBO);
-	glBindVertexArray(DebugPointVAO);
+	GLState::BindVertexArray(DebugPointVAO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, DebugPointVBO);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, DebugPointVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(DebugPointVertices), DebugPointVertices, GL_STATIC_DRAW);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, DebugPointEBO);
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, DebugPointEBO);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(DebugPointIndices), DebugPointIndices, GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::BindVertexArray(0);
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -431,6 +961,107 @@ void App::framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	App::app->CurrentHeight = height;
 }
 
+// glfw: single key presses that toggle features
+// ---------------------------------------------------------------------------------------------
+void App::key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if (action != GLFW_PRESS)
+		return;
+
+	switch (key)
+	{
+	case GLFW_KEY_F1:
+		if (mods & GLFW_MOD_SHIFT)
+		{
+			App::app->bInstanced = !App::app->bInstanced;
+			std::cout << "Instancing: " << (App::app->bInstanced ? "on" : "off") << std::endl;
+		}
+		else
+		{
+			App::app->bStereoReprojection = !App::app->bStereoReprojection;
+			std::cout << "Stereo reprojection: " << (App::app->bStereoReprojection ? "on" : "off") << std::endl;
+		}
+		break;
+	case GLFW_KEY_F2:
+		if (mods & GLFW_MOD_SHIFT)
+			App::app->bRunInstancingBenchmark = true;
+		else
+			App::app->bRunReprojectionBenchmark = true;
+		break;
+	case GLFW_KEY_F3:
+		if (mods & GLFW_MOD_SHIFT)
+			App::app->bRunVertexFormatBenchmark = true;
+		else
+		{
+			App::app->bLateWarp = !App::app->bLateWarp;
+			App::app->RestartLateWarpReport();
+			std::cout << "Late warp: " << (App::app->bLateWarp ? "on" : "off") << std::endl;
+		}
+		break;
+	case GLFW_KEY_F4:
+		App::app->bFoveated = !App::app->bFoveated;
+		std::cout << "Foveated rendering: " << (App::app->bFoveated ? "on" : "off") << std::endl;
+		break;
+	case GLFW_KEY_F5:
+		if (mods & GLFW_MOD_SHIFT)
+			App::app->bRunNormalMatrixBenchmark = true;
+		else
+			App::app->bRunFoveationBenchmark = true;
+		break;
+	case GLFW_KEY_F7:
+		App::app->bExportStats = true;
+		break;
+	case GLFW_KEY_F8:
+		App::app->bExportTimeline = true;
+		break;
+	case GLFW_KEY_F9:
+		App::app->bCapturing = !App::app->bCapturing;
+		std::cout << "Frame capture: " << (App::app->bCapturing ? "on" : "off") << std::endl;
+		if (!App::app->bCapturing)
+			App::app->Capture->Report();
+		break;
+	case GLFW_KEY_F10:
+		if (mods & GLFW_MOD_SHIFT)
+		{
+			App::app->bShadows = !App::app->bShadows;
+			std::cout << "Shadows: " << (App::app->bShadows ? "on" : "off") << std::endl;
+		}
+		else
+			App::app->ToggleRecording("recording.y4m");
+		break;
+	case GLFW_KEY_F11:
+		if (mods & GLFW_MOD_SHIFT)
+		{
+			App::app->bDeferred = !App::app->bDeferred;
+			std::cout << "Deferred shading: " << (App::app->bDeferred ? "on" : "off") << std::endl;
+		}
+		else
+			App::app->bRunLightingBenchmark = true;
+		break;
+	case GLFW_KEY_F12:
+		if (mods & GLFW_MOD_SHIFT)
+			App::app->bRunDeferredBenchmark = true;
+		else
+			App::app->bRunClusterBenchmark = true;
+		break;
+	case GLFW_KEY_F6:
+		if (mods & GLFW_MOD_SHIFT)
+		{
+			App::app->bPacerReport = !App::app->bPacerReport;
+			App::app->Pacer.RestartReport();
+			std::cout << "Frame interval report: " << (App::app->bPacerReport ? "on" : "off") << std::endl;
+		}
+		else
+		{
+			App::app->Pacer.bAdaptive = !App::app->Pacer.bAdaptive;
+			glfwSwapInterval(App::app->Pacer.SwapInterval());
+			std::cout << "Adaptive vsync pacing: " << (App::app->Pacer.bAdaptive ? "on" : "off")
+				<< (App::app->Pacer.TargetFPS > 0.0 ? "" : ", without --fps there is no target to pace to") << std::endl;
+		}
+		break;
+	}
+}
+
 // glfw: whenever the mouse moves, this callback is called
 // -------------------------------------------------------
 void App::mouse_callback(GLFWwindow* window, double xpos, double ypos)
@@ -479,7 +1110,7 @@ unsigned int App::loadTexture(char const * path)
 		else if (nrComponents == 4)
 			format = GL_RGBA;
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
+		GLState::BindTexture(0, textureID);
 		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 		glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -494,6 +1125,8 @@ unsigned int App::loadTexture(char const * path)
 	{
 		std::cout << "Texture failed to load at path: " << path << std::endl;
 		stbi_image_free(data);
+		GLState::DeleteTextures(1, &textureID);
+		textureID = 0;
 	}
 
 	return textureID;
@@ -501,309 +1134,1780 @@ unsigned int App::loadTexture(char const * path)
 
 void App::Start()
 {
-	auto start = std::chrono::steady_clock::now();
-	int Frames = 0;
-
-	double frame_start = glfwGetTime();
+	DrawCounter::Reset();
+	double RunStart = GetTime();
+	RestartLateWarpReport();
 
 	// render loop
 	// -----------
-	while (!glfwWindowShouldClose(window))
+	while (!ShouldClose())
 	{
+		// Limit FPS, frame starts on an absolute schedule
+		Pacer.Wait();
+		Stats->BeginFrame();
+		Profiler->BeginFrame();
+
+		// programs are only ever swapped here, between frames
+		ReloadShaders();
+
 		// per-frame time logic
 		// --------------------
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
+		float currentFrame = GetTime();
+		deltaTime = Options.bBenchmark ? Script.FixedDeltaTime : currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
 		// input
 		// -----
-		processInput(window);
+		if (!Options.bHeadless && !Options.bBenchmark)
+			processInput(window);
 
 		// render
 		// ------
+		RenderTarget::BindScreen();
 		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 
-		// Limit FPS
-		if (FrameLimit > 0.f)
-		{
-			++Frames;
-			auto now = std::chrono::steady_clock::now();
-			auto diff = now - start;
-			auto end = now + std::chrono::milliseconds((int)(1.0 / FrameLimit * 1000.0));
-			if (diff >= std::chrono::seconds(1))
-			{
-				start = now;
-				//std::cout << "FPS: " << Frames << " " << (1.f / FrameLimit) << "ms" << std::endl;
-				Frames = 0;
+		//~~~~~~~~~~~~~~~~~~~~~~~ RENDERING ~~~~~~~~~~~~~~~~~~~~~~~~~~
+		Stats->BeginPhase(PHASE_POSE_FETCH);
+		FetchPose();
+		Stats->EndPhase(PHASE_POSE_FETCH);
 
-			}
+		// everything eye independent once, then each eye is submitted from the packet
+		PrepareFrame();
 
-			std::this_thread::sleep_until(end);
+		// shadow maps depend on the scene and the frame's eyes only, both eyes share them
+		if (Options.bRenderScene && bShadows)
+			RenderShadowMaps();
+
+		if (bLateWarp)
+		{
+			// Render both eyes offscreen, they are presented right before the swap
+			RenderEyesOffscreen();
+		}
+		else if (bFoveated)
+		{
+			// Render both eyes with a full resolution inset around the gaze point
+			RenderFoveatedStereo();
+		}
+		else if (bStereoReprojection)
+		{
+			// Render left Eye and reproject it to the right one
+			RenderReprojectedStereo();
 		}
 		else
 		{
-			//std::cout << "FPS: " << 1.0 / deltaTime << " " << (deltaTime  * 1000.f) << "ms" << std::endl;
+			// Render for left Eye
+			MainRender(true);
+
+			// Render for right Eye
+			MainRender(false);
 		}
+		//~~~~~~~~~~~~~~~~~~~~~~~ END RENDERING ~~~~~~~~~~~~~~~~~~~~~
 
+		if (bRunReprojectionBenchmark)
+		{
+			bRunReprojectionBenchmark = false;
+			BenchmarkReprojection();
+		}
 
-		//++Frames;
-		//double wait_time = 1.0 / (FrameLimit);
-		//double curr_frame_time = glfwGetTime() - frame_start;
-		//double dur = 1000.0 * (wait_time - curr_frame_time) + 0.5;
-		//DWORD durDW = (DWORD)dur;
-		//if (durDW > 0) // ensures that we don't have a dur > 0.0 which converts to a durDW of 0.
-		//{
-		//	Sleep(durDW);
-		//	//std::cout << "FPS: " << 1.0 / deltaTime << " " << (deltaTime  * 1000.f) << "ms" << std::endl;
-		//	std::cout << "FPS: " << Frames << " " << (1.f / FrameLimit) << "ms" << std::endl;
-		//}
-		//else
-		//{
-		//	Frames = 0;
-		//}
+		if (bRunFoveationBenchmark)
+		{
+			bRunFoveationBenchmark = false;
+			BenchmarkFoveation();
+		}
 
-		double frame_end = glfwGetTime();
-		frame_start = frame_end;
+		if (bRunLightingBenchmark)
+		{
+			bRunLightingBenchmark = false;
+			BenchmarkLightingVariants();
+		}
 
+		if (bRunClusterBenchmark)
+		{
+			bRunClusterBenchmark = false;
+			BenchmarkClusteredLighting();
+		}
 
-		//~~~~~~~~~~~~~~~~~~~~~~~ RENDERING ~~~~~~~~~~~~~~~~~~~~~~~~~~
-		// Render for left Eye
-		MainRender(true);
+		if (bRunDeferredBenchmark)
+		{
+			bRunDeferredBenchmark = false;
+			BenchmarkDeferredShading();
+		}
 
-		// Render for right Eye
-		MainRender(false);
-		//~~~~~~~~~~~~~~~~~~~~~~~ END RENDERING ~~~~~~~~~~~~~~~~~~~~~
+		if (bRunNormalMatrixBenchmark)
+		{
+			bRunNormalMatrixBenchmark = false;
+			BenchmarkNormalMatrices();
+		}
+
+		if (bRunInstancingBenchmark)
+		{
+			bRunInstancingBenchmark = false;
+			BenchmarkInstancing();
+		}
+
+		if (bRunVertexFormatBenchmark)
+		{
+			bRunVertexFormatBenchmark = false;
+			BenchmarkVertexFormat();
+		}
 
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		// -------------------------------------------------------------------------------
-		glfwPollEvents();
-		glfwSwapBuffers(window);
+		if (!Options.bHeadless)
+			glfwPollEvents();
+		if (bLateWarp)
+			PresentWithLatestPose();
+		if (bCapturing)
+		{
+			GpuScope Scope(Profiler, "Capture");
+			RenderTarget::BindScreen();
+			Capture->Capture(CurrentWidth, CurrentHeight);
+		}
+		Capture->Poll();
+		if (Recorder->IsRecording())
+		{
+			GpuScope Scope(Profiler, "Record");
+			RenderTarget::BindScreen();
+			Recorder->Record();
+		}
+		Recorder->Poll();
+		Stats->EndGPU();
+		Profiler->EndFrame();
+		Pacer.FrameSubmitted();
+		Stats->BeginPhase(PHASE_SWAP);
+		if (Options.bHeadless)
+			PresentHeadless();
+		else
+			glfwSwapBuffers(window);
+		Stats->EndPhase(PHASE_SWAP);
+		++FramesRendered;
+		Pacer.FrameSwapped();
+		if (!Options.bBenchmark && (Pacer.TargetFPS > 0.0 || bPacerReport))
+			Pacer.Report();
+		Stats->EndFrame();
+
+		if (bExportStats)
+		{
+			bExportStats = false;
+			ExportStats();
+		}
+
+		if (bExportTimeline)
+		{
+			bExportTimeline = false;
+			Profiler->PrintTimeline();
+			Profiler->ExportTrace("gpu_timeline.json");
+		}
 	}
+
+	if (Options.bBenchmark)
+	{
+		Stats->Flush();
+		ReportBenchmark(GetTime() - RunStart);
+	}
+
+	if (bCapturing)
+	{
+		Capture->Finish();
+		Capture->Report();
+	}
+	Recorder->Stop();
+
+	if (Options.bExportStats)
+		ExportStats();
 }
 
-void App::RenderCubes()
+// calculate where each object is: position and uniform scale, and rotation
+// ------------------------------------------------------------------------
+void App::CubePlacement(unsigned int Index, glm::vec4& PositionScale, glm::quat& Rotation) const
 {
-	// world transformation
-	glm::mat4 model;
+	// scale if cube 0, its position scales with it
+	float Scale = Index == 0 ? 0.2f : 1.0f;
+	PositionScale = glm::vec4(cubePositions[Index] * Scale, Scale);
 
-	// Draw light
-	// ------------------------------------------------------------------
-	// be sure to activate shader when setting uniforms/drawing objects
-	lightingShader->use();
-	lightingShader->setVec3("viewPos", camera->Position + EyeViewPointOffset_inUnits);
-	lightingShader->setFloat("material.shininess", 32.0f);
-
-	/*
-	Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index
-	the proper PointLight struct in the array to set each uniform variable. This can be done more code-friendly
-	by defining light types as classes and set their values in there, or by using a more efficient uniform approach
-	by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
-	*/
-	// directional light
-	lightingShader->setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-	lightingShader->setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-	lightingShader->setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-	lightingShader->setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-	// point light 1
-	lightingShader->setVec3("pointLights[0].position", pointLightPositions[0]);
-	lightingShader->setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-	lightingShader->setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-	lightingShader->setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-	lightingShader->setFloat("pointLights[0].constant", 1.0f);
-	lightingShader->setFloat("pointLights[0].linear", 0.09);
-	lightingShader->setFloat("pointLights[0].quadratic", 0.032);
-	// point light 2
-	lightingShader->setVec3("pointLights[1].position", pointLightPositions[1]);
-	lightingShader->setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-	lightingShader->setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-	lightingShader->setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-	lightingShader->setFloat("pointLights[1].constant", 1.0f);
-	lightingShader->setFloat("pointLights[1].linear", 0.09);
-	lightingShader->setFloat("pointLights[1].quadratic", 0.032);
-	// point light 3
-	lightingShader->setVec3("pointLights[2].position", pointLightPositions[2]);
-	lightingShader->setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-	lightingShader->setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-	lightingShader->setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-	lightingShader->setFloat("pointLights[2].constant", 1.0f);
-	lightingShader->setFloat("pointLights[2].linear", 0.09);
-	lightingShader->setFloat("pointLights[2].quadratic", 0.032);
-	// point light 4
-	lightingShader->setVec3("pointLights[3].position", pointLightPositions[3]);
-	lightingShader->setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-	lightingShader->setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-	lightingShader->setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-	lightingShader->setFloat("pointLights[3].constant", 1.0f);
-	lightingShader->setFloat("pointLights[3].linear", 0.09);
-	lightingShader->setFloat("pointLights[3].quadratic", 0.032);
-	// spotLight
-	//lightingShader->setVec3("spotLight.position", camera->Position + EyeViewPointOffset_inUnits);
-	lightingShader->setVec3("spotLight.direction", camera->Front);
-	lightingShader->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-	lightingShader->setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-	lightingShader->setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-	lightingShader->setFloat("spotLight.constant", 1.0f);
-	lightingShader->setFloat("spotLight.linear", 0.09);
-	lightingShader->setFloat("spotLight.quadratic", 0.032);
-	lightingShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-	lightingShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-
-	// Global transformation matrix
-	lightingShader->setMat4("projection", PerspectiveProjection);
-	lightingShader->setMat4("view", view);
+	float angle = 20.0f * (Index + 1);
+	Rotation = glm::angleAxis(glm::radians(angle), glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f)));
+}
 
-	// world transformation
-	lightingShader->setMat4("model", model);
+// normal matrices of the packet's containers so no vertex shader inverts them, computed by the
+// first per object draw of the packet and shared by both eyes
+// ------------------------------------------------------------------------
+const std::vector<glm::mat3>& App::FrameCubeNormals()
+{
+	if (CubeNormalsFrame != Frame->Number)
+	{
+		CubeNormals.Compute(Frame->CubeModels, CubeNormalMatrices);
+		CubeNormalsFrame = Frame->Number;
+	}
+	return CubeNormalMatrices;
+}
+
+// pick the cheapest lighting variant for each container and group the draws by it, returns whether
+// any of them reads its point lights from the clusters
+// ------------------------------------------------------------------------
+bool App::BuildCubeDraws()
+{
+	CubeDraws.resize(Frame->CubeModels.size());
+	bool bClustered = false;
+	for (size_t i = 0; i < CubeDraws.size(); i++)
+	{
+		CubeDraw& Draw = CubeDraws[i];
+		Draw.Object = (unsigned int)i;
+		const LightCuller::List& Listed = Culler->Lists[i];
+		Draw.LightList = glm::ivec2(Listed.Offset, Listed.Count);
+		if (ForcedLightingVariant >= 0)
+		{
+			Draw.Variant = (unsigned int)ForcedLightingVariant;
+			Draw.PointLights = glm::min(glm::ivec4(0, 1, 2, 3), glm::ivec4(std::max((int)Clusters->Lights.size() - 1, 0)));
+		}
+		else
+		{
+			Draw.Variant = LightingVariantFor(Frame->CubeBounds[i], Listed, Draw.PointLights);
+		}
+		if (bInstanced)
+			Draw.Variant |= LIGHTING_INSTANCED;
+		bClustered |= (Draw.Variant & LIGHTING_CLUSTERED) != 0;
+	}
+	// draw grouped by variant, so programs only switch between groups
+	std::stable_sort(CubeDraws.begin(), CubeDraws.end());
+	return bClustered;
+}
+
+void App::RenderCubes()
+{
+	GpuScope Scope(Profiler, "RenderCubes");
+
+	// lights and material were uploaded by PrepareFrame, only the camera changes per eye
+	UpdateCameraBlock();
 
 	// bind diffuse map
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, diffuseMap);
+	GLState::BindTexture(0, diffuseMap);
 	// bind specular map
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, specularMap);
+	GLState::BindTexture(1, specularMap);
+	// point lights, the light clusters and the per container lists
+	Clusters->Bind();
+	Culler->Bind();
+	// cascades and spot map from RenderShadowMaps, rendered here when this packet has none yet,
+	// e.g. for a benchmark that prepared its own frame
+	if (bShadows)
+	{
+		if (ShadowMapsFrame != Frame->Number)
+			RenderShadowMaps();
+		Shadows->Bind();
+	}
 
-	// render containers
-	glBindVertexArray(cubeVAO);
-	for (unsigned int i = 1; i < 11; i++)
+	// which point lights reach each container, only redone when the lights or containers moved
+	Culler->Cull(*Clusters, Frame->CubeBounds);
+
+	if (bInstanced)
 	{
-		// calculate the model matrix for each object and pass it to shader before drawing
-		glm::mat4 model;
+		RenderCubesInstanced();
+		return;
+	}
+
+	// bin the lights for this eye, shared by every clustered draw
+	if (BuildCubeDraws())
+		Clusters->Build(PerspectiveProjection, view);
 
-		// scale if cube 0;
-		if (i == 1)
+	// render containers
+	const std::vector<glm::mat3>& Normals = FrameCubeNormals();
+	GLState::BindVertexArray(cubeVAO);
+	const ShaderVariants<LightingUniforms>::Variant* Current = nullptr;
+	for (size_t i = 0; i < CubeDraws.size(); i++)
+	{
+		const CubeDraw& Draw = CubeDraws[i];
+		if (i == 0 || Draw.Variant != CubeDraws[i - 1].Variant)
 		{
-			model = glm::scale(model, glm::vec3(0.2, 0.2, 0.2));
+			Current = &LightingShaders->Get(Draw.Variant);
+			Current->Program->use();
 		}
 
-		model = glm::translate(model, cubePositions[i -1]);
-		float angle = 20.0f * i;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-		lightingShader->setMat4("model", model);
+		Current->Program->setMat4(Current->Uniforms.Model, Frame->CubeModels[Draw.Object]);
+		Current->Program->setMat3(Current->Uniforms.NormalMatrix, Normals[Draw.Object]);
+		if ((Draw.Variant & LIGHTING_POINT_LIGHTS) != 0)
+			Current->Program->setIVec4(Current->Uniforms.PointLightIndices, Draw.PointLights);
+		if ((Draw.Variant & LIGHTING_LIGHT_LIST) != 0)
+			Current->Program->setIVec2(Current->Uniforms.DrawLightRange, Draw.LightList.x, Draw.LightList.y);
 
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		CubeMesh->Draw();
 	}
 }
 
-void App::RenderLight()
+// every container from the instance buffer, one draw per lighting variant; the instances are only
+// rebuilt when the frame, the light lists or the variant choice changed, so both eyes share them
+// ------------------------------------------------------------------------
+void App::RenderCubesInstanced()
 {
-	// world transformation
-	glm::mat4 model;
+	if (CubeInstancesFrame != Frame->Number || CubeInstancesForcedVariant != ForcedLightingVariant
+		|| CubeInstancesCullVersion != Culler->Version() || bCubeInstancesShadows != bShadows)
+	{
+		bCubeInstancesClustered = BuildCubeDraws();
 
-	// also draw the lamp object(s)
-	lampShader->use();
-	lampShader->setMat4("projection", PerspectiveProjection);
-	lampShader->setMat4("view", view);
+		CubeInstances->Data.resize(CubeDraws.size());
+		CubeInstanceGroups.clear();
+		for (size_t i = 0; i < CubeDraws.size(); i++)
+		{
+			const CubeDraw& Draw = CubeDraws[i];
+			CubeInstance& Instance = CubeInstances->Data[i];
+			Instance.PositionScale = Frame->CubePlacements[Draw.Object];
+			Instance.Rotation = Frame->CubeRotations[Draw.Object];
+			Instance.PointLights = Draw.PointLights;
+			Instance.LightList = Draw.LightList;
+
+			if (i == 0 || Draw.Variant != CubeDraws[i - 1].Variant)
+				CubeInstanceGroups.push_back({ Draw.Variant, (unsigned int)i, 0 });
+			CubeInstanceGroups.back().Count++;
+		}
+		CubeInstances->Upload();
 
-	// we now draw as many light bulbs as we have point lights.
-	glBindVertexArray(lightVAO);
-	for (unsigned int i = 0; i < 4; i++)
+		CubeInstancesFrame = Frame->Number;
+		CubeInstancesForcedVariant = ForcedLightingVariant;
+		CubeInstancesCullVersion = Culler->Version();
+		bCubeInstancesShadows = bShadows;
+	}
+
+	// bin the lights for this eye, shared by every clustered group
+	if (bCubeInstancesClustered)
+		Clusters->Build(PerspectiveProjection, view);
+
+	// render containers
+	GLState::BindVertexArray(cubeInstancedVAO);
+	for (const InstanceGroup& Group : CubeInstanceGroups)
 	{
-		model = glm::mat4();
-		model = glm::translate(model, pointLightPositions[i]);
-		model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-		lampShader->setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		LightingShaders->Get(Group.Variant).Program->use();
+		CubeInstances->Rebase(Group.First);
+		CubeMesh->DrawInstanced(Group.Count);
 	}
 }
 
-void App::RenderDebugPoint()
+// containers into the G-buffer, then lit into the eye's framebuffer; no per draw light selection,
+// every point light is drawn once as a volume
+// ------------------------------------------------------------------------
+void App::RenderCubesDeferred()
 {
-	// world transformation
-	glm::mat4 DebugPointModel;
-	glm::mat4 DebugPointProjection;
-	glm::mat4 DebugPointView;
-
-	// Draw debug Point
-	// ------------------------------------------------------------------
-	DebugPointShader->use();
-	glBindVertexArray(DebugPointVAO);
+	GpuScope Scope(Profiler, "RenderCubesDeferred");
 
-	DebugPointModel = glm::scale(DebugPointModel, glm::vec3(DebugSquareScalar, DebugSquareScalar, 1.f));
-	DebugPointModel = glm::translate(DebugPointModel, glm::vec3(pixelsize_cm * FPGAScreenWidth / ScreenWidth / DebugSquareScalar * MiddleEye.x / 2.f,
-		pixelsize_cm * FPGAScreenHeight / ScreenHeight / DebugSquareScalar * MiddleEye.y / 2.f, 0.f));
+	UpdateCameraBlock();
 
+	Deferred->BeginGeometry();
+	GLState::BindTexture(0, diffuseMap);
+	GLState::BindTexture(1, specularMap);
+	const std::vector<glm::mat3>& Normals = FrameCubeNormals();
+	GLState::BindVertexArray(cubeVAO);
+	for (unsigned int i = 0; i < Frame->CubeModels.size(); i++)
+	{
+		Deferred->GeometryShader->setMat4(Deferred->GeometryModelLocation, Frame->CubeModels[i]);
+		Deferred->GeometryShader->setMat3(Deferred->GeometryNormalMatrixLocation, Normals[i]);
+		CubeMesh->Draw();
+	}
 
-	DebugPointShader->setMat4("projection", DebugPointProjection);
-	DebugPointShader->setMat4("view", DebugPointView);
-	DebugPointShader->setMat4("model", DebugPointModel);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	Clusters->Bind();
+	// the same cascades and spot map as the forward path
+	if (bShadows)
+	{
+		if (ShadowMapsFrame != Frame->Number)
+			RenderShadowMaps();
+		Shadows->Bind();
+	}
+	Deferred->Shade(PerspectiveProjection * view, (int)Clusters->Lights.size(), bShadows);
 }
 
-void App::MainRender(bool IsLeftEye)
+// fit the shadow maps to both eyes of this frame and re-render the ones that changed
+// ------------------------------------------------------------------------
+void App::RenderShadowMaps()
 {
-	// view/projection transformations
-	glm::mat4 projection = glm::perspective(glm::radians(camera->Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+	GpuScope Scope(Profiler, "Shadows");
 
-	LeftEye = camera->LeftEye;
-	RightEye = camera->RightEye;
-	MiddleEye = (LeftEye + RightEye) / 2.f;
-
-	// setup camera paralax planes
-	LeftEyeScaled = LeftEye * ParallaxScale;
-	RightEyeScaled = RightEye * ParallaxScale;
-	width_cm_scaled = width_cm * ParallaxScale;
-	height_cm_scaled = width_cm * ParallaxScale;
+	glm::mat4 EyeProjection[2];
+	glm::mat4 EyeView[2];
+	for (int Eye = 0; Eye < 2; Eye++)
+	{
+		EyeProjection[Eye] = Frame->Eyes[Eye].Projection;
+		EyeView[Eye] = Frame->Eyes[Eye].View;
+	}
 
-	float zoff = 0.0f;
-	glm::vec3 pa = glm::vec3(-width_cm / 2.0f, -height_cm / 2.0f, -zoff);
-	glm::vec3 pb = glm::vec3(width_cm / 2.0f, -height_cm / 2.0f, -zoff);
-	glm::vec3 pc = glm::vec3(-width_cm / 2.0f, height_cm / 2.0f, -zoff);
+	Shadows->Render(EyeProjection, EyeView, Frame->Lights, Frame->SpotLightRange, Frame->CubePlacements, Frame->CubeRotations, Frame->CubesVersion);
+	ShadowMapsFrame = Frame->Number;
+}
 
-	if (IsLeftEye)
-	{
-		glViewport(0, 0, CurrentWidth / 2, CurrentHeight);
+// lighting features that reach an object, from its bounds and its culled point lights
+// ------------------------------------------------------------------------
+unsigned int App::LightingVariantFor(const ObjectBounds& Bounds, const LightCuller::List& Listed, glm::ivec4& PointLights) const
+{
+	// past this many lights a draw's own list costs more than the cluster it covers
+	const unsigned int MaxListedLights = 64;
 
-		// Get perspective matrix here
-		PerspectiveProjection = camera->GeneralizedPerspectiveProjection(pa, pb, pc, LeftEyeScaled, NearPlane, FarPlane);
-		//std::cout << "LeftEye PerspectiveProjection" << glm::to_string(LeftEye) << "\r\n";
-		projection = PerspectiveProjection;
+	unsigned int Variant = LIGHTING_DIR_LIGHT;
+	if (specularMap != 0)
+		Variant |= LIGHTING_SPECULAR_MAP;
 
-		// 1 unit == 1m == 100 cm
-		EyeViewPointOffset_inUnits = LeftEyeScaled / 100.f;
-		EyeViewPointOffset_inUnits += glm::vec3(0.f, 0.f, -VirtualCameraOffsetZ / 100.f);
-		//std::cout << "EyeViewPoint_inUnits: " << glm::to_string(EyeViewPointOffset_inUnits) << std::endl;
+	// up to 4 culled point lights go in a uniform, up to MaxListedLights are read from the list
+	// buffer, more are left to the clusters
+	PointLights = glm::ivec4(0);
+	if (Listed.Count <= 4)
+	{
+		for (unsigned int i = 0; i < Listed.Count; i++)
+			PointLights[i] = Culler->Indices[Listed.Offset + i];
+		Variant |= Listed.Count;
 	}
+	else if (Listed.Count <= MaxListedLights)
+		Variant |= LIGHTING_LIGHT_LIST;
 	else
-	{
-		glViewport(CurrentWidth / 2, 0, CurrentWidth / 2, CurrentHeight);
+		Variant |= LIGHTING_CLUSTERED;
 
+	const LightsBlock& Lights = Frame->Lights;
 
-		// Get perspective matrix here
-		PerspectiveProjection = camera->GeneralizedPerspectiveProjection(pa, pb, pc, RightEyeScaled, NearPlane, FarPlane);
-		//std::cout << "RightEye PerspectiveProjection" << glm::to_string(RightEye) << "\r\n";
-		projection = PerspectiveProjection;
+	// sphere around the box against the outer cone, cut off at the light's range
+	const SpotLightBlock& Spot = Lights.SpotLight;
+	float Radius = glm::length(Bounds.Extent);
+	glm::vec3 Offset = Bounds.Center - Spot.Position;
+	float Along = glm::dot(Offset, Spot.Direction);
+	float Across = std::sqrt(std::max(glm::dot(Offset, Offset) - Along * Along, 0.0f));
+	float SinOuter = std::sqrt(std::max(1.0f - Spot.OuterCutOff * Spot.OuterCutOff, 0.0f));
+	float ConeDistance = Spot.OuterCutOff * Across - SinOuter * Along;
+	if (ConeDistance <= Radius && Along <= Frame->SpotLightRange + Radius && Along >= -Radius)
+		Variant |= LIGHTING_SPOT_LIGHT;
+
+	if (bShadows)
+		Variant |= LIGHTING_SHADOWS;
+
+	return Variant;
+}
+
+void App::RenderLight()
+{
+	GpuScope Scope(Profiler, "RenderLight");
+
+	// world transformation
+	glm::mat4 model;
+
+	// also draw the lamp object(s)
+	UpdateCameraBlock();
+	Clusters->Bind();
+	int LightCount = std::max((int)Clusters->Lights.size(), 1);
+
+	// every lamp in one draw
+	if (bInstanced)
+	{
+		lampInstancedShader->use();
+		lampInstancedShader->setInt(LampLightsLocation, LightCount);
+		GLState::BindVertexArray(lightInstancedVAO);
+		CubeMesh->DrawInstanced((int)LampInstances->Data.size());
+		return;
+	}
+
+	// we now draw as many light bulbs as we have point lights.
+	lampShader->use();
+	GLState::BindVertexArray(lightVAO);
+	for (unsigned int i = 0; i < LampPositions.size(); i++)
+	{
+		model = glm::mat4();
+		model = glm::translate(model, LampPositions[i]);
+		model = glm::scale(model, glm::vec3(LampScale)); // Make it a smaller cube
+		lampShader->setMat4(LampModelLocation, model);
+		lampShader->setInt(LampIndexLocation, i % LightCount);
+		CubeMesh->Draw();
+	}
+}
+
+// Middle eye mapped onto the screen, in NDC of one eye viewport
+glm::vec2 App::GazePointNDC()
+{
+	return glm::vec2(pixelsize_cm * FPGAScreenWidth / ScreenWidth * Frame->MiddleEye.x / 2.f,
+		pixelsize_cm * FPGAScreenHeight / ScreenHeight * Frame->MiddleEye.y / 2.f);
+}
+
+void App::RenderDebugPoint()
+{
+	GpuScope Scope(Profiler, "RenderDebugPoint");
+
+	// world transformation
+	glm::mat4 DebugPointModel;
+	glm::mat4 DebugPointProjection;
+	glm::mat4 DebugPointView;
+
+	// Draw debug Point
+	// ------------------------------------------------------------------
+	DebugPointShader->use();
+	GLState::BindVertexArray(DebugPointVAO);
+
+	DebugPointModel = glm::scale(DebugPointModel, glm::vec3(DebugSquareScalar, DebugSquareScalar, 1.f));
+	DebugPointModel = glm::translate(DebugPointModel, glm::vec3(GazePointNDC() / DebugSquareScalar, 0.f));
+
+
+	DebugPointShader->setMat4(DebugPointLocations.Projection, DebugPointProjection);
+	DebugPointShader->setMat4(DebugPointLocations.View, DebugPointView);
+	DebugPointShader->setMat4(DebugPointLocations.Model, DebugPointModel);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	DrawCounter::Count(2);
+}
+
+void App::RenderScene()
+{
+	if (bDeferred)
+		RenderCubesDeferred();
+	else
+		RenderCubes();
+	RenderLight();
+}
+
+// what every stereo path draws into an eye before the debug point, so they all show the same content
+void App::RenderEyeScene()
+{
+	if (Options.bRenderScene)
+		RenderScene();
+}
+
+// the eye SetupEye chose into a cleared offscreen target, how every offscreen path and benchmark
+// submits an eye so their timings compare
+void App::RenderEyeSceneTo(RenderTarget& Target)
+{
+	Target.Bind();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	RenderEyeScene();
+}
+
+void App::ExportStats()
+{
+	Stats->Report();
+	Stats->ExportCSV("frame_stats.csv");
+	Stats->ExportJSON("frame_stats.json");
+}
+
+void App::FetchPose()
+{
+	camera->GetEyes(LeftEye, RightEye, RenderPoseSequence, RenderPoseTimestamp);
+
+	// the tracker is not listening during benchmarks, the eyes follow the script
+	if (Options.bBenchmark)
+		Script.EyesAt(FramesRendered, LeftEye, RightEye);
+}
+
+// per-frame prepare stage: everything both eyes share goes into the packet that is not being
+// submitted, which then becomes the frame; the blocks that stay the same for both eyes are
+// uploaded here once instead of per eye
+// ------------------------------------------------------------------------
+void App::PrepareFrame()
+{
+	Stats->BeginPhase(PHASE_FRAME_PREPARE);
+
+	FramePacket& Packet = Packets[Frame == &Packets[0] ? 1 : 0];
+	Packet.Number = Frame != nullptr ? Frame->Number + 1 : 1;
+	PrepareEyes(Packet);
+	PrepareScene(Packet);
+	Frame = &Packet;
+
+	// point lights are uploaded by BuildPointLights, only changes reach the driver
+	Clusters->Upload();
+	LightUniforms->Data = Frame->Lights;
+	LightUniforms->Update();
+	MaterialUniforms->Data.Shininess = 32.0f;
+	MaterialUniforms->Update();
+
+	Stats->EndPhase(PHASE_FRAME_PREPARE);
+}
+
+// both eyes' projection and view from the fetched eye positions
+// ------------------------------------------------------------------------
+void App::PrepareEyes(FramePacket& Packet)
+{
+	Packet.PoseSequence = RenderPoseSequence;
+	Packet.PoseTimestamp = RenderPoseTimestamp;
+	Packet.LeftEye = LeftEye;
+	Packet.RightEye = RightEye;
+	Packet.MiddleEye = (LeftEye + RightEye) / 2.f;
+
+	// screen corners, the screen is centered on the tracker origin
+	glm::vec3 pa = glm::vec3(-width_cm / 2.0f, -height_cm / 2.0f, 0.f);
+	glm::vec3 pb = glm::vec3(width_cm / 2.0f, -height_cm / 2.0f, 0.f);
+	glm::vec3 pc = glm::vec3(-width_cm / 2.0f, height_cm / 2.0f, 0.f);
+
+	for (int i = 0; i < 2; i++)
+	{
+		FramePacket::Eye& Eye = Packet.Eyes[i];
+
+		// setup camera paralax planes
+		glm::vec3 EyeScaled = (i == 0 ? LeftEye : RightEye) * ParallaxScale;
+		Eye.Projection = camera->GeneralizedPerspectiveProjection(pa, pb, pc, EyeScaled, NearPlane, FarPlane);
 
 		// 1 unit == 1m == 100 cm
-		EyeViewPointOffset_inUnits = RightEyeScaled / 100.f;
-		EyeViewPointOffset_inUnits += glm::vec3(0.f, 0.f, -VirtualCameraOffsetZ / 100.f);
-		//std::cout << "EyeViewPoint_inUnits: " << glm::to_string(EyeViewPointOffset_inUnits) << std::endl;
+		Eye.ViewPointOffset = EyeScaled / 100.f + glm::vec3(0.f, 0.f, -VirtualCameraOffsetZ / 100.f);
+
+		//http://paulbourke.net/stereographics/stereorender/
+		Eye.View = camera->GetViewMatrix(Eye.ViewPointOffset);
+	}
+}
+
+// lights and container transforms, the same for both eyes
+// ------------------------------------------------------------------------
+void App::PrepareScene(FramePacket& Packet)
+{
+	LightsBlock& Lights = Packet.Lights;
+
+	// directional light
+	Lights.DirLight.Direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+	Lights.DirLight.Ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+	Lights.DirLight.Diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+	Lights.DirLight.Specular = glm::vec3(0.5f, 0.5f, 0.5f);
+	// spotLight, at the world origin: following the eye was left disabled, it would differ per eye
+	// while the lights and the spot shadow map are shared by both
+	//Lights.SpotLight.Position = camera->Position + EyeViewPointOffset_inUnits;
+	Lights.SpotLight.Position = glm::vec3(0.0f, 0.0f, 0.0f);
+	Lights.SpotLight.Direction = camera->Front;
+	Lights.SpotLight.Ambient = glm::vec3(0.0f, 0.0f, 0.0f);
+	Lights.SpotLight.Diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+	Lights.SpotLight.Specular = glm::vec3(1.0f, 1.0f, 1.0f);
+	Lights.SpotLight.Constant = 1.0f;
+	Lights.SpotLight.Linear = 0.09f;
+	Lights.SpotLight.Quadratic = 0.032f;
+	Lights.SpotLight.CutOff = glm::cos(glm::radians(12.5f));
+	Lights.SpotLight.OuterCutOff = glm::cos(glm::radians(15.0f));
+	Packet.SpotLightRange = LightClusters::Range(Lights.SpotLight);
+
+	// placements for the instances, models for the draws that still take one and bounds for the
+	// light culling
+	Packet.CubePlacements.resize(cubePositions.size());
+	Packet.CubeRotations.resize(cubePositions.size());
+	Packet.CubeModels.resize(cubePositions.size());
+	Packet.CubeBounds.resize(cubePositions.size());
+	for (unsigned int i = 0; i < cubePositions.size(); i++)
+	{
+		glm::vec4& Placement = Packet.CubePlacements[i];
+		CubePlacement(i, Placement, Packet.CubeRotations[i]);
+		glm::mat4& Model = Packet.CubeModels[i];
+		Model = glm::mat4_cast(Packet.CubeRotations[i]);
+		Model[0] *= Placement.w;
+		Model[1] *= Placement.w;
+		Model[2] *= Placement.w;
+		Model[3] = glm::vec4(glm::vec3(Placement), 1.0f);
+		Packet.CubeBounds[i] = LightCuller::CubeBounds(Model);
+	}
+	Packet.CubesVersion = CubesVersion;
+}
+
+// per-eye submit stage: the eye's matrices from the frame packet become the current camera
+// ------------------------------------------------------------------------
+void App::SetupEye(bool IsLeftEye)
+{
+	const FramePacket::Eye& Eye = Frame->Eyes[IsLeftEye ? 0 : 1];
+	PerspectiveProjection = Eye.Projection;
+	view = Eye.View;
+	EyeViewPointOffset_inUnits = Eye.ViewPointOffset;
+}
+
+void App::MainRender(bool IsLeftEye)
+{
+	FramePhase EyePhase = IsLeftEye ? PHASE_LEFT_EYE : PHASE_RIGHT_EYE;
+	Stats->BeginPhase(EyePhase);
+	GpuScope Scope(Profiler, IsLeftEye ? "LeftEye" : "RightEye");
+
+	SetupEye(IsLeftEye);
+
+	if (IsLeftEye)
+		GLState::Viewport(0, 0, CurrentWidth / 2, CurrentHeight);
+	else
+		GLState::Viewport(CurrentWidth / 2, 0, CurrentWidth / 2, CurrentHeight);
+
+	RenderEyeScene();
+	RenderDebugPoint();
+
+	Stats->EndPhase(EyePhase);
+}
+
+void App::RenderReprojectedStereo()
+{
+	int EyeWidth = CurrentWidth / 2;
+	SourceEyeTarget->Resize(EyeWidth, CurrentHeight);
+	WarpTarget->Resize(EyeWidth, CurrentHeight);
+
+	// fully shade the left eye offscreen
+	Stats->BeginPhase(PHASE_LEFT_EYE);
+	SetupEye(true);
+	glm::mat4 LeftViewProjection = PerspectiveProjection * view;
+
+	RenderEyeSceneTo(*SourceEyeTarget);
+	SourceEyeTarget->BlitToScreen(0, 0, EyeWidth, CurrentHeight);
+
+	GLState::Viewport(0, 0, EyeWidth, CurrentHeight);
+	RenderDebugPoint();
+	Stats->EndPhase(PHASE_LEFT_EYE);
+
+	// synthesize the right eye from the left eye's depth
+	Stats->BeginPhase(PHASE_RIGHT_EYE);
+	SetupEye(false);
+	{
+		GpuScope Scope(Profiler, "ReprojectionWarp");
+		Reprojection->Warp(*SourceEyeTarget, LeftViewProjection, PerspectiveProjection * view, NearPlane, FarPlane, *WarpTarget);
+	}
+
+	GLState::Viewport(EyeWidth, 0, EyeWidth, CurrentHeight);
+	{
+		GpuScope Scope(Profiler, "ReprojectionFillHoles");
+		Reprojection->FillHoles(*WarpTarget);
+	}
+	RenderDebugPoint();
+	Stats->EndPhase(PHASE_RIGHT_EYE);
+}
+
+// compares a reprojected right eye against a true render of it
+void App::BenchmarkReprojection()
+{
+	const int Iterations = 60;
+	int EyeWidth = CurrentWidth / 2;
+
+	SourceEyeTarget->Resize(EyeWidth, CurrentHeight);
+	WarpTarget->Resize(EyeWidth, CurrentHeight);
+	RenderTarget Reference(EyeWidth, CurrentHeight);
+	RenderTarget Synthesized(EyeWidth, CurrentHeight);
+
+	unsigned int Queries[2];
+	glGenQueries(2, Queries);
+	GLuint64 RenderTime = 0, ReprojectionTime = 0;
+
+	FetchPose();
+	PrepareFrame();
+	for (int i = 0; i < Iterations; i++)
+	{
+		SetupEye(true);
+		glm::mat4 LeftViewProjection = PerspectiveProjection * view;
+		RenderEyeSceneTo(*SourceEyeTarget);
+
+		SetupEye(false);
+
+		glBeginQuery(GL_TIME_ELAPSED, Queries[0]);
+		RenderEyeSceneTo(Reference);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		glBeginQuery(GL_TIME_ELAPSED, Queries[1]);
+		Reprojection->Warp(*SourceEyeTarget, LeftViewProjection, PerspectiveProjection * view, NearPlane, FarPlane, *WarpTarget);
+		Synthesized.Bind();
+		Reprojection->FillHoles(*WarpTarget);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		GLuint64 Elapsed;
+		glGetQueryObjectui64v(Queries[0], GL_QUERY_RESULT, &Elapsed);
+		RenderTime += Elapsed;
+		glGetQueryObjectui64v(Queries[1], GL_QUERY_RESULT, &Elapsed);
+		ReprojectionTime += Elapsed;
+	}
+	glDeleteQueries(2, Queries);
+
+	std::vector<unsigned char> ReferencePixels(EyeWidth * CurrentHeight * 4);
+	std::vector<unsigned char> SynthesizedPixels(EyeWidth * CurrentHeight * 4);
+	Reference.ReadPixels(ReferencePixels.data());
+	Synthesized.ReadPixels(SynthesizedPixels.data());
+	RenderTarget::BindScreen();
+
+	std::cout << "Reprojection benchmark " << EyeWidth << "x" << CurrentHeight
+		<< ": right eye render " << RenderTime / 1.0e6 / Iterations << "ms"
+		<< ", reprojection " << ReprojectionTime / 1.0e6 / Iterations << "ms"
+		<< ", PSNR " << StereoReprojection::ComputePSNR(ReferencePixels, SynthesizedPixels) << "dB" << std::endl;
+}
+
+
+void App::RenderEyesOffscreen()
+{
+	int EyeWidth = CurrentWidth / 2;
+
+	for (int Eye = 0; Eye < 2; Eye++)
+	{
+		FramePhase EyePhase = Eye == 0 ? PHASE_LEFT_EYE : PHASE_RIGHT_EYE;
+		Stats->BeginPhase(EyePhase);
+
+		EyeTargets[Eye]->Resize(EyeWidth, CurrentHeight);
+
+		SetupEye(Eye == 0);
+		EyeViewProjection[Eye] = PerspectiveProjection * view;
+
+		RenderEyeSceneTo(*EyeTargets[Eye]);
+
+		Stats->EndPhase(EyePhase);
+	}
+	RenderTarget::BindScreen();
+}
+
+// Present the offscreen eyes, reprojected to the newest tracker pose when one arrived during rendering
+void App::PresentWithLatestPose()
+{
+	int EyeWidth = CurrentWidth / 2;
+
+	glm::vec3 LatestLeftEye, LatestRightEye;
+	unsigned int LatestSequence;
+	double LatestTimestamp;
+	camera->GetEyes(LatestLeftEye, LatestRightEye, LatestSequence, LatestTimestamp);
+
+	// collect the warp costs the GPU has finished without waiting on it; a query stays in flight
+	// until its result is there, and one from an already reported window is dropped
+	for (int i = 0; i < LateWarpQueryCount; i++)
+	{
+		if (LateWarpQueryWindow[i] < 0)
+			continue;
+		GLint Available = 0;
+		glGetQueryObjectiv(LateWarpQueries[i], GL_QUERY_RESULT_AVAILABLE, &Available);
+		if (!Available)
+			continue;
+		if (LateWarpQueryWindow[i] == LateWarpWindow)
+		{
+			GLuint64 Elapsed;
+			glGetQueryObjectui64v(LateWarpQueries[i], GL_QUERY_RESULT, &Elapsed);
+			LateWarpGPUTime += Elapsed / 1.0e9;
+			++LateWarpGPUSamples;
+		}
+		LateWarpQueryWindow[i] = -1;
+	}
+
+	double Now = GetTime();
+	++LateWarpFrames;
+	LateWarpRenderedPoseAge += Now - RenderPoseTimestamp;
+
+	if (LatestSequence == RenderPoseSequence)
+	{
+		LateWarpPresentedPoseAge += Now - RenderPoseTimestamp;
+
+		EyeTargets[0]->BlitToScreen(0, 0, EyeWidth, CurrentHeight);
+		EyeTargets[1]->BlitToScreen(EyeWidth, 0, EyeWidth, CurrentHeight);
+
+		for (int Eye = 0; Eye < 2; Eye++)
+		{
+			SetupEye(Eye == 0);
+			GLState::Viewport(Eye * EyeWidth, 0, EyeWidth, CurrentHeight);
+			RenderDebugPoint();
+		}
+	}
+	else
+	{
+		++LateWarpWarped;
+		LateWarpPresentedPoseAge += Now - LatestTimestamp;
+
+		LeftEye = LatestLeftEye;
+		RightEye = LatestRightEye;
+		PrepareFrame();
+
+		// this warp goes untimed if every query is still in flight
+		int QueryIndex = -1;
+		for (int i = 0; i < LateWarpQueryCount && QueryIndex < 0; i++)
+		{
+			if (LateWarpQueryWindow[i] < 0)
+				QueryIndex = i;
+		}
+		if (QueryIndex >= 0)
+			glBeginQuery(GL_TIME_ELAPSED, LateWarpQueries[QueryIndex]);
+		for (int Eye = 0; Eye < 2; Eye++)
+		{
+			SetupEye(Eye == 0);
+			WarpTarget->Resize(EyeWidth, CurrentHeight);
+			{
+				GpuScope Scope(Profiler, "ReprojectionWarp");
+				Reprojection->Warp(*EyeTargets[Eye], EyeViewProjection[Eye], PerspectiveProjection * view, NearPlane, FarPlane, *WarpTarget);
+			}
+
+			GLState::Viewport(Eye * EyeWidth, 0, EyeWidth, CurrentHeight);
+			{
+				GpuScope Scope(Profiler, "ReprojectionFillHoles");
+				Reprojection->FillHoles(*WarpTarget);
+			}
+			RenderDebugPoint();
+		}
+		if (QueryIndex >= 0)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			LateWarpQueryWindow[QueryIndex] = LateWarpWindow;
+		}
+	}
+
+	if (Now - LateWarpReportTime >= 1.0)
+	{
+		std::cout << "Late warp: " << LateWarpWarped << "/" << LateWarpFrames << " frames warped"
+			<< ", pose age rendered " << LateWarpRenderedPoseAge * 1000.0 / LateWarpFrames << "ms"
+			<< " presented " << LateWarpPresentedPoseAge * 1000.0 / LateWarpFrames << "ms";
+		if (LateWarpGPUSamples > 0)
+			std::cout << ", warp cost " << LateWarpGPUTime * 1000.0 / LateWarpGPUSamples << "ms over " << LateWarpGPUSamples << " timed warps";
+		std::cout << std::endl;
+
+		RestartLateWarpReport();
+	}
+}
+
+// start a new late warp report window from now, queries still in flight no longer count
+// ------------------------------------------------------------------------
+void App::RestartLateWarpReport()
+{
+	LateWarpReportTime = GetTime();
+	++LateWarpWindow;
+	LateWarpFrames = LateWarpWarped = LateWarpGPUSamples = 0;
+	LateWarpRenderedPoseAge = LateWarpPresentedPoseAge = LateWarpGPUTime = 0.0;
+}
+
+
+void App::RenderFoveatedEye(bool IsLeftEye, int x, int y, int width, int height)
+{
+	SetupEye(IsLeftEye);
+	Foveation->Begin(width, height, GazePointNDC());
+
+	// whole frustum at reduced resolution
+	RenderEyeSceneTo(*Foveation->Periphery);
+
+	// full resolution around the gaze point
+	glm::mat4 EyeProjection = PerspectiveProjection;
+	PerspectiveProjection = Foveation->InsetProjection(EyeProjection);
+	RenderEyeSceneTo(*Foveation->Inset);
+	PerspectiveProjection = EyeProjection;
+
+	RenderTarget::BindScreen();
+	GLState::Viewport(x, y, width, height);
+	{
+		GpuScope Scope(Profiler, "FoveatedComposite");
+		Foveation->Composite();
 	}
+}
 
-	glm::vec3 FacePosOriginal = (camera->LeftEye - camera->RightEye) / 2.f;
-	glm::vec3 EyeSeparation;
-	EyeSeparation.x = (camera->RightEye.x - camera->LeftEye.x) / 2.f;
-	EyeSeparation.y = (camera->RightEye.y - camera->LeftEye.y) / 2.f;
-	EyeSeparation.z = (camera->RightEye.z - camera->LeftEye.z) / 2.f;
+void App::RenderFoveatedStereo()
+{
+	int EyeWidth = CurrentWidth / 2;
 
-	//http://paulbourke.net/stereographics/stereorender/
-	view = camera->GetViewMatrix(EyeViewPointOffset_inUnits);
+	Stats->BeginPhase(PHASE_LEFT_EYE);
+	RenderFoveatedEye(true, 0, 0, EyeWidth, CurrentHeight);
+	RenderDebugPoint();
+	Stats->EndPhase(PHASE_LEFT_EYE);
 
+	Stats->BeginPhase(PHASE_RIGHT_EYE);
+	RenderFoveatedEye(false, EyeWidth, 0, EyeWidth, CurrentHeight);
 	RenderDebugPoint();
-	//RenderCubes();
-	//RenderLight();
+	Stats->EndPhase(PHASE_RIGHT_EYE);
+}
+
+// fill-rate and GPU time of foveated against full resolution shading on the FPGA panel resolution
+void App::BenchmarkFoveation()
+{
+	const int Iterations = 30;
+	int EyeWidth = (int)FPGAScreenWidth / 2;
+	int EyeHeight = (int)FPGAScreenHeight;
+
+	RenderTarget Full(EyeWidth, EyeHeight);
+
+	unsigned int Queries[2];
+	glGenQueries(2, Queries);
+	GLuint64 FullTime = 0, FoveatedTime = 0;
 
+	FetchPose();
+	PrepareFrame();
+	for (int i = 0; i < Iterations; i++)
+	{
+		// the full pass submits the eye like BenchmarkReprojection's reference and both foveated passes
+		SetupEye(true);
+		glBeginQuery(GL_TIME_ELAPSED, Queries[0]);
+		RenderEyeSceneTo(Full);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		glBeginQuery(GL_TIME_ELAPSED, Queries[1]);
+		RenderFoveatedEye(true, 0, 0, EyeWidth, EyeHeight);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		GLuint64 Elapsed;
+		glGetQueryObjectui64v(Queries[0], GL_QUERY_RESULT, &Elapsed);
+		FullTime += Elapsed;
+		glGetQueryObjectui64v(Queries[1], GL_QUERY_RESULT, &Elapsed);
+		FoveatedTime += Elapsed;
+	}
+	glDeleteQueries(2, Queries);
+	RenderTarget::BindScreen();
+
+	long long FullPixels = (long long)EyeWidth * EyeHeight;
+	std::cout << "Foveation benchmark " << EyeWidth << "x" << EyeHeight << " per eye"
+		<< ": shaded pixels " << Foveation->ShadedPixels() << "/" << FullPixels
+		<< " (" << 100.0 * Foveation->ShadedPixels() / FullPixels << "%)"
+		<< ", full " << FullTime / 1.0e6 / Iterations << "ms"
+		<< ", foveated " << FoveatedTime / 1.0e6 / Iterations << "ms" << std::endl;
 }
 
+// GPU time of the container pass per lighting variant, at full eye resolution
+// ------------------------------------------------------------------------
+void App::BenchmarkLightingVariants()
+{
+	const int Iterations = 30;
+	int EyeWidth = CurrentWidth / 2;
+
+	struct Case
+	{
+		const char* Name;
+		int Variant;
+	};
+	const Case Cases[] = {
+		{ "per draw", -1 },
+		{ "all", LIGHTING_ALL },
+		{ "no spot", LIGHTING_ALL & ~LIGHTING_SPOT_LIGHT },
+		{ "2 point", (LIGHTING_ALL & ~LIGHTING_POINT_LIGHTS) | 2 },
+		{ "1 point", (LIGHTING_ALL & ~LIGHTING_POINT_LIGHTS) | 1 },
+		{ "dir only", LIGHTING_DIR_LIGHT | LIGHTING_SPECULAR_MAP },
+		{ "dir only, no specular", LIGHTING_DIR_LIGHT }
+	};
+
+	RenderTarget Target(EyeWidth, CurrentHeight);
+	unsigned int Query;
+	glGenQueries(1, &Query);
+
+	FetchPose();
+	PrepareFrame();
+	SetupEye(true);
+	std::cout << "Lighting variant benchmark " << EyeWidth << "x" << CurrentHeight << ", " << cubePositions.size() << " containers:";
+	for (const Case& Test : Cases)
+	{
+		ForcedLightingVariant = Test.Variant;
+		// first pass compiles the variant if it is new
+		Target.Bind();
+		RenderCubes();
 
+		GLuint64 Total = 0;
+		for (int i = 0; i < Iterations; i++)
+		{
+			glBeginQuery(GL_TIME_ELAPSED, Query);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			RenderCubes();
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 Elapsed;
+			glGetQueryObjectui64v(Query, GL_QUERY_RESULT, &Elapsed);
+			Total += Elapsed;
+		}
+		std::cout << (Test.Variant == -1 ? " " : ", ") << Test.Name << " " << Total / 1.0e6 / Iterations << "ms";
+	}
+	std::cout << std::endl;
 
+	ForcedLightingVariant = -1;
+	glDeleteQueries(1, &Query);
+	RenderTarget::BindScreen();
+}
 
-int main()
+// the demo's four white point lights, or Count coloured ones scattered through the scene
+// ------------------------------------------------------------------------
+void App::BuildPointLights(int Count)
 {
-	App OpenGLApp = App();
+	std::vector<PointLightBlock>& Lights = Clusters->Lights;
+	Lights.clear();
+	if (Count <= 0)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			PointLightBlock PointLight;
+			PointLight.Position = pointLightPositions[i];
+			PointLight.Ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+			PointLight.Diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+			PointLight.Specular = glm::vec3(1.0f, 1.0f, 1.0f);
+			PointLight.Constant = 1.0f;
+			PointLight.Linear = 0.09f;
+			PointLight.Quadratic = 0.032f;
+			Lights.push_back(PointLight);
+		}
+	}
+	else
+	{
+		// dimmer and falling off faster than the demo lights, each reaches about 6 units
+		std::vector<glm::vec3> Positions, Colors;
+		BenchmarkScript::BuildLights(Count, Positions, Colors);
+		for (int i = 0; i < Count; i++)
+		{
+			PointLightBlock PointLight;
+			PointLight.Position = Positions[i];
+			PointLight.Ambient = glm::vec3(0.0f);
+			PointLight.Diffuse = Colors[i] * 0.4f;
+			PointLight.Specular = Colors[i] * 0.2f;
+			PointLight.Constant = 1.0f;
+			PointLight.Linear = 0.7f;
+			PointLight.Quadratic = 4.0f;
+			Lights.push_back(PointLight);
+		}
+	}
+	Clusters->Upload();
+}
+
+// CPU binning and culling, and GPU time of the container pass from 4 to 4096 point lights at full eye
+// resolution, clustered against every light per fragment
+// ------------------------------------------------------------------------
+void App::BenchmarkClusteredLighting()
+{
+	const int Iterations = 10;
+	const int LightCounts[] = { 4, 16, 64, 256, 1024, 4096 };
+	int EyeWidth = CurrentWidth / 2;
+
+	RenderTarget Target(EyeWidth, CurrentHeight);
+	unsigned int Query;
+	glGenQueries(1, &Query);
+
+	// container pass with one variant forced on every draw
+	auto TimeVariant = [&](int Variant)
+	{
+		ForcedLightingVariant = Variant;
+		// first pass compiles the variant if it is new
+		Target.Bind();
+		RenderCubes();
+
+		GLuint64 Total = 0;
+		for (int i = 0; i < Iterations; i++)
+		{
+			glBeginQuery(GL_TIME_ELAPSED, Query);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			RenderCubes();
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 Elapsed;
+			glGetQueryObjectui64v(Query, GL_QUERY_RESULT, &Elapsed);
+			Total += Elapsed;
+		}
+		return Total / 1.0e6 / Iterations;
+	};
+
+	FetchPose();
+	PrepareFrame();
+	SetupEye(true);
+	std::cout << "Clustered lighting benchmark " << EyeWidth << "x" << CurrentHeight << ", " << cubePositions.size() << " containers, "
+		<< LightClusters::TilesX << "x" << LightClusters::TilesY << "x" << LightClusters::Slices << " clusters on " << Workers->Concurrency() << " threads:" << std::endl;
+	for (int Count : LightCounts)
+	{
+		BuildPointLights(Count);
+
+		// neither the camera nor the containers move, so every build and cull has to be forced
+		double BinTime = 0.0;
+		double CullTime = 0.0;
+		for (int i = 0; i < Iterations; i++)
+		{
+			Clusters->Invalidate();
+			Clusters->Build(PerspectiveProjection, view);
+			BinTime += Clusters->Last.Milliseconds;
+			Culler->Invalidate();
+			Culler->Cull(*Clusters, Frame->CubeBounds);
+			CullTime += Culler->Last.Milliseconds;
+		}
+
+		const int Base = LIGHTING_DIR_LIGHT | LIGHTING_SPECULAR_MAP;
+		double ClusteredTime = TimeVariant(Base | LIGHTING_CLUSTERED);
+		double ListedTime = TimeVariant(Base | LIGHTING_LIGHT_LIST);
+		double EveryLightTime = TimeVariant(Base | LIGHTING_EVERY_POINT_LIGHT);
+		double PerDrawTime = TimeVariant(-1);
+		std::cout << "  " << Count << " lights: binning " << BinTime / Iterations << "ms, "
+			<< (double)Clusters->Last.References / LightClusters::Count << " lights per cluster (max " << Clusters->Last.MaxPerCluster << ")"
+			<< ", culling " << CullTime / Iterations << "ms, " << (double)Culler->Last.References / cubePositions.size() << " lights per container"
+			<< ", clustered " << ClusteredTime << "ms, culled lists " << ListedTime << "ms, every light " << EveryLightTime << "ms"
+			<< ", picked per container " << PerDrawTime << "ms" << std::endl;
+	}
+
+	ForcedLightingVariant = -1;
+	BuildPointLights(Options.PointLights);
+	glDeleteQueries(1, &Query);
+	RenderTarget::BindScreen();
+}
+
+// GPU time and estimated memory traffic of the containers in both eyes at 5120x1440, forward
+// against deferred, from 64 to 4096 point lights. Traffic counts 8 bytes of color and depth per
+// forward fragment; deferred fragments write or read the 12 byte G-buffer texel and the light
+// volumes blend another 8 bytes of color
+// ------------------------------------------------------------------------
+void App::BenchmarkDeferredShading()
+{
+	const int Iterations = 10;
+	const int EyeWidth = 2560;
+	const int EyeHeight = 1440;
+	const int LightCounts[] = { 64, 256, 1024, 4096 };
+
+	RenderTarget LeftTarget(EyeWidth, EyeHeight);
+	RenderTarget RightTarget(EyeWidth, EyeHeight);
+	RenderTarget* Targets[2] = { &LeftTarget, &RightTarget };
+	unsigned int Queries[2];
+	glGenQueries(2, Queries);
+
+	auto RenderEyes = [&](bool bDeferredPass)
+	{
+		for (int Eye = 0; Eye < 2; Eye++)
+		{
+			SetupEye(Eye == 0);
+			Targets[Eye]->Bind();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			if (bDeferredPass)
+				RenderCubesDeferred();
+			else
+				RenderCubes();
+		}
+	};
+
+	// GPU time of both eyes, and the fragments they shaded
+	auto TimeEyes = [&](bool bDeferredPass, double& Fragments)
+	{
+		// first pass compiles variants and builds the light lists
+		RenderEyes(bDeferredPass);
+
+		GLuint64 Time = 0, Samples = 0;
+		for (int i = 0; i < Iterations; i++)
+		{
+			glBeginQuery(GL_TIME_ELAPSED, Queries[0]);
+			glBeginQuery(GL_SAMPLES_PASSED, Queries[1]);
+			RenderEyes(bDeferredPass);
+			glEndQuery(GL_SAMPLES_PASSED);
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 Result;
+			glGetQueryObjectui64v(Queries[0], GL_QUERY_RESULT, &Result);
+			Time += Result;
+			glGetQueryObjectui64v(Queries[1], GL_QUERY_RESULT, &Result);
+			Samples += Result;
+		}
+		Fragments = (double)Samples / Iterations;
+		return Time / 1.0e6 / Iterations;
+	};
+
+	FetchPose();
+	PrepareFrame();
+	std::cout << "Deferred shading benchmark " << 2 * EyeWidth << "x" << EyeHeight << ", " << cubePositions.size() << " containers, G-buffer "
+		<< DeferredRenderer::BytesPerPixel << " bytes a pixel:" << std::endl;
+	for (int Count : LightCounts)
+	{
+		BuildPointLights(Count);
+
+		double ForwardFragments, DeferredFragments;
+		double ForwardTime = TimeEyes(false, ForwardFragments);
+		double DeferredTime = TimeEyes(true, DeferredFragments);
+
+		// the volumes' own fragments need a query of their own, outside the one over the frame
+		Deferred->bCountLightFragments = true;
+		double LightFragments = 0.0;
+		for (int Eye = 0; Eye < 2; Eye++)
+		{
+			SetupEye(Eye == 0);
+			Targets[Eye]->Bind();
+			RenderCubesDeferred();
+			LightFragments += (double)Deferred->LightFragments;
+		}
+		Deferred->bCountLightFragments = false;
+
+		double ForwardMB = ForwardFragments * 8.0 / 1.0e6;
+		double DeferredMB = (DeferredFragments * DeferredRenderer::BytesPerPixel + LightFragments * 8.0) / 1.0e6;
+		std::cout << "  " << Count << " lights: forward " << ForwardTime << "ms, " << ForwardMB << "MB"
+			<< ", deferred " << DeferredTime << "ms, " << DeferredMB << "MB (" << LightFragments / (2.0 * EyeWidth * EyeHeight) << " light volumes a pixel)" << std::endl;
+	}
+
+	BuildPointLights(Options.PointLights);
+	glDeleteQueries(2, Queries);
+	RenderTarget::BindScreen();
+}
+
+// normal matrices on the CPU against inverting the model per vertex: the batched kernel for rigid
+// and for non-uniformly scaled models next to glm's inverse, then the GPU time of both eyes
+// drawing the containers into a tiny target, so vertex work dominates; run it on the instances
+// scene for a meaningful vertex load
+// ------------------------------------------------------------------------
+void App::BenchmarkNormalMatrices()
+{
+	const int Iterations = 30;
+	const int Counts[] = { 1024, 16384, 262144, 1048576 };
+
+	FetchPose();
+	PrepareFrame();
+	const std::vector<glm::mat4>& Models = Frame->CubeModels;
+	std::cout << "Normal matrix benchmark:" << std::endl;
+	NormalMatrices Batch;
+	std::vector<glm::mat3> Normals, Reference;
+	for (int Count : Counts)
+	{
+		std::vector<glm::mat4> Rigid(Count), Scaled(Count);
+		for (int i = 0; i < Count; i++)
+		{
+			Rigid[i] = Models[i % Models.size()];
+			Scaled[i] = glm::scale(Rigid[i], glm::vec3(1.f, 2.f, 0.5f));
+		}
+
+		// warm, so allocation stays out of the timing
+		Batch.Compute(Scaled, Normals);
+		Batch.Compute(Rigid, Normals);
+		double RigidTime = Batch.Last.Milliseconds;
+		Batch.Compute(Scaled, Normals);
+		double ScaledTime = Batch.Last.Milliseconds;
+
+		Reference.resize(Count);
+		double Start = GetTime();
+		for (int i = 0; i < Count; i++)
+			Reference[i] = NormalMatrices::Reference(Scaled[i]);
+		double ReferenceTime = (GetTime() - Start) * 1000.0;
+
+		std::cout << "  " << Count << " models: rigid " << RigidTime << "ms, scaled " << ScaledTime << "ms, glm inverse " << ReferenceTime << "ms" << std::endl;
+	}
+
+	RenderTarget Target(64, 36);
+	unsigned int Query;
+	glGenQueries(1, &Query);
+	// instances carry no model to invert, both variants draw per object
+	bool bSceneInstanced = bInstanced;
+	bInstanced = false;
+
+	auto TimeEyes = [&](int Variant)
+	{
+		ForcedLightingVariant = Variant;
+		// first pass compiles the variant if it is new
+		Target.Bind();
+		RenderCubes();
+
+		GLuint64 Total = 0;
+		for (int i = 0; i < Iterations; i++)
+		{
+			glBeginQuery(GL_TIME_ELAPSED, Query);
+			for (int Eye = 0; Eye < 2; Eye++)
+			{
+				SetupEye(Eye == 0);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				RenderCubes();
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 Elapsed;
+			glGetQueryObjectui64v(Query, GL_QUERY_RESULT, &Elapsed);
+			Total += Elapsed;
+		}
+		return Total / 1.0e6 / Iterations;
+	};
+	double InverseTime = TimeEyes(LIGHTING_DIR_LIGHT | LIGHTING_VERTEX_INVERSE);
+	double UniformTime = TimeEyes(LIGHTING_DIR_LIGHT);
+	std::cout << "  both eyes, " << cubePositions.size() << " containers, " << CubeMesh->Vertices.size() * cubePositions.size() << " vertices an eye: inverse per vertex "
+		<< InverseTime << "ms, normal matrix uniform " << UniformTime << "ms" << std::endl;
+
+	ForcedLightingVariant = -1;
+	bInstanced = bSceneInstanced;
+	glDeleteQueries(1, &Query);
+	RenderTarget::BindScreen();
+}
+
+// CPU and GPU time of a frame of 10 to 1M containers and as many lamps, instanced against a draw
+// per object. The CPU time is preparing the frame and submitting both eyes; the eyes are small so
+// fill stays out of the GPU time. The per draw path stops at 100k objects, past that a frame takes
+// seconds.
+// ------------------------------------------------------------------------
+void App::BenchmarkInstancing()
+{
+	const int Iterations = 10;
+	const int Counts[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+	const int MaxPerDraw = 100000;
+
+	RenderTarget Target(640, 360);
+	unsigned int Query;
+	glGenQueries(1, &Query);
+	std::vector<glm::vec3> SceneCubes = cubePositions;
+	std::vector<glm::vec3> SceneLamps = LampPositions;
+	bool bSceneInstanced = bInstanced;
+
+	// GPU milliseconds of a frame, its CPU milliseconds into CPUTime
+	auto TimeFrame = [&](bool bInstancedPass, double& CPUTime)
+	{
+		bInstanced = bInstancedPass;
+		GLuint64 Total = 0;
+		CPUTime = 0.0;
+		// the first pass compiles variants and grows the buffers, it is not counted
+		for (int i = -1; i < Iterations; i++)
+		{
+			double Start = GetTime();
+			glBeginQuery(GL_TIME_ELAPSED, Query);
+			PrepareFrame();
+			for (int Eye = 0; Eye < 2; Eye++)
+			{
+				SetupEye(Eye == 0);
+				Target.Bind();
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				RenderCubes();
+				RenderLight();
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+			double Submitted = GetTime();
+
+			GLuint64 Elapsed;
+			glGetQueryObjectui64v(Query, GL_QUERY_RESULT, &Elapsed);
+			if (i >= 0)
+			{
+				CPUTime += (Submitted - Start) * 1000.0;
+				Total += Elapsed;
+			}
+		}
+		CPUTime /= Iterations;
+		return Total / 1.0e6 / Iterations;
+	};
+
+	FetchPose();
+	std::cout << "Instancing benchmark, both eyes 640x360:" << std::endl;
+	for (int Count : Counts)
+	{
+		BenchmarkScript::BuildInstances(Count, cubePositions);
+		++CubesVersion;
+		BenchmarkScript::BuildInstances(Count, LampPositions, 0x6C078965u);
+		UploadLampInstances();
+
+		double InstancedCPU;
+		double InstancedGPU = TimeFrame(true, InstancedCPU);
+		std::cout << "  " << Count << " containers and lamps: instanced CPU " << InstancedCPU << "ms, GPU " << InstancedGPU << "ms";
+		if (Count <= MaxPerDraw)
+		{
+			double PerDrawCPU;
+			double PerDrawGPU = TimeFrame(false, PerDrawCPU);
+			std::cout << ", per draw CPU " << PerDrawCPU << "ms, GPU " << PerDrawGPU << "ms";
+		}
+		std::cout << std::endl;
+	}
+
+	cubePositions = SceneCubes;
+	++CubesVersion;
+	LampPositions = SceneLamps;
+	UploadLampInstances();
+	bInstanced = bSceneInstanced;
+	PrepareFrame();
+	glDeleteQueries(1, &Query);
+	RenderTarget::BindScreen();
+}
+
+// GPU time of both eyes drawing 10k to 1M lit containers instanced, from the float triangle list
+// the cube used to be uploaded as against the packed indexed mesh; the eyes are tiny so vertex
+// fetch and shading dominate
+// ------------------------------------------------------------------------
+void App::BenchmarkVertexFormat()
+{
+	const int Iterations = 10;
+	const int Counts[] = { 10000, 100000, 1000000 };
+	const unsigned int Variant = LIGHTING_DIR_LIGHT | LIGHTING_SPECULAR_MAP | LIGHTING_INSTANCED;
+
+	CubeMesh->Report("Cube");
+
+	// the triangle list as floats, the way LoadCubes uploaded it before it was packed
+	unsigned int FloatVBO;
+	glGenBuffers(1, &FloatVBO);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, FloatVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(CubeVertices), CubeVertices, GL_STATIC_DRAW);
+
+	// float and packed vertices, each with its own instances
+	unsigned int VAOs[2];
+	InstanceBuffer<CubeInstance>* Instances[2];
+	glGenVertexArrays(2, VAOs);
+	GLState::BindVertexArray(VAOs[0]);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	Instances[0] = CreateCubeInstances();
+	GLState::BindVertexArray(VAOs[1]);
+	CubeMesh->Attributes();
+	Instances[1] = CreateCubeInstances();
+
+	RenderTarget Target(64, 36);
+	unsigned int Query;
+	glGenQueries(1, &Query);
+
+	auto TimeEyes = [&](int Format, int Count)
+	{
+		GLuint64 Total = 0;
+		// the first pass compiles the variant, it is not counted
+		for (int i = -1; i < Iterations; i++)
+		{
+			glBeginQuery(GL_TIME_ELAPSED, Query);
+			for (int Eye = 0; Eye < 2; Eye++)
+			{
+				SetupEye(Eye == 0);
+				Target.Bind();
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				UpdateCameraBlock();
+				GLState::BindTexture(0, diffuseMap);
+				GLState::BindTexture(1, specularMap);
+				Clusters->Bind();
+				LightingShaders->Get(Variant).Program->use();
+				GLState::BindVertexArray(VAOs[Format]);
+				if (Format == 0)
+				{
+					glDrawArraysInstanced(GL_TRIANGLES, 0, 36, Count);
+					DrawCounter::Count(12ull * Count);
+				}
+				else
+					CubeMesh->DrawInstanced(Count);
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 Elapsed;
+			glGetQueryObjectui64v(Query, GL_QUERY_RESULT, &Elapsed);
+			if (i >= 0)
+				Total += Elapsed;
+		}
+		return Total / 1.0e6 / Iterations;
+	};
+
+	FetchPose();
+	PrepareFrame();
+	std::cout << "Vertex format benchmark, both eyes 64x36: " << sizeof(CubeVertices) << " bytes of float vertices against "
+		<< CubeMesh->Stats.VertexBytes << " bytes of packed vertices and " << CubeMesh->Stats.IndexBytes << " bytes of indices" << std::endl;
+	std::vector<glm::vec3> Positions;
+	for (int Count : Counts)
+	{
+		BenchmarkScript::BuildInstances(Count, Positions);
+		for (InstanceBuffer<CubeInstance>* Buffer : Instances)
+		{
+			Buffer->Data.resize(Count);
+			for (int i = 0; i < Count; i++)
+			{
+				CubeInstance& Instance = Buffer->Data[i];
+				Instance.PositionScale = glm::vec4(Positions[i], 1.0f);
+				Instance.Rotation = glm::angleAxis(glm::radians(20.0f * (i + 1)), glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f)));
+				Instance.PointLights = glm::ivec4(0);
+				Instance.LightList = glm::ivec2(0);
+			}
+			Buffer->Upload();
+		}
+
+		double FloatTime = TimeEyes(0, Count);
+		double PackedTime = TimeEyes(1, Count);
+		std::cout << "  " << Count << " containers: floats " << FloatTime << "ms, packed " << PackedTime << "ms" << std::endl;
+	}
+
+	delete Instances[0];
+	delete Instances[1];
+	GLState::DeleteVertexArrays(2, VAOs);
+	GLState::DeleteBuffers(1, &FloatVBO);
+	glDeleteQueries(1, &Query);
+	RenderTarget::BindScreen();
+}
+
+// ------------------------------------------------------------------------
+bool App::ShouldClose()
+{
+	if (Options.Frames > 0 && FramesRendered >= Options.Frames)
+		return true;
+	return Options.bHeadless ? false : glfwWindowShouldClose(window) != 0;
+}
+
+// stands in for the swap: flush the frame and keep at most two frames queued on the GPU
+// ------------------------------------------------------------------------
+void App::PresentHeadless()
+{
+	int Slot = FramesRendered % 2;
+	if (HeadlessFences[Slot] != 0)
+	{
+		glClientWaitSync(HeadlessFences[Slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		glDeleteSync(HeadlessFences[Slot]);
+	}
+	HeadlessFences[Slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+}
+
+// look up every uniform handle the render passes use
+// ------------------------------------------------------------------------
+void App::CacheUniforms()
+{
+	lampShader->bindUniformBlock("Camera", UBO_CAMERA);
+	lampShader->bindUniformBlock("Lights", UBO_LIGHTS);
+
+	lampShader->use();
+	lampShader->setInt("pointLightData", LIGHT_UNIT_DATA);
+
+	LampModelLocation = lampShader->uniform("model");
+	LampIndexLocation = lampShader->uniform("lamp");
+
+	lampInstancedShader->bindUniformBlock("Camera", UBO_CAMERA);
+	lampInstancedShader->bindUniformBlock("Lights", UBO_LIGHTS);
+
+	lampInstancedShader->use();
+	lampInstancedShader->setInt("pointLightData", LIGHT_UNIT_DATA);
+	lampInstancedShader->setFloat("lampScale", LampScale);
+
+	LampLightsLocation = lampInstancedShader->uniform("lampLights");
+	DebugPointLocations.Load(DebugPointShader);
+
+	Deferred->CacheUniforms();
+	Shadows->CacheUniforms();
+	Reprojection->CacheUniforms();
+	Foveation->CacheUniforms();
+}
+
+// pick up edited shader files: start recompiling after a change, swap finished programs in
+// ------------------------------------------------------------------------
+void App::ReloadShaders()
+{
+	Shader* Shaders[] = { lampShader, lampInstancedShader, DebugPointShader };
+
+	if (ShaderFiles != nullptr && ShaderFiles->Changed())
+	{
+		for (Shader* Program : Shaders)
+		{
+			if (Program->beginReload())
+				std::cout << "Recompiling " << Program->name() << std::endl;
+		}
+		LightingShaders->BeginReload();
+	}
+
+	// variants set themselves up again when swapped
+	LightingShaders->PollReload();
+
+	bool bSwapped = false;
+	for (Shader* Program : Shaders)
+	{
+		Shader::ReloadState State = Program->pollReload();
+		if (State == Shader::RELOAD_SWAPPED)
+		{
+			std::cout << "Reloaded " << Program->name() << std::endl;
+			bSwapped = true;
+		}
+		else if (State == Shader::RELOAD_FAILED)
+			std::cout << "ERROR::SHADER::RELOAD_FAILED " << Program->name() << ", keeping the previous program" << std::endl;
+	}
+
+	// handles and bindings belong to the old programs
+	if (bSwapped)
+		CacheUniforms();
+}
+
+// camera of the eye/pass about to draw, a no-op unless the matrices changed
+// ------------------------------------------------------------------------
+void App::UpdateCameraBlock()
+{
+	CameraBlock& Block = CameraUniforms->Data;
+	Block.Projection = PerspectiveProjection;
+	Block.View = view;
+	Block.Position = glm::vec4(camera->Position + EyeViewPointOffset_inUnits, 1.f);
+	CameraUniforms->Update();
+}
+
+// start recording into Path, or stop and report throughput if already recording
+// ------------------------------------------------------------------------
+void App::ToggleRecording(const std::string& Path)
+{
+	if (Recorder->IsRecording())
+	{
+		Recorder->Stop();
+		return;
+	}
+
+	// the Y4M header needs a nominal rate, benchmarks advance exactly one fixed step per frame
+	double FPS = Options.bBenchmark ? 1.0 / Script.FixedDeltaTime : (Options.FrameLimit > 0.0 ? Options.FrameLimit : Pacer.RefreshRate);
+	Recorder->Start(Path, CurrentWidth, CurrentHeight, (int)(FPS + 0.5));
+}
+
+// print the benchmark result as JSON and keep a copy in benchmark.json
+// ------------------------------------------------------------------------
+void App::ReportBenchmark(double Seconds)
+{
+	int Frames = std::max(FramesRendered, 1);
+	const DrawCounter& Draws = DrawCounter::Frame();
+
+	std::ostringstream Json;
+	Json << "{\n";
+	Json << "  \"scene\": \"" << ScenePresetNames[Options.Scene] << "\",\n";
+	Json << "  \"renderer\": \"" << glGetString(GL_RENDERER) << "\",\n";
+	Json << "  \"headless\": " << (Options.bHeadless ? "true" : "false") << ",\n";
+	Json << "  \"width\": " << CurrentWidth << ",\n";
+	Json << "  \"height\": " << CurrentHeight << ",\n";
+	Json << "  \"frames\": " << FramesRendered << ",\n";
+	Json << "  \"seconds\": " << Seconds << ",\n";
+	Json << "  \"fps\": " << FramesRendered / Seconds << ",\n";
+	Json << "  \"draw_calls_per_frame\": " << (double)Draws.DrawCalls / Frames << ",\n";
+	Json << "  \"triangles_per_frame\": " << (double)Draws.Triangles / Frames << ",\n";
+	Json << "  \"gl_calls_per_frame\": " << (double)Draws.GLCalls / Frames << ",\n";
+	Json << "  \"gl_calls_filtered_per_frame\": " << (double)Draws.FilteredCalls / Frames << ",\n";
+	Json << "  \"point_lights\": " << Clusters->Lights.size() << ",\n";
+	Json << "  \"deferred\": " << (bDeferred ? "true" : "false") << ",\n";
+	Json << "  \"light_binning_ms_per_frame\": " << Clusters->Total.Milliseconds / Frames << ",\n";
+	Json << "  \"light_culling_ms_per_frame\": " << Culler->Total.Milliseconds / Frames << ",\n";
+	Json << "  \"normal_matrix_ms_per_frame\": " << CubeNormals.Total.Milliseconds / Frames << ",\n";
+	Json << "  \"shadows\": " << (bShadows ? "true" : "false") << ",\n";
+	Json << "  \"shadow_maps_rendered_per_frame\": " << (double)Shadows->TotalRendered / Frames << ",\n";
+	Json << "  \"instanced\": " << (bInstanced ? "true" : "false") << ",\n";
+	Json << "  \"shader_startup_ms\": " << ShaderCache::Stats().Milliseconds << ",\n";
+	Json << "  \"shader_programs\": " << ShaderCache::Stats().Programs << ",\n";
+	Json << "  \"shader_cache_hits\": " << ShaderCache::Stats().Hits;
+
+	// Metric -1 is the CPU frame, PHASE_COUNT the GPU frame, anything else a phase
+	for (int Metric = -1; Metric <= PHASE_COUNT; Metric++)
+	{
+		double Result[4];
+		if (!Stats->Summary(Metric, Result))
+			continue;
+
+		std::string Name = Metric < 0 ? "cpu_frame" : (Metric == PHASE_COUNT ? "gpu_frame" : FramePhaseNames[Metric]);
+		Json << ",\n  \"" << Name << "_ms\": {\"p50\": " << Result[0] * 1000.0 << ", \"p95\": " << Result[1] * 1000.0
+			<< ", \"p99\": " << Result[2] * 1000.0 << ", \"max\": " << Result[3] * 1000.0 << "}";
+	}
+	Json << "\n}\n";
+
+	std::cout << Json.str();
+
+	std::ofstream File("benchmark.json");
+	if (File)
+		File << Json.str();
+	else
+		std::cout << "ERROR::BENCHMARK::FILE_NOT_SUCCESFULLY_WRITTEN benchmark.json" << std::endl;
+}
+
+
+
+
+int main(int argc, char** argv)
+{
+	// [--headless] [--size WxH] [--frames N] [--fps N] [--benchmark] [--scene cubes|lamps|instances] [--lights N] [--capture tga|bmp] [--record file.y4m] [--stats]
+	// [--deferred] [--no-shadows] [--no-instancing]
+	AppOptions Options;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+			Options.bHeadless = true;
+		else if (strcmp(argv[i], "--benchmark") == 0)
+			Options.bBenchmark = Options.bRenderScene = true;
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+		{
+			if (BenchmarkScript::ParseScene(argv[++i], Options.Scene))
+				Options.bRenderScene = true;
+			else
+				std::cout << "Unknown scene " << argv[i] << std::endl;
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+		{
+			int Width, Height;
+			if (sscanf(argv[++i], "%dx%d", &Width, &Height) == 2 && Width > 0 && Height > 0)
+			{
+				Options.Width = Width;
+				Options.Height = Height;
+			}
+			else
+				std::cout << "Invalid size " << argv[i] << ", keeping " << Options.Width << "x" << Options.Height << std::endl;
+		}
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+		{
+			if (FrameCapture::ParseFormat(argv[++i], Options.CaptureFormat))
+				Options.bCapture = true;
+			else
+				std::cout << "Unknown capture format " << argv[i] << std::endl;
+		}
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			Options.RecordPath = argv[++i];
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			Options.Frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+		{
+			Options.FrameLimit = atof(argv[++i]);
+			if (Options.FrameLimit <= 0.0)
+			{
+				std::cout << "Invalid frame rate " << argv[i] << ", frames stay unpaced" << std::endl;
+				Options.FrameLimit = 0.0;
+			}
+		}
+		else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+			Options.PointLights = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--deferred") == 0)
+			Options.bDeferred = true;
+		else if (strcmp(argv[i], "--no-shadows") == 0)
+			Options.bShadows = false;
+		else if (strcmp(argv[i], "--no-instancing") == 0)
+			Options.bInstanced = false;
+		else if (strcmp(argv[i], "--stats") == 0)
+			Options.bExportStats = true;
+		else
+			std::cout << "Unknown argument " << argv[i] << std::endl;
+	}
+
+	// a benchmark always ends
+	if (Options.bBenchmark && Options.Frames <= 0)
+		Options.Frames = 600;
+
+	App OpenGLApp(Options);
 	OpenGLApp.Start();
 
 	return 0;
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <xmmintrin.h>
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include "Timer.h"
+
+// Normal matrices of a batch of model matrices, computed once per object on the CPU so the vertex
+// shader only multiplies. The normal matrix is the inverse transpose of the model's upper 3x3,
+// whose columns are the cross products of the model's columns over its determinant; four models
+// are done at a time, transposed into a structure of arrays in SSE registers. Models that only
+// rotate and scale uniformly need no inverse: the shaders normalize the interpolated normal, so
+// a group of four such models copies its upper 3x3 and skips the cross products.
+class NormalMatrices
+{
+public:
+	// last Compute, and the sum of every Compute
+	struct ComputeStats
+	{
+		int Computes = 0;
+		unsigned int Matrices = 0;
+		// copied from rigid groups instead of inverted
+		unsigned int Rigid = 0;
+		double Milliseconds = 0.0;
+	};
+	ComputeStats Last;
+	ComputeStats Total;
+
+	// normal matrix of each model into Normals
+	// ------------------------------------------------------------------------
+	void Compute(const std::vector<glm::mat4>& Models, std::vector<glm::mat3>& Normals)
+	{
+		double Start = GetTime();
+		Last = ComputeStats();
+		Last.Computes = 1;
+		Last.Matrices = (unsigned int)Models.size();
+		Normals.resize(Models.size());
+
+		size_t Full = Models.size() & ~(size_t)3;
+		for (size_t i = 0; i < Full; i += 4)
+			Last.Rigid += ComputeGroup(&Models[i], &Normals[i], 4);
+		if (Full < Models.size())
+		{
+			// the tail is padded with identities, which are rigid and never decide a group
+			glm::mat4 Padded[4];
+			int Count = (int)(Models.size() - Full);
+			for (int i = 0; i < Count; i++)
+				Padded[i] = Models[Full + i];
+			Last.Rigid += ComputeGroup(Padded, &Normals[Full], Count);
+		}
+
+		Last.Milliseconds = (GetTime() - Start) * 1000.0;
+		Total.Computes++;
+		Total.Matrices += Last.Matrices;
+		Total.Rigid += Last.Rigid;
+		Total.Milliseconds += Last.Milliseconds;
+	}
+
+	// what the vertex shader used to compute for every vertex, reference for the benchmark
+	static glm::mat3 Reference(const glm::mat4& Model)
+	{
+		return glm::mat3(glm::transpose(glm::inverse(Model)));
+	}
+
+private:
+	// four models to Count normal matrices, returns how many were copied as rigid
+	// ------------------------------------------------------------------------
+	static unsigned int ComputeGroup(const glm::mat4* Models, glm::mat3* Normals, int Count)
+	{
+		// loaded a model per register, transposed so C[Column][Row] holds that element of all four
+		__m128 C[3][4];
+		for (int Column = 0; Column < 3; Column++)
+		{
+			for (int Model = 0; Model < 4; Model++)
+				C[Column][Model] = _mm_loadu_ps(&Models[Model][Column][0]);
+			_MM_TRANSPOSE4_PS(C[Column][0], C[Column][1], C[Column][2], C[Column][3]);
+		}
+
+		// rigid: columns pairwise orthogonal and of equal length, up to float noise
+		__m128 AA = Dot(C[0], C[0]);
+		__m128 BB = Dot(C[1], C[1]);
+		__m128 CC = Dot(C[2], C[2]);
+		__m128 Tolerance = _mm_mul_ps(AA, _mm_set1_ps(1e-4f));
+		__m128 Rigid = _mm_and_ps(Near(Dot(C[0], C[1]), _mm_setzero_ps(), Tolerance), Near(Dot(C[1], C[2]), _mm_setzero_ps(), Tolerance));
+		Rigid = _mm_and_ps(Rigid, Near(Dot(C[2], C[0]), _mm_setzero_ps(), Tolerance));
+		Rigid = _mm_and_ps(Rigid, _mm_and_ps(Near(AA, BB, Tolerance), Near(AA, CC, Tolerance)));
+		if (_mm_movemask_ps(Rigid) == 0xF)
+		{
+			for (int i = 0; i < Count; i++)
+				Normals[i] = glm::mat3(Models[i]);
+			return (unsigned int)Count;
+		}
+
+		// columns b x c, c x a and a x b over a . (b x c)
+		__m128 N[3][4];
+		Cross(C[1], C[2], N[0]);
+		Cross(C[2], C[0], N[1]);
+		Cross(C[0], C[1], N[2]);
+		__m128 InverseDeterminant = _mm_div_ps(_mm_set1_ps(1.f), Dot(C[0], N[0]));
+		for (int Column = 0; Column < 3; Column++)
+		{
+			for (int Row = 0; Row < 3; Row++)
+				N[Column][Row] = _mm_mul_ps(N[Column][Row], InverseDeterminant);
+			N[Column][3] = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(N[Column][0], N[Column][1], N[Column][2], N[Column][3]);
+		}
+
+		float Column[4];
+		for (int i = 0; i < Count; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				_mm_storeu_ps(Column, N[c][i]);
+				Normals[i][c] = glm::vec3(Column[0], Column[1], Column[2]);
+			}
+		}
+		return 0;
+	}
+
+	static __m128 Dot(const __m128 A[], const __m128 B[])
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(A[0], B[0]), _mm_mul_ps(A[1], B[1])), _mm_mul_ps(A[2], B[2]));
+	}
+
+	static void Cross(const __m128 A[], const __m128 B[], __m128 Result[])
+	{
+		Result[0] = _mm_sub_ps(_mm_mul_ps(A[1], B[2]), _mm_mul_ps(A[2], B[1]));
+		Result[1] = _mm_sub_ps(_mm_mul_ps(A[2], B[0]), _mm_mul_ps(A[0], B[2]));
+		Result[2] = _mm_sub_ps(_mm_mul_ps(A[0], B[1]), _mm_mul_ps(A[1], B[0]));
+	}
+
+	// |A - B| <= Tolerance per lane
+	static __m128 Near(__m128 A, __m128 B, __m128 Tolerance)
+	{
+		__m128 Difference = _mm_sub_ps(A, B);
+		__m128 Absolute = _mm_max_ps(Difference, _mm_sub_ps(_mm_setzero_ps(), Difference));
+		return _mm_cmple_ps(Absolute, Tolerance);
+	}
+};
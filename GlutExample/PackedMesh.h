@@ -0,0 +1,223 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "DrawCounter.h"
+#include "GLState.h"
+
+// Indexed mesh in a compact vertex format, built from a non-indexed triangle list of interleaved
+// position, normal and texture coordinate floats (32 bytes a vertex). Corners with the same packed
+// position, normal and texture coordinates are merged into one vertex and the triangles index
+// them with 16 bit indices, so fewer vertices are fetched and the post transform cache can reuse
+// shaded ones. A vertex is 24 bytes: the position stays float, the normal and tangent are signed
+// normalized GL_INT_2_10_10_10_REV (the tangent's w the handedness of the bitangent) and the
+// texture coordinates are half floats. Attributes uses locations 0 to 2 like the float layout did,
+// the tangent goes to TangentLocation for shaders that want it; no shader reads it yet, one that
+// does takes sign(w) as the handedness.
+class PackedMesh
+{
+public:
+	static const int TangentLocation = 7;
+
+	struct Vertex
+	{
+		float Position[3];
+		unsigned int Normal;
+		unsigned int Tangent;
+		unsigned short TexCoords[2];
+	};
+
+	std::vector<Vertex> Vertices;
+	std::vector<unsigned short> Indices;
+
+	// the source triangle list against the packed mesh
+	struct MeshStats
+	{
+		unsigned int SourceVertices = 0;
+		unsigned int SourceBytes = 0;
+		unsigned int VertexBytes = 0;
+		unsigned int IndexBytes = 0;
+	};
+	MeshStats Stats;
+
+	// SourceVertices vertices of 8 floats each, every 3 a triangle
+	// ------------------------------------------------------------------------
+	PackedMesh(const float* Source, int SourceVertices)
+	{
+		Build(Source, SourceVertices);
+
+		glGenBuffers(1, &VertexBuffer);
+		glGenBuffers(1, &IndexBuffer);
+		// the index buffer becomes an element buffer once a vertex array binds it in Attributes
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(Vertex), Vertices.data(), GL_STATIC_DRAW);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, IndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, Indices.size() * sizeof(unsigned short), Indices.data(), GL_STATIC_DRAW);
+	}
+
+	~PackedMesh()
+	{
+		GLState::DeleteBuffers(1, &VertexBuffer);
+		GLState::DeleteBuffers(1, &IndexBuffer);
+	}
+
+	// vertex attributes and index buffer on the bound vertex array, only the position if bPositionOnly
+	// ------------------------------------------------------------------------
+	void Attributes(bool bPositionOnly = false) const
+	{
+		GLState::BindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+		GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexBuffer);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+		glEnableVertexAttribArray(0);
+		if (bPositionOnly)
+			return;
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(TangentLocation, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+		glEnableVertexAttribArray(TangentLocation);
+	}
+
+	int IndexCount() const
+	{
+		return (int)Indices.size();
+	}
+
+	// from a vertex array set up with Attributes
+	// ------------------------------------------------------------------------
+	void Draw() const
+	{
+		glDrawElements(GL_TRIANGLES, IndexCount(), GL_UNSIGNED_SHORT, (void*)0);
+		DrawCounter::Count(Indices.size() / 3);
+	}
+
+	void DrawInstanced(int Instances) const
+	{
+		glDrawElementsInstanced(GL_TRIANGLES, IndexCount(), GL_UNSIGNED_SHORT, (void*)0, Instances);
+		DrawCounter::Count((unsigned long long)Instances * (Indices.size() / 3));
+	}
+
+	void Report(const char* Name) const
+	{
+		std::cout << Name << " mesh: " << Stats.SourceVertices << " vertices, " << Stats.SourceBytes << " bytes as floats; packed "
+			<< Vertices.size() << " vertices, " << Stats.VertexBytes << " bytes and " << Stats.IndexBytes << " bytes of indices" << std::endl;
+	}
+
+	// signed normalized 10:10:10:2 with x in the low bits, the layout of GL_INT_2_10_10_10_REV.
+	// w only keeps its sign, negative as -2: GL 3.3 decodes a 2 bit -1 to -1/3 and -2 to -1, later
+	// versions decode both to -1, so -2 reads as -1 under either rule
+	static unsigned int PackSnorm(const glm::vec4& Value)
+	{
+		glm::ivec4 Packed(glm::round(glm::clamp(Value, -1.0f, 1.0f) * glm::vec4(511.0f, 511.0f, 511.0f, 1.0f)));
+		Packed.w = Value.w < 0.0f ? -2 : Value.w > 0.0f ? 1 : 0;
+		return (Packed.x & 0x3FF) | (Packed.y & 0x3FF) << 10 | (Packed.z & 0x3FF) << 20 | (unsigned int)(Packed.w & 0x3) << 30;
+	}
+
+private:
+	unsigned int VertexBuffer;
+	unsigned int IndexBuffer;
+
+	// what two corners must share to become one vertex, the tangent is accumulated per vertex
+	struct VertexKey
+	{
+		float Position[3];
+		unsigned int Normal;
+		unsigned short TexCoords[2];
+
+		bool operator==(const VertexKey& Other) const { return memcmp(this, &Other, sizeof(VertexKey)) == 0; }
+	};
+
+	// FNV-1a over the key's bytes
+	struct VertexKeyHash
+	{
+		size_t operator()(const VertexKey& Key) const
+		{
+			const unsigned char* Bytes = (const unsigned char*)&Key;
+			unsigned int Hash = 2166136261u;
+			for (size_t i = 0; i < sizeof(VertexKey); i++)
+				Hash = (Hash ^ Bytes[i]) * 16777619u;
+			return Hash;
+		}
+	};
+
+	// ------------------------------------------------------------------------
+	void Build(const float* Source, int SourceVertices)
+	{
+		Stats.SourceVertices = (unsigned int)SourceVertices;
+		Stats.SourceBytes = (unsigned int)(SourceVertices * 8 * sizeof(float));
+
+		std::unordered_map<VertexKey, unsigned short, VertexKeyHash> Merged;
+		// per vertex sums of the tangents and bitangents of the triangles using it
+		std::vector<glm::vec3> Normals, Tangents, Bitangents;
+		for (int Triangle = 0; Triangle + 2 < SourceVertices; Triangle += 3)
+		{
+			const float* Corners[3] = { &Source[Triangle * 8], &Source[(Triangle + 1) * 8], &Source[(Triangle + 2) * 8] };
+
+			// tangent along u and bitangent along v of the triangle's texture mapping
+			glm::vec3 Edge1 = glm::vec3(Corners[1][0], Corners[1][1], Corners[1][2]) - glm::vec3(Corners[0][0], Corners[0][1], Corners[0][2]);
+			glm::vec3 Edge2 = glm::vec3(Corners[2][0], Corners[2][1], Corners[2][2]) - glm::vec3(Corners[0][0], Corners[0][1], Corners[0][2]);
+			glm::vec2 UV1 = glm::vec2(Corners[1][6], Corners[1][7]) - glm::vec2(Corners[0][6], Corners[0][7]);
+			glm::vec2 UV2 = glm::vec2(Corners[2][6], Corners[2][7]) - glm::vec2(Corners[0][6], Corners[0][7]);
+			float Determinant = UV1.x * UV2.y - UV2.x * UV1.y;
+			float Scale = std::abs(Determinant) > 1e-12f ? 1.0f / Determinant : 0.0f;
+			glm::vec3 Tangent = (Edge1 * UV2.y - Edge2 * UV1.y) * Scale;
+			glm::vec3 Bitangent = (Edge2 * UV1.x - Edge1 * UV2.x) * Scale;
+
+			for (const float* Corner : Corners)
+			{
+				VertexKey Key;
+				memcpy(Key.Position, Corner, 3 * sizeof(float));
+				Key.Normal = PackSnorm(glm::vec4(Corner[3], Corner[4], Corner[5], 0.0f));
+				Key.TexCoords[0] = glm::packHalf1x16(Corner[6]);
+				Key.TexCoords[1] = glm::packHalf1x16(Corner[7]);
+
+				auto Found = Merged.find(Key);
+				if (Found == Merged.end())
+				{
+					if (Vertices.size() > 0xFFFF)
+					{
+						std::cout << "ERROR::MESH::TOO_MANY_VERTICES more than 65536 for 16 bit indices" << std::endl;
+						Vertices.clear();
+						Indices.clear();
+						return;
+					}
+					Found = Merged.emplace(Key, (unsigned short)Vertices.size()).first;
+					Vertex Packed;
+					memcpy(Packed.Position, Key.Position, sizeof(Packed.Position));
+					Packed.Normal = Key.Normal;
+					Packed.TexCoords[0] = Key.TexCoords[0];
+					Packed.TexCoords[1] = Key.TexCoords[1];
+					Vertices.push_back(Packed);
+					Normals.push_back(glm::vec3(Corner[3], Corner[4], Corner[5]));
+					Tangents.push_back(glm::vec3(0.0f));
+					Bitangents.push_back(glm::vec3(0.0f));
+				}
+				Tangents[Found->second] += Tangent;
+				Bitangents[Found->second] += Bitangent;
+				Indices.push_back(Found->second);
+			}
+		}
+
+		// tangents made orthogonal to the normal, w flips the bitangent for mirrored mappings
+		for (size_t i = 0; i < Vertices.size(); i++)
+		{
+			glm::vec3 Tangent = Tangents[i] - Normals[i] * glm::dot(Normals[i], Tangents[i]);
+			float Length = glm::length(Tangent);
+			Tangent = Length > 1e-12f ? Tangent / Length : glm::vec3(0.0f);
+			float Handedness = glm::dot(glm::cross(Normals[i], Tangent), Bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+			Vertices[i].Tangent = PackSnorm(glm::vec4(Tangent, Handedness));
+		}
+
+		Stats.VertexBytes = (unsigned int)(Vertices.size() * sizeof(Vertex));
+		Stats.IndexBytes = (unsigned int)(Indices.size() * sizeof(unsigned short));
+	}
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <iostream>
+
+#include "GLState.h"
+
+// Offscreen framebuffer with a color and a sampleable depth attachment.
+// Used wherever an eye has to be rendered somewhere other than the back buffer.
+class RenderTarget
+{
+public:
+	unsigned int FBO = 0;
+	unsigned int ColorTexture = 0;
+	unsigned int DepthTexture = 0;
+	int Width = 0;
+	int Height = 0;
+
+	RenderTarget(int width, int height)
+	{
+		Resize(width, height);
+	}
+
+	~RenderTarget()
+	{
+		Release();
+	}
+
+	// framebuffer that stands in for the window's back buffer, 0 unless rendering headless
+	// ------------------------------------------------------------------------
+	static unsigned int& ScreenFramebuffer()
+	{
+		static unsigned int Screen = 0;
+		return Screen;
+	}
+
+	static void BindScreen()
+	{
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, ScreenFramebuffer());
+	}
+
+	// (re)allocate attachments, does nothing when the size is unchanged
+	// ------------------------------------------------------------------------
+	void Resize(int width, int height)
+	{
+		if (FBO != 0 && width == Width && height == Height)
+			return;
+
+		Release();
+
+		Width = width;
+		Height = height;
+
+		glGenFramebuffers(1, &FBO);
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+		glGenTextures(1, &ColorTexture);
+		GLState::BindTexture(0, ColorTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ColorTexture, 0);
+
+		glGenTextures(1, &DepthTexture);
+		GLState::BindTexture(0, DepthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, Width, Height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, DepthTexture, 0);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: Render target " << Width << "x" << Height << " is not complete!" << std::endl;
+
+		GLState::BindTexture(0, 0);
+		BindScreen();
+	}
+
+	// bind as draw target covering the whole attachment
+	// ------------------------------------------------------------------------
+	void Bind()
+	{
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, FBO);
+		GLState::Viewport(0, 0, Width, Height);
+	}
+
+	// copy color into a rectangle of the screen framebuffer
+	// ------------------------------------------------------------------------
+	void BlitToScreen(int x, int y, int width, int height)
+	{
+		GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+		GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, ScreenFramebuffer());
+		glBlitFramebuffer(0, 0, Width, Height, x, y, x + width, y + height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		BindScreen();
+	}
+
+	// read back color as tightly packed RGBA8 rows (bottom row first)
+	// ------------------------------------------------------------------------
+	void ReadPixels(unsigned char* destination)
+	{
+		GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, destination);
+		GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, ScreenFramebuffer());
+	}
+
+private:
+	void Release()
+	{
+		if (FBO != 0)
+		{
+			GLState::DeleteFramebuffers(1, &FBO);
+			GLState::DeleteTextures(1, &ColorTexture);
+			GLState::DeleteTextures(1, &DepthTexture);
+			FBO = ColorTexture = DepthTexture = 0;
+		}
+	}
+};
@@ -3,166 +3,573 @@
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <fstream>
-#include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "DrawCounter.h"
+#include "GLState.h"
+#include "ShaderCache.h"
 
 class Shader
 {
 public:
 	unsigned int ID;
-	// constructor generates the shader on the fly
+	// constructor generates the shader on the fly; defines are inserted after the #version line of
+	// every stage, #include "file" is resolved relative to the including file
 	// ------------------------------------------------------------------------
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "")
+		: Shader(Deferred(), vertexPath, fragmentPath, geometryPath, defines)
 	{
-		// 1. retrieve the vertex/fragment source code from filePath
+		// 1. retrieve the vertex/fragment source code from filePath, missing files are reported
 		std::string vertexCode;
 		std::string fragmentCode;
 		std::string geometryCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
-		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
-		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-			// if geometry shader path is present, also load a geometry shader
-			if (geometryPath != nullptr)
-			{
-				gShaderFile.open(geometryPath);
-				std::stringstream gShaderStream;
-				gShaderStream << gShaderFile.rdbuf();
-				gShaderFile.close();
-				geometryCode = gShaderStream.str();
-			}
-		}
-		catch (std::ifstream::failure e)
+		times.readBegin = now();
+		readSources(vertexCode, fragmentCode, geometryCode);
+		times.readEnd = now();
+		buildMilliseconds += (times.readEnd - times.readBegin) * 1000.0;
+		// 2. link from the binary cache when this exact program was built before, compile otherwise
+		submit(vertexCode, fragmentCode, geometryCode);
+		finish();
+	}
+	// tag for a shader that only remembers its files, ShaderBatch reads and submits it later
+	struct Deferred {};
+	Shader(Deferred, const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "")
+		: ID(0), vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath != nullptr ? geometryPath : ""), defines(defines)
+	{
+	}
+	// true if the program was linked from the binary cache instead of compiled
+	bool fromCache = false;
+	// time spent on the calling thread reading, submitting and waiting for the program
+	double buildMilliseconds = 0.0;
+	// when each step happened, seconds on the steady clock, for the startup timeline
+	struct BuildTimes
+	{
+		double readBegin = 0.0, readEnd = 0.0, submitted = 0.0, ready = 0.0;
+	};
+	BuildTimes times;
+	// issue compile and link (or load the cached binary) without waiting for the driver
+	// ------------------------------------------------------------------------
+	void submit(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode)
+	{
+		double start = now();
+		startBuild(current, vertexCode, fragmentCode, geometryCode);
+		ID = current.program;
+		fromCache = current.fromCache;
+		times.submitted = now();
+		buildMilliseconds += (times.submitted - start) * 1000.0;
+
+		ShaderCache::Totals& totals = ShaderCache::Stats();
+		totals.Programs++;
+		totals.Hits += fromCache ? 1 : 0;
+		totals.Milliseconds += buildMilliseconds;
+	}
+	// wait for the submitted program, report its errors and resolve its uniforms. Called on first
+	// use, so link status is only queried once the program is actually needed.
+	// ------------------------------------------------------------------------
+	void finish()
+	{
+		if (bReady)
+			return;
+		double start = now();
+		finishBuild(current);
+		cacheUniformLocations();
+		bReady = true;
+		times.ready = now();
+		buildMilliseconds += (times.ready - start) * 1000.0;
+		ShaderCache::Stats().Milliseconds += (times.ready - start) * 1000.0;
+	}
+	bool ready() const
+	{
+		return bReady;
+	}
+	// true once the driver is done with a submitted program, finish then never blocks
+	bool compiled() const
+	{
+		if (bReady || current.fromCache || !parallelCompile())
+			return true;
+		GLint done = GL_FALSE;
+		glGetProgramiv(current.program, GL_COMPLETION_STATUS_KHR, &done);
+		return done != 0;
+	}
+	// hot reload, see beginReload and pollReload
+	enum ReloadState {
+		RELOAD_NONE,
+		RELOAD_PENDING,
+		RELOAD_SWAPPED,
+		RELOAD_FAILED
+	};
+	// start rebuilding from the files on disk, false if their contents did not change since the
+	// last build. The driver compiles in the background when it supports parallel compiling.
+	// ------------------------------------------------------------------------
+	bool beginReload()
+	{
+		finish();
+		std::string vertexCode, fragmentCode, geometryCode;
+		if (!readSources(vertexCode, fragmentCode, geometryCode))
+			return false;
+		if (ShaderCache::Key({ vertexCode, fragmentCode, geometryCode }) == (pending.program != 0 ? pending.key : current.key))
+			return false;
+
+		discardBuild(pending);
+		startBuild(pending, vertexCode, fragmentCode, geometryCode);
+		return true;
+	}
+	// call at a frame boundary: swaps ID over to the reloaded program once the driver is done with
+	// it. On RELOAD_FAILED the errors were printed and the last good program stays in use. After
+	// RELOAD_SWAPPED all uniform handles, block bindings and uniform values must be set up again.
+	// ------------------------------------------------------------------------
+	ReloadState pollReload()
+	{
+		if (pending.program == 0)
+			return RELOAD_NONE;
+
+		if (!pending.fromCache && parallelCompile())
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			GLint done = GL_FALSE;
+			glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+			if (!done)
+				return RELOAD_PENDING;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		int success;
-		char infoLog[512];
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// if geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if (geometryPath != nullptr)
+
+		if (!finishBuild(pending))
 		{
-			const char * gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
+			// remember the broken sources, so they are not retried until edited again
+			current.key = pending.key;
+			discardBuild(pending);
+			return RELOAD_FAILED;
 		}
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr)
-			glAttachShader(ID, geometry);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		// delete the shaders as they're linked into our program now and no longer necessery
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
-			glDeleteShader(geometry);
 
+		GLState::DeleteProgram(current.program);
+		current = pending;
+		pending = Build();
+		ID = current.program;
+		cacheUniformLocations();
+		return RELOAD_SWAPPED;
+	}
+	// what logs call the program, the fragment shader path unless set
+	std::string label;
+	const std::string& name() const
+	{
+		return label.empty() ? fragmentPath : label;
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
 	void use()
 	{
-		glUseProgram(ID);
+		if (!bReady)
+			finish();
+		GLState::UseProgram(ID);
+	}
+	// attach a named uniform block to a binding point, ignored if the program has no such block
+	// ------------------------------------------------------------------------
+	void bindUniformBlock(const std::string &name, unsigned int binding) const
+	{
+		ensureReady();
+		unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, index, binding);
 	}
-	// utility uniform functions
+	// location handle of a uniform, resolved at link time; -1 (ignored by the setters) if the
+	// program has no such active uniform. Look handles up once and keep them for the hot path.
+	// ------------------------------------------------------------------------
+	int uniform(const std::string &name) const
+	{
+		ensureReady();
+		std::unordered_map<std::string, int>::const_iterator it = uniformLocations.find(name);
+		return it != uniformLocations.end() ? it->second : -1;
+	}
+	// utility uniform functions, by handle
+	// ------------------------------------------------------------------------
+	void setBool(int location, bool value) const
+	{
+		glUniform1i(location, (int)value);
+		DrawCounter::CountCalls();
+	}
+	void setInt(int location, int value) const
+	{
+		glUniform1i(location, value);
+		DrawCounter::CountCalls();
+	}
+	void setFloat(int location, float value) const
+	{
+		glUniform1f(location, value);
+		DrawCounter::CountCalls();
+	}
+	void setVec2(int location, const glm::vec2 &value) const
+	{
+		glUniform2fv(location, 1, &value[0]);
+		DrawCounter::CountCalls();
+	}
+	void setVec2(int location, float x, float y) const
+	{
+		glUniform2f(location, x, y);
+		DrawCounter::CountCalls();
+	}
+	void setIVec2(int location, int x, int y) const
+	{
+		glUniform2i(location, x, y);
+		DrawCounter::CountCalls();
+	}
+	void setIVec4(int location, const glm::ivec4 &value) const
+	{
+		glUniform4iv(location, 1, &value[0]);
+		DrawCounter::CountCalls();
+	}
+	void setVec3(int location, const glm::vec3 &value) const
+	{
+		glUniform3fv(location, 1, &value[0]);
+		DrawCounter::CountCalls();
+	}
+	void setVec3(int location, float x, float y, float z) const
+	{
+		glUniform3f(location, x, y, z);
+		DrawCounter::CountCalls();
+	}
+	void setVec4(int location, const glm::vec4 &value) const
+	{
+		glUniform4fv(location, 1, &value[0]);
+		DrawCounter::CountCalls();
+	}
+	void setVec4(int location, float x, float y, float z, float w) const
+	{
+		glUniform4f(location, x, y, z, w);
+		DrawCounter::CountCalls();
+	}
+	void setMat2(int location, const glm::mat2 &mat) const
+	{
+		glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+		DrawCounter::CountCalls();
+	}
+	void setMat3(int location, const glm::mat3 &mat) const
+	{
+		glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+		DrawCounter::CountCalls();
+	}
+	void setMat4(int location, const glm::mat4 &mat) const
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+		DrawCounter::CountCalls();
+	}
+	// utility uniform functions, by name (cached lookup, for code off the hot path)
 	// ------------------------------------------------------------------------
 	void setBool(const std::string &name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		setBool(uniform(name), value);
 	}
 	// ------------------------------------------------------------------------
 	void setInt(const std::string &name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		setInt(uniform(name), value);
 	}
 	// ------------------------------------------------------------------------
 	void setFloat(const std::string &name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		setFloat(uniform(name), value);
 	}
 	// ------------------------------------------------------------------------
 	void setVec2(const std::string &name, const glm::vec2 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec2(uniform(name), value);
 	}
 	void setVec2(const std::string &name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		setVec2(uniform(name), x, y);
+	}
+	void setIVec2(const std::string &name, int x, int y) const
+	{
+		setIVec2(uniform(name), x, y);
 	}
 	// ------------------------------------------------------------------------
 	void setVec3(const std::string &name, const glm::vec3 &value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec3(uniform(name), value);
 	}
 	void setVec3(const std::string &name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		setVec3(uniform(name), x, y, z);
 	}
 	// ------------------------------------------------------------------------
 	void setVec4(const std::string &name, const glm::vec4 &value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec4(uniform(name), value);
 	}
-	void setVec4(const std::string &name, float x, float y, float z, float w)
+	void setVec4(const std::string &name, float x, float y, float z, float w) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		setVec4(uniform(name), x, y, z, w);
 	}
 	// ------------------------------------------------------------------------
 	void setMat2(const std::string &name, const glm::mat2 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat2(uniform(name), mat);
 	}
 	// ------------------------------------------------------------------------
 	void setMat3(const std::string &name, const glm::mat3 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat3(uniform(name), mat);
 	}
 	// ------------------------------------------------------------------------
 	void setMat4(const std::string &name, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat4(uniform(name), mat);
 	}
 
 private:
+	std::unordered_map<std::string, int> uniformLocations;
+
+	// read a whole file into text, false if it can't be opened
+	// ------------------------------------------------------------------------
+	static bool readFile(const char* path, std::string& text)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+		std::streamoff size = file.tellg();
+		text.resize(size > 0 ? (size_t)size : 0);
+		file.seekg(0);
+		file.read(&text[0], text.size());
+		return !file.fail();
+	}
+
+	// a program on its way from sources to a linked program
+	struct Build
+	{
+		unsigned int program = 0;
+		unsigned int stages[3] = { 0, 0, 0 };
+		std::string key;
+		bool fromCache = false;
+	};
+
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::string geometryPath;
+	std::string defines;
+	Build current;
+	Build pending;
+	bool bReady = false;
+
+	friend class ShaderBatch;
+
+	static double now()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// lookups on a deferred program complete it first; that only changes what the program is
+	// waiting for, not what it is, so const callers may trigger it
+	void ensureReady() const
+	{
+		if (!bReady)
+			const_cast<Shader*>(this)->finish();
+	}
+
+	bool readSources(std::string& vertexCode, std::string& fragmentCode, std::string& geometryCode) const
+	{
+		return preprocess(vertexPath, vertexCode) && preprocess(fragmentPath, fragmentCode) &&
+			(geometryPath.empty() || preprocess(geometryPath, geometryCode));
+	}
+
+	// source of one stage with defines injected and includes spliced in
+	// ------------------------------------------------------------------------
+	bool preprocess(const std::string& path, std::string& code) const
+	{
+		std::vector<std::string> included;
+		code.clear();
+		if (!appendFile(path, code, included))
+			return false;
+
+		if (!defines.empty())
+		{
+			size_t version = code.find("#version");
+			size_t line = version != std::string::npos ? code.find('\n', version) : std::string::npos;
+			if (line == std::string::npos)
+				code = defines + "\n" + code;
+			else
+				code.insert(line + 1, defines + "\n");
+		}
+		return true;
+	}
+
+	// append a file to code, replacing #include lines by the named file; every file goes in once
+	// ------------------------------------------------------------------------
+	static bool appendFile(const std::string& path, std::string& code, std::vector<std::string>& included)
+	{
+		if (std::find(included.begin(), included.end(), path) != included.end())
+			return true;
+		included.push_back(path);
+
+		std::string text;
+		if (!readFile(path.c_str(), text))
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+			return false;
+		}
+
+		size_t slash = path.find_last_of("/\\");
+		std::string directory = slash != std::string::npos ? path.substr(0, slash + 1) : "";
+
+		size_t begin = 0;
+		while (begin < text.size())
+		{
+			size_t end = text.find('\n', begin);
+			end = end != std::string::npos ? end + 1 : text.size();
+
+			size_t first = text.find_first_not_of(" \t", begin);
+			if (first < end && text.compare(first, 8, "#include") == 0)
+			{
+				size_t open = text.find('"', first + 8);
+				size_t close = open < end ? text.find('"', open + 1) : std::string::npos;
+				if (close >= end)
+				{
+					std::cout << "ERROR::SHADER::MALFORMED_INCLUDE in " << path << std::endl;
+					return false;
+				}
+				if (!appendFile(directory + text.substr(open + 1, close - open - 1), code, included))
+					return false;
+				if (!code.empty() && code.back() != '\n')
+					code += '\n';
+			}
+			else
+				code.append(text, begin, end - begin);
+			begin = end;
+		}
+		return true;
+	}
+
+	// let the driver compile and link on its own threads, if it can
+	// ------------------------------------------------------------------------
+	static bool parallelCompile()
+	{
+		static int supported = -1;
+		if (supported < 0)
+		{
+			supported = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+			if (GLEW_KHR_parallel_shader_compile)
+				glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+			else if (GLEW_ARB_parallel_shader_compile)
+				glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		}
+		return supported != 0;
+	}
+
+	// link from the binary cache or issue compile and link, without waiting for either
+	// ------------------------------------------------------------------------
+	void startBuild(Build& build, const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode)
+	{
+		build.key = ShaderCache::Key({ vertexCode, fragmentCode, geometryCode });
+		build.program = glCreateProgram();
+		build.fromCache = ShaderCache::Load(build.program, build.key);
+		if (build.fromCache)
+			return;
+
+		// a failed glProgramBinary leaves the program unusable, start over
+		glDeleteProgram(build.program);
+		build.program = glCreateProgram();
+		parallelCompile();
+
+		const std::string* sources[3] = { &vertexCode, &fragmentCode, geometryPath.empty() ? nullptr : &geometryCode };
+		const GLenum types[3] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+		for (int i = 0; i < 3; i++)
+		{
+			if (sources[i] == nullptr)
+				continue;
+			const char* code = sources[i]->c_str();
+			build.stages[i] = glCreateShader(types[i]);
+			glShaderSource(build.stages[i], 1, &code, NULL);
+			glCompileShader(build.stages[i]);
+			glAttachShader(build.program, build.stages[i]);
+		}
+		// ask the driver to keep the binary around for the cache
+		if (ShaderCache::Supported())
+			glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(build.program);
+	}
+
+	// wait for a build, print its errors and store it in the binary cache, true if it linked
+	// ------------------------------------------------------------------------
+	bool finishBuild(Build& build)
+	{
+		if (build.fromCache)
+			return true;
+
+		const char* types[3] = { "VERTEX", "FRAGMENT", "GEOMETRY" };
+		for (int i = 0; i < 3; i++)
+		{
+			if (build.stages[i] != 0)
+				checkCompileErrors(build.stages[i], types[i]);
+		}
+		checkCompileErrors(build.program, "PROGRAM");
+		// delete the shaders as they're linked into our program now and no longer necessery
+		for (int i = 0; i < 3; i++)
+		{
+			if (build.stages[i] != 0)
+				glDeleteShader(build.stages[i]);
+			build.stages[i] = 0;
+		}
+
+		GLint linked = GL_FALSE;
+		glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+		if (linked)
+			ShaderCache::Save(build.program, build.key);
+		return linked != 0;
+	}
+
+	void discardBuild(Build& build)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			if (build.stages[i] != 0)
+				glDeleteShader(build.stages[i]);
+		}
+		if (build.program != 0)
+			glDeleteProgram(build.program);
+		build = Build();
+	}
+
+	// resolve every active uniform once after linking, array elements included
+	// ------------------------------------------------------------------------
+	void cacheUniformLocations()
+	{
+		uniformLocations.clear();
+
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::string buffer(std::max(maxLength, 1), '\0');
+
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type;
+			glGetActiveUniform(ID, i, (GLsizei)buffer.size(), &length, &size, &type, &buffer[0]);
+			std::string name(buffer.data(), length);
+
+			// uniform block members have no location
+			GLint location = glGetUniformLocation(ID, name.c_str());
+			if (location < 0)
+				continue;
+			uniformLocations[name] = location;
+
+			// arrays are reported once as "name[0]", make "name" and every element addressable
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			{
+				std::string base = name.substr(0, name.size() - 3);
+				uniformLocations[base] = location;
+				for (GLint element = 1; element < size; element++)
+				{
+					std::string elementName = base + "[" + std::to_string(element) + "]";
+					uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+				}
+			}
+		}
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
 	void checkCompileErrors(GLuint shader, std::string type)
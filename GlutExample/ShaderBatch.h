@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Shader.h"
+
+// Builds many programs at once instead of one after another.
+// Add only records the files. Submit preprocesses every source on a pool of threads, then issues
+// all compiles and links back to back on the GL thread without asking for any status, so the
+// driver can work on them in parallel (KHR_parallel_shader_compile) while the caller carries on.
+// Each program is completed when it is first used, or by Finish.
+class ShaderBatch
+{
+public:
+	// the returned shader is owned by the caller like any other
+	Shader* Add(const char* VertexPath, const char* FragmentPath, const char* GeometryPath = nullptr, const std::string& Defines = "")
+	{
+		Shader* Program = new Shader(Shader::Deferred(), VertexPath, FragmentPath, GeometryPath, Defines);
+		Pending.push_back(Program);
+		return Program;
+	}
+
+	// ------------------------------------------------------------------------
+	void Submit()
+	{
+		if (Pending.empty())
+			return;
+		if (Start == 0.0)
+			Start = Shader::now();
+
+		// file reads and include expansion touch no GL state, spread them over the cores
+		struct Sources
+		{
+			std::string Vertex, Fragment, Geometry;
+		};
+		std::vector<Sources> Code(Pending.size());
+		std::atomic_int Next{ 0 };
+		auto Read = [&]()
+		{
+			for (int i = Next++; i < (int)Pending.size(); i = Next++)
+			{
+				Pending[i]->times.readBegin = Shader::now();
+				Pending[i]->readSources(Code[i].Vertex, Code[i].Fragment, Code[i].Geometry);
+				Pending[i]->times.readEnd = Shader::now();
+			}
+		};
+		int Workers = std::min((int)Pending.size(), std::max(1, (int)std::thread::hardware_concurrency()));
+		std::vector<std::thread> Threads;
+		for (int i = 1; i < Workers; i++)
+			Threads.push_back(std::thread(Read));
+		Read();
+		for (std::thread& Thread : Threads)
+			Thread.join();
+
+		for (size_t i = 0; i < Pending.size(); i++)
+			Pending[i]->submit(Code[i].Vertex, Code[i].Fragment, Code[i].Geometry);
+
+		Submitted.insert(Submitted.end(), Pending.begin(), Pending.end());
+		Pending.clear();
+	}
+
+	// complete every submitted program, those the driver finished first
+	// ------------------------------------------------------------------------
+	void Finish()
+	{
+		Submit();
+		for (Shader* Program : Submitted)
+		{
+			if (Program->compiled())
+				Program->finish();
+		}
+		for (Shader* Program : Submitted)
+			Program->finish();
+	}
+
+	// one line per program: sources read, build submitted and ready, ms from the first Submit
+	// ------------------------------------------------------------------------
+	void Report() const
+	{
+		std::cout << "Shader startup timeline (ms: read begin-end | submitted | ready):" << std::endl;
+		for (const Shader* Program : Submitted)
+		{
+			const Shader::BuildTimes& Times = Program->times;
+			std::cout << "  " << Program->name() << ": " << (Times.readBegin - Start) * 1000.0 << "-" << (Times.readEnd - Start) * 1000.0
+				<< " | " << (Times.submitted - Start) * 1000.0 << " | ";
+			if (Program->ready())
+				std::cout << (Times.ready - Start) * 1000.0;
+			else
+				std::cout << "pending";
+			std::cout << (Program->fromCache ? " (cached)" : "") << std::endl;
+		}
+	}
+
+private:
+	std::vector<Shader*> Pending;
+	std::vector<Shader*> Submitted;
+	double Start = 0.0;
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// A program is keyed by a hash of everything that went into it: the stage sources with their
+// defines and the driver's vendor, renderer and version strings, so a driver update or an edited
+// shader simply misses. A cached binary the driver refuses to link is deleted and the caller
+// compiles from source as usual.
+class ShaderCache
+{
+public:
+	// where binaries are kept, relative to the working directory
+	static std::string& Directory()
+	{
+		static std::string Path = "shader_cache/";
+		return Path;
+	}
+
+	// startup totals over every program built so far
+	struct Totals
+	{
+		int Programs = 0;
+		int Hits = 0;
+		double Milliseconds = 0.0;
+	};
+
+	static Totals& Stats()
+	{
+		static Totals Result;
+		return Result;
+	}
+
+	// drivers without program binary formats get no cache at all
+	static bool Supported()
+	{
+		static int Formats = -1;
+		if (Formats < 0)
+		{
+			Formats = 0;
+			if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+				glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &Formats);
+		}
+		return Formats > 0;
+	}
+
+	// 64 bit FNV-1a over the given strings and the driver identification
+	// ------------------------------------------------------------------------
+	static std::string Key(const std::vector<std::string>& Parts)
+	{
+		unsigned long long Hash = 14695981039346656037ull;
+		std::string Driver = DriverString();
+		for (size_t i = 0; i <= Parts.size(); i++)
+		{
+			const std::string& Part = i < Parts.size() ? Parts[i] : Driver;
+			for (unsigned char c : Part)
+			{
+				Hash ^= c;
+				Hash *= 1099511628211ull;
+			}
+			// separator, so moving text between stages changes the key
+			Hash ^= 0xff;
+			Hash *= 1099511628211ull;
+		}
+
+		char Text[17];
+		snprintf(Text, sizeof(Text), "%016llx", Hash);
+		return Text;
+	}
+
+	// link Program from a cached binary, false if there is none or the driver rejected it
+	// ------------------------------------------------------------------------
+	static bool Load(unsigned int Program, const std::string& Key)
+	{
+		if (!Supported())
+			return false;
+
+		std::ifstream File(PathOf(Key), std::ios::binary | std::ios::ate);
+		if (!File)
+			return false;
+		std::streamoff Size = File.tellg();
+		File.seekg(0);
+
+		// the length is checked against the file before it sizes anything, a truncated or corrupt
+		// entry must not turn into a huge allocation
+		Header Head;
+		File.read((char*)&Head, sizeof(Head));
+		bool bValid = File && Head.Magic == MagicNumber && Head.Length > 0 && Size >= (std::streamoff)sizeof(Head)
+			&& (std::streamoff)Head.Length <= Size - (std::streamoff)sizeof(Head);
+		std::vector<char> Binary;
+		if (bValid)
+		{
+			Binary.resize(Head.Length);
+			File.read(Binary.data(), Binary.size());
+		}
+		if (!bValid || !File)
+		{
+			std::cout << "ERROR::SHADERCACHE:: Corrupt cache entry " << Key << ", recompiling" << std::endl;
+			File.close();
+			remove(PathOf(Key).c_str());
+			return false;
+		}
+
+		glProgramBinary(Program, Head.Format, Binary.data(), (GLsizei)Binary.size());
+		GLint Linked = GL_FALSE;
+		glGetProgramiv(Program, GL_LINK_STATUS, &Linked);
+		if (!Linked)
+		{
+			std::cout << "ERROR::SHADERCACHE:: Driver rejected cached binary " << Key << ", recompiling" << std::endl;
+			File.close();
+			remove(PathOf(Key).c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// write the binary of a freshly linked Program
+	// ------------------------------------------------------------------------
+	static void Save(unsigned int Program, const std::string& Key)
+	{
+		if (!Supported())
+			return;
+
+		GLint Length = 0;
+		glGetProgramiv(Program, GL_PROGRAM_BINARY_LENGTH, &Length);
+		if (Length <= 0)
+			return;
+
+		Header Head;
+		Head.Magic = MagicNumber;
+		Head.Length = (unsigned int)Length;
+		std::vector<char> Binary(Length);
+		GLenum Format = 0;
+		glGetProgramBinary(Program, Length, NULL, &Format, Binary.data());
+		Head.Format = Format;
+
+		MakeDirectory();
+		// write under a temporary name first, a crash mid-write never leaves a truncated entry
+		std::string Path = PathOf(Key);
+		std::string Temporary = Path + ".tmp";
+		{
+			std::ofstream File(Temporary, std::ios::binary);
+			if (!File)
+			{
+				std::cout << "ERROR::SHADERCACHE::FILE_NOT_SUCCESFULLY_WRITTEN " << Temporary << std::endl;
+				return;
+			}
+			File.write((const char*)&Head, sizeof(Head));
+			File.write(Binary.data(), Binary.size());
+		}
+		remove(Path.c_str());
+		rename(Temporary.c_str(), Path.c_str());
+	}
+
+	// one line summary, warm when every program came from the cache
+	// ------------------------------------------------------------------------
+	static void Report()
+	{
+		const Totals& Result = Stats();
+		std::cout << "Shader startup: " << Result.Programs << " programs in " << Result.Milliseconds << "ms, "
+			<< (Result.Programs > 0 && Result.Hits == Result.Programs ? "warm" : "cold") << " ("
+			<< Result.Hits << " from binary cache" << (Supported() ? "" : ", not supported by driver") << ")" << std::endl;
+	}
+
+private:
+	static const unsigned int MagicNumber = 0x31425047; // "GPB1"
+
+	struct Header
+	{
+		unsigned int Magic;
+		unsigned int Format;
+		unsigned int Length;
+	};
+
+	static std::string PathOf(const std::string& Key)
+	{
+		return Directory() + Key + ".bin";
+	}
+
+	static std::string DriverString()
+	{
+		const char* Vendor = (const char*)glGetString(GL_VENDOR);
+		const char* Renderer = (const char*)glGetString(GL_RENDERER);
+		const char* Version = (const char*)glGetString(GL_VERSION);
+		return std::string(Vendor ? Vendor : "") + "|" + (Renderer ? Renderer : "") + "|" + (Version ? Version : "");
+	}
+
+	static void MakeDirectory()
+	{
+#ifdef _WIN32
+		_mkdir(Directory().c_str());
+#else
+		mkdir(Directory().c_str(), 0755);
+#endif
+	}
+};
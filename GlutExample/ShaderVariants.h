@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "Shader.h"
+#include "ShaderBatch.h"
+
+// Specialized builds of one shader pair, keyed by a feature bitmask.
+// Defines turns a mask into the #define lines injected into the sources, so the compiler can drop
+// whatever a variant does not use. Variants are compiled on first use, or queued on a ShaderBatch
+// with Preload, and go through the program binary cache like any other shader. Handles is a
+// struct of uniform handles with a Load(const Shader*) member, looked up again whenever a variant
+// is (re)built; Configure sets up block bindings and uniform values that never change.
+template <typename Handles>
+class ShaderVariants
+{
+public:
+	struct Variant
+	{
+		Shader* Program;
+		Handles Uniforms;
+		bool bSetUp;
+	};
+
+	std::function<std::string(unsigned int)> Defines;
+	std::function<void(Shader*)> Configure;
+
+	ShaderVariants(const std::string& VertexPath, const std::string& FragmentPath) : VertexPath(VertexPath), FragmentPath(FragmentPath)
+	{
+	}
+
+	~ShaderVariants()
+	{
+		for (auto& Entry : Variants)
+		{
+			GLState::DeleteProgram(Entry.second.Program->ID);
+			delete Entry.second.Program;
+		}
+	}
+
+	// ------------------------------------------------------------------------
+	Variant& Get(unsigned int Mask)
+	{
+		typename std::map<unsigned int, Variant>::iterator It = Variants.find(Mask);
+		if (It == Variants.end())
+			It = Add(Mask, new Shader(VertexPath.c_str(), FragmentPath.c_str(), nullptr, Defines ? Defines(Mask) : ""));
+
+		// preloaded variants are set up on first use, which is also when their link status is needed
+		if (!It->second.bSetUp)
+			Setup(It->second);
+		return It->second;
+	}
+
+	// queue a variant on a batch to build it together with other programs
+	void Preload(unsigned int Mask, ShaderBatch& Batch)
+	{
+		if (Variants.find(Mask) == Variants.end())
+			Add(Mask, Batch.Add(VertexPath.c_str(), FragmentPath.c_str(), nullptr, Defines ? Defines(Mask) : ""));
+	}
+
+	const std::map<unsigned int, Variant>& All() const
+	{
+		return Variants;
+	}
+
+	// hot reload of every built variant, see Shader::beginReload / pollReload
+	// ------------------------------------------------------------------------
+	void BeginReload()
+	{
+		int Started = 0;
+		for (auto& Entry : Variants)
+			Started += Entry.second.Program->beginReload() ? 1 : 0;
+		if (Started > 0)
+			std::cout << "Recompiling " << Started << " variants of " << FragmentPath << std::endl;
+	}
+
+	// true if any variant was swapped
+	bool PollReload()
+	{
+		bool bSwapped = false;
+		for (auto& Entry : Variants)
+		{
+			Shader::ReloadState State = Entry.second.Program->pollReload();
+			if (State == Shader::RELOAD_SWAPPED)
+			{
+				Setup(Entry.second);
+				bSwapped = true;
+			}
+			else if (State == Shader::RELOAD_FAILED)
+				std::cout << "ERROR::SHADER::RELOAD_FAILED " << FragmentPath << " variant " << Entry.first << ", keeping the previous program" << std::endl;
+		}
+		if (bSwapped)
+			std::cout << "Reloaded " << FragmentPath << std::endl;
+		return bSwapped;
+	}
+
+private:
+	std::string VertexPath;
+	std::string FragmentPath;
+	std::map<unsigned int, Variant> Variants;
+
+	typename std::map<unsigned int, Variant>::iterator Add(unsigned int Mask, Shader* Program)
+	{
+		char Label[32];
+		snprintf(Label, sizeof(Label), " variant 0x%02x", Mask);
+		Program->label = FragmentPath + Label;
+
+		Variant& Result = Variants[Mask];
+		Result.Program = Program;
+		Result.bSetUp = false;
+		return Variants.find(Mask);
+	}
+
+	void Setup(Variant& Target)
+	{
+		Target.bSetUp = true;
+		if (Configure)
+			Configure(Target.Program);
+		Target.Uniforms.Load(Target.Program);
+	}
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+// the project defines NOMINMAX and WIN32_LEAN_AND_MEAN, so std::min and std::max stay usable
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Watches a directory for modified files on a background thread (inotify, or change
+// notifications on Windows). The render loop polls Changed once per frame and rebuilds whatever
+// it depends on; the watcher itself never touches GL.
+class ShaderWatcher
+{
+public:
+	ShaderWatcher(const std::string& Directory) : Directory(Directory)
+	{
+		Thread = std::thread([this]() { Run(); });
+	}
+
+	~ShaderWatcher()
+	{
+		bStop = true;
+		Thread.join();
+	}
+
+	// true once after any number of changes since the last call
+	bool Changed()
+	{
+		return bChanged.exchange(false);
+	}
+
+private:
+	std::string Directory;
+	std::thread Thread;
+	std::atomic_bool bStop{ false };
+	std::atomic_bool bChanged{ false };
+
+	// the wait times out regularly so the destructor never blocks for long
+	static const int WakeupMilliseconds = 100;
+
+#ifdef _WIN32
+	void Run()
+	{
+		HANDLE Handle = FindFirstChangeNotificationA(Directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+		if (Handle == INVALID_HANDLE_VALUE)
+		{
+			std::cout << "ERROR::SHADERWATCHER:: Can't watch " << Directory << std::endl;
+			return;
+		}
+
+		while (!bStop)
+		{
+			if (WaitForSingleObject(Handle, WakeupMilliseconds) == WAIT_OBJECT_0)
+			{
+				bChanged = true;
+				FindNextChangeNotification(Handle);
+			}
+		}
+		FindCloseChangeNotification(Handle);
+	}
+#else
+	void Run()
+	{
+		int Notify = inotify_init1(IN_NONBLOCK);
+		// editors either rewrite the file in place or move a new one over it
+		if (Notify < 0 || inotify_add_watch(Notify, Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		{
+			std::cout << "ERROR::SHADERWATCHER:: Can't watch " << Directory << std::endl;
+			if (Notify >= 0)
+				close(Notify);
+			return;
+		}
+
+		char Events[4096];
+		while (!bStop)
+		{
+			pollfd Poll = { Notify, POLLIN, 0 };
+			if (poll(&Poll, 1, WakeupMilliseconds) <= 0)
+				continue;
+			// drain the queue, only the fact that something changed matters
+			while (read(Notify, Events, sizeof(Events)) > 0)
+				bChanged = true;
+		}
+		close(Notify);
+	}
+#endif
+};
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_access.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include "DrawCounter.h"
+#include "GLState.h"
+#include "InstanceBuffer.h"
+#include "PackedMesh.h"
+#include "RenderTarget.h"
+#include "Shader.h"
+#include "ShaderBatch.h"
+#include "UniformBlocks.h"
+
+// texture units of the shadow maps in the lighting shader, after the light buffers and G-buffer
+enum ShadowTextureUnit {
+	SHADOW_UNIT_CASCADES = 7,
+	SHADOW_UNIT_SPOT = 8
+};
+
+// Shadow maps of the directional light and the spot light, rendered once per frame for both eyes.
+// The directional light has SHADOW_CASCADES cascades splitting the view depth up to ShadowDistance;
+// each one is fitted around the union of both eye frusta over its depth range. Cascades are
+// bounding spheres snapped to a coarse grid in light space, so small head movements leave their
+// matrices unchanged, and a map is only rendered again when its matrix or the casters changed.
+// The casters of every map rendered in a frame are culled into one instance buffer, each map a run
+// of it drawn with a single instanced draw. Lookups filter 3x3 hardware compared taps; the
+// matrices go to the Shadows block at UBO_SHADOWS.
+class ShadowMaps
+{
+public:
+	int CascadeResolution = 2048;
+	int SpotResolution = 1024;
+	// view depth covered by the cascades, nothing further away is shadowed
+	float ShadowDistance = 60.f;
+	// between uniform (0) and logarithmic (1) splits
+	float SplitBlend = 0.75f;
+	// how far casters outside a cascade can be towards the light
+	float CasterReach = 50.f;
+
+	// maps rendered by the last Render and over every call, of 1 + SHADOW_CASCADES each
+	int LastRendered = 0;
+	long long TotalRendered = 0;
+
+	// position and uniform scale, then the rotation, of one caster
+	struct CasterInstance
+	{
+		glm::vec4 PositionScale;
+		glm::quat Rotation;
+	};
+
+	// Mesh is every caster's shape, it has to be closed and fit in a unit cube; the program is built
+	// with the rest of Shaders, CacheUniforms once it was submitted
+	ShadowMaps(const PackedMesh& Mesh, ShaderBatch& Shaders) : Mesh(Mesh)
+	{
+		DepthShader = Shaders.Add("../resources/shaders/Shadow.vertex.glsl", "../resources/shaders/Shadow.fragment.glsl", nullptr, "#define INSTANCED 1");
+		Uniforms = new UniformBlock<ShadowsBlock>(UBO_SHADOWS);
+
+		glGenVertexArrays(1, &VAO);
+		GLState::BindVertexArray(VAO);
+		Mesh.Attributes(true);
+		Instances = new InstanceBuffer<CasterInstance>();
+		Instances->Attribute(3, 4, offsetof(CasterInstance, PositionScale));
+		Instances->Attribute(4, 4, offsetof(CasterInstance, Rotation));
+
+		glGenTextures(1, &CascadeTexture);
+		GLState::BindTexture(SHADOW_UNIT_CASCADES, CascadeTexture, GL_TEXTURE_2D_ARRAY);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, CascadeResolution, CascadeResolution, SHADOW_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		SetupCompare(GL_TEXTURE_2D_ARRAY);
+
+		glGenTextures(1, &SpotTexture);
+		GLState::BindTexture(SHADOW_UNIT_SPOT, SpotTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SpotResolution, SpotResolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		SetupCompare(GL_TEXTURE_2D);
+
+		// depth only, the attachment changes per map
+		glGenFramebuffers(1, &FBO);
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		RenderTarget::BindScreen();
+
+		for (int i = 0; i <= SHADOW_CASCADES; i++)
+			bValid[i] = false;
+	}
+
+	~ShadowMaps()
+	{
+		GLState::DeleteFramebuffers(1, &FBO);
+		GLState::DeleteTextures(1, &CascadeTexture);
+		GLState::DeleteTextures(1, &SpotTexture);
+		delete Uniforms;
+		delete DepthShader;
+		delete Instances;
+		GLState::DeleteVertexArrays(1, &VAO);
+	}
+
+	void CacheUniforms()
+	{
+		LightSpaceLocation = DepthShader->uniform("lightSpace");
+	}
+
+	// fit the maps to both eyes and render the ones whose view or casters changed; the casters are
+	// placed like the container instances, CastersVersion has to change whenever they move
+	// ------------------------------------------------------------------------
+	void Render(const glm::mat4 EyeProjection[2], const glm::mat4 EyeView[2], const LightsBlock& Lights, float SpotRange,
+		const std::vector<glm::vec4>& Placements, const std::vector<glm::quat>& Rotations, unsigned int CastersVersion)
+	{
+		if (CastersVersion != RenderedVersion)
+		{
+			RenderedVersion = CastersVersion;
+			Invalidate();
+		}
+
+		ShadowsBlock& Block = Uniforms->Data;
+		glm::mat4 LightSpace[SHADOW_CASCADES + 1];
+		FitCascades(EyeProjection, EyeView, Lights.DirLight.Direction, LightSpace, Block);
+		LightSpace[SHADOW_CASCADES] = SpotLightSpace(Lights.SpotLight, SpotRange);
+		Block.Spot = TextureSpace() * LightSpace[SHADOW_CASCADES];
+		Block.TexelSize = glm::vec4(1.f / CascadeResolution, 1.f / SpotResolution, 0.f, 0.f);
+		Uniforms->Update();
+
+		// the casters of each map to render as one run of the instance buffer
+		LastRendered = 0;
+		size_t First[SHADOW_CASCADES + 1], Count[SHADOW_CASCADES + 1];
+		Instances->Data.clear();
+		for (int Map = 0; Map <= SHADOW_CASCADES; Map++)
+		{
+			Count[Map] = 0;
+			if (bValid[Map] && LightSpace[Map] == Rendered[Map])
+				continue;
+			First[Map] = Instances->Data.size();
+			Cull(LightSpace[Map], Placements, Rotations);
+			Count[Map] = Instances->Data.size() - First[Map];
+			LastRendered++;
+		}
+		TotalRendered += LastRendered;
+		if (LastRendered == 0)
+			return;
+		Instances->Upload();
+
+		unsigned int Target = GLState::BoundDrawFramebuffer();
+		int Viewport[4];
+		GLState::CurrentViewport(Viewport);
+		for (int Map = 0; Map <= SHADOW_CASCADES; Map++)
+		{
+			if (bValid[Map] && LightSpace[Map] == Rendered[Map])
+				continue;
+			RenderMap(Map, LightSpace[Map], First[Map], Count[Map]);
+			Rendered[Map] = LightSpace[Map];
+			bValid[Map] = true;
+		}
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, Target);
+		GLState::Viewport(Viewport[0], Viewport[1], Viewport[2], Viewport[3]);
+	}
+
+	// maps on their texture units, the block stays bound to UBO_SHADOWS
+	void Bind() const
+	{
+		GLState::BindTexture(SHADOW_UNIT_CASCADES, CascadeTexture, GL_TEXTURE_2D_ARRAY);
+		GLState::BindTexture(SHADOW_UNIT_SPOT, SpotTexture);
+	}
+
+	// render every map again on the next Render
+	void Invalidate()
+	{
+		for (int i = 0; i <= SHADOW_CASCADES; i++)
+			bValid[i] = false;
+	}
+
+private:
+	Shader* DepthShader;
+	int LightSpaceLocation;
+	UniformBlock<ShadowsBlock>* Uniforms;
+
+	const PackedMesh& Mesh;
+	unsigned int VAO;
+	InstanceBuffer<CasterInstance>* Instances;
+
+	unsigned int CascadeTexture;
+	unsigned int SpotTexture;
+	unsigned int FBO;
+
+	// what each map, the cascades and then the spot light, was last rendered with
+	glm::mat4 Rendered[SHADOW_CASCADES + 1];
+	bool bValid[SHADOW_CASCADES + 1];
+	unsigned int RenderedVersion = 0;
+
+	// hardware depth compare with bilinear filtering, outside the map is lit
+	void SetupCompare(GLenum Target)
+	{
+		const float Border[] = { 1.f, 1.f, 1.f, 1.f };
+		glTexParameteri(Target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(Target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(Target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(Target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		glTexParameterfv(Target, GL_TEXTURE_BORDER_COLOR, Border);
+		glTexParameteri(Target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(Target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	}
+
+	// clip space to texture coordinates and depth
+	static glm::mat4 TextureSpace()
+	{
+		glm::mat4 Bias = glm::translate(glm::mat4(), glm::vec3(0.5f));
+		return glm::scale(Bias, glm::vec3(0.5f));
+	}
+
+	// split the view depth, then fit a light space box around both eyes' part of each slice
+	// ------------------------------------------------------------------------
+	void FitCascades(const glm::mat4 EyeProjection[2], const glm::mat4 EyeView[2], const glm::vec3& Direction, glm::mat4 LightSpace[], ShadowsBlock& Block)
+	{
+		// view space rays through the frustum corners of each eye, scaled to a view depth of 1
+		glm::vec3 Rays[2][4];
+		glm::mat4 EyeToWorld[2];
+		float Near = ShadowDistance;
+		for (int Eye = 0; Eye < 2; Eye++)
+		{
+			glm::mat4 InverseProjection = glm::inverse(EyeProjection[Eye]);
+			EyeToWorld[Eye] = glm::inverse(EyeView[Eye]);
+			for (int Corner = 0; Corner < 4; Corner++)
+			{
+				glm::vec4 Point = InverseProjection * glm::vec4(Corner & 1 ? 1.f : -1.f, Corner & 2 ? 1.f : -1.f, -1.f, 1.f);
+				glm::vec3 Ray = glm::vec3(Point) / Point.w;
+				Near = std::min(Near, -Ray.z);
+				Rays[Eye][Corner] = Ray / -Ray.z;
+			}
+		}
+
+		glm::vec3 Up = std::abs(Direction.y) > 0.99f * glm::length(Direction) ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+		glm::mat4 LightRotation = glm::lookAt(glm::vec3(0.f), Direction, Up);
+		glm::mat4 RotationToWorld = glm::inverse(LightRotation);
+
+		float Start = Near;
+		for (int Cascade = 0; Cascade < SHADOW_CASCADES; Cascade++)
+		{
+			float Fraction = (Cascade + 1) / (float)SHADOW_CASCADES;
+			float Uniform = Near + (ShadowDistance - Near) * Fraction;
+			float Logarithmic = Near * std::pow(ShadowDistance / Near, Fraction);
+			float End = Uniform + (Logarithmic - Uniform) * SplitBlend;
+
+			// corners of both eyes' slices, bounded by a sphere so the fit does not change as the eyes turn
+			glm::vec3 Corners[16];
+			glm::vec3 Center(0.f);
+			for (int Eye = 0; Eye < 2; Eye++)
+			{
+				for (int Corner = 0; Corner < 8; Corner++)
+				{
+					float Depth = Corner < 4 ? Start : End;
+					glm::vec3& World = Corners[Eye * 8 + Corner];
+					World = glm::vec3(EyeToWorld[Eye] * glm::vec4(Rays[Eye][Corner % 4] * Depth, 1.f));
+					Center += World / 16.f;
+				}
+			}
+			float Radius = 0.f;
+			for (const glm::vec3& Corner : Corners)
+				Radius = std::max(Radius, glm::length(Corner - Center));
+
+			// half size rounded up, then the center snapped to 1/16 of it: a multiple of the texel
+			// size that leaves the sphere inside the box, so texels never crawl and slight eye
+			// movements keep the cascade as it was
+			float Extent = std::ceil(Radius * 1.125f * 4.f) / 4.f;
+			float Step = Extent / 16.f;
+			glm::vec3 LightCenter = glm::vec3(LightRotation * glm::vec4(Center, 1.f));
+			LightCenter.x = std::floor(LightCenter.x / Step + 0.5f) * Step;
+			LightCenter.y = std::floor(LightCenter.y / Step + 0.5f) * Step;
+			LightCenter.z = std::floor(LightCenter.z / Step + 0.5f) * Step;
+			Center = glm::vec3(RotationToWorld * glm::vec4(LightCenter, 1.f));
+
+			glm::vec3 Eye = Center - glm::normalize(Direction) * (Extent + CasterReach);
+			glm::mat4 LightView = glm::lookAt(Eye, Center, Up);
+			glm::mat4 LightProjection = glm::ortho(-Extent, Extent, -Extent, Extent, 0.f, 2.f * Extent + CasterReach);
+			LightSpace[Cascade] = LightProjection * LightView;
+
+			Block.Cascades[Cascade] = TextureSpace() * LightSpace[Cascade];
+			Block.CascadeEnds[Cascade] = End;
+			Block.CascadeTexels[Cascade] = 2.f * Extent / CascadeResolution;
+			Start = End;
+		}
+	}
+
+	// perspective over the outer cone, out to where the light fades out; from wherever the block
+	// puts the light, which PrepareScene keeps at the origin
+	glm::mat4 SpotLightSpace(const SpotLightBlock& Spot, float Range) const
+	{
+		glm::vec3 Direction = glm::normalize(Spot.Direction);
+		glm::vec3 Up = std::abs(Direction.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+		float FieldOfView = 2.f * std::acos(Spot.OuterCutOff) * 1.1f;
+		return glm::perspective(FieldOfView, 1.f, 0.1f, std::max(Range, 0.2f)) * glm::lookAt(Spot.Position, Spot.Position + Direction, Up);
+	}
+
+	// append the casters that can reach a map to the instances: skip those whose bounding sphere is
+	// entirely left, right, below or above it, the depth range already reaches CasterReach towards the light
+	// ------------------------------------------------------------------------
+	void Cull(const glm::mat4& LightSpace, const std::vector<glm::vec4>& Placements, const std::vector<glm::quat>& Rotations)
+	{
+		// how far a clip space x, y and w can move for a unit step in world space
+		glm::vec3 Scale(glm::length(glm::vec3(glm::row(LightSpace, 0))), glm::length(glm::vec3(glm::row(LightSpace, 1))), glm::length(glm::vec3(glm::row(LightSpace, 3))));
+		for (size_t i = 0; i < Placements.size(); i++)
+		{
+			const glm::vec4& Placement = Placements[i];
+			glm::vec4 Clip = LightSpace * glm::vec4(glm::vec3(Placement), 1.f);
+			// around a unit cube of that scale
+			float Radius = 0.8660254f * Placement.w;
+			float W = Clip.w + Radius * Scale.z;
+			if (std::abs(Clip.x) - Radius * Scale.x > W || std::abs(Clip.y) - Radius * Scale.y > W)
+				continue;
+			Instances->Data.push_back({ Placement, Rotations[i] });
+		}
+	}
+
+	// draw Count casters from First of the instances into one map
+	// ------------------------------------------------------------------------
+	void RenderMap(int Map, const glm::mat4& LightSpace, size_t First, size_t Count)
+	{
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, FBO);
+		if (Map < SHADOW_CASCADES)
+		{
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, CascadeTexture, 0, Map);
+			GLState::Viewport(0, 0, CascadeResolution, CascadeResolution);
+		}
+		else
+		{
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, SpotTexture, 0);
+			GLState::Viewport(0, 0, SpotResolution, SpotResolution);
+		}
+		DrawCounter::CountCalls();
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: Shadow map " << Map << " is not complete!" << std::endl;
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		// slope scaled bias against acne, the lookups add a normal offset on top
+		GLState::Enable(GL_DEPTH_TEST);
+		GLState::Enable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.f, 4.f);
+		DrawCounter::CountCalls();
+
+		if (Count > 0)
+		{
+			DepthShader->use();
+			DepthShader->setMat4(LightSpaceLocation, LightSpace);
+			GLState::BindVertexArray(VAO);
+			Instances->Rebase(First);
+			Mesh.DrawInstanced((int)Count);
+		}
+
+		GLState::Disable(GL_POLYGON_OFFSET_FILL);
+	}
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+
+#include "DrawCounter.h"
+#include "RenderTarget.h"
+#include "Shader.h"
+#include "ShaderBatch.h"
+
+// Depth-image-based reprojection: synthesizes one eye from another eye's color and depth.
+// The source depth buffer is turned into a grid mesh that is unprojected with the source
+// eye matrices and projected again with the destination ones; disocclusion holes that
+// open up are filled along the scanline from the background side.
+class StereoReprojection
+{
+public:
+	// pixels per grid cell of the warp mesh, 1 is exact, 2 is a quarter of the vertices
+	int GridStep = 2;
+	// relative linear depth jump inside a cell that tears the mesh
+	float DepthDiscontinuity = 0.05f;
+	// how far the hole filling searches along the scanline, in pixels
+	int MaxHoleSearch = 64;
+
+	// the programs are built with the rest of Shaders, CacheUniforms once they were submitted
+	StereoReprojection(ShaderBatch& Shaders)
+	{
+		WarpShader = Shaders.Add("../resources/shaders/Reprojection.vertex.glsl", "../resources/shaders/Reprojection.fragment.glsl");
+		HoleFillShader = Shaders.Add("../resources/shaders/Fullscreen.vertex.glsl", "../resources/shaders/HoleFill.fragment.glsl");
+
+		// attribute-less draws still need a VAO in the core profile
+		glGenVertexArrays(1, &EmptyVAO);
+	}
+
+	~StereoReprojection()
+	{
+		GLState::DeleteVertexArrays(1, &EmptyVAO);
+		delete WarpShader;
+		delete HoleFillShader;
+	}
+
+	// ------------------------------------------------------------------------
+	void CacheUniforms()
+	{
+		// texture units never change, set them once
+		WarpShader->use();
+		WarpShader->setInt("srcColor", 0);
+		WarpShader->setInt("srcDepth", 1);
+		HoleFillShader->use();
+		HoleFillShader->setInt("warpedColor", 0);
+		HoleFillShader->setInt("warpedDepth", 1);
+		GLState::UseProgram(0);
+
+		SrcInvViewProjectionLocation = WarpShader->uniform("srcInvViewProjection");
+		DstViewProjectionLocation = WarpShader->uniform("dstViewProjection");
+		GridSizeLocation = WarpShader->uniform("gridSize");
+		NearPlaneLocation = WarpShader->uniform("nearPlane");
+		FarPlaneLocation = WarpShader->uniform("farPlane");
+		DepthDiscontinuityLocation = WarpShader->uniform("depthDiscontinuity");
+		MaxSearchLocation = HoleFillShader->uniform("maxSearch");
+	}
+
+	// warp source eye into destination target, leaving holes with alpha 0
+	// ------------------------------------------------------------------------
+	void Warp(RenderTarget& Source, const glm::mat4& SourceViewProjection, const glm::mat4& DestinationViewProjection,
+		float NearPlane, float FarPlane, RenderTarget& Destination)
+	{
+		int GridWidth = (Source.Width + GridStep - 1) / GridStep;
+		int GridHeight = (Source.Height + GridStep - 1) / GridStep;
+
+		// holes are where nothing lands on the transparent clear, the caller's clear colour is put back after
+		GLfloat ClearColor[4];
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, ClearColor);
+		Destination.Bind();
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glClearColor(ClearColor[0], ClearColor[1], ClearColor[2], ClearColor[3]);
+
+		WarpShader->use();
+		WarpShader->setMat4(SrcInvViewProjectionLocation, glm::inverse(SourceViewProjection));
+		WarpShader->setMat4(DstViewProjectionLocation, DestinationViewProjection);
+		WarpShader->setIVec2(GridSizeLocation, GridWidth, GridHeight);
+		WarpShader->setFloat(NearPlaneLocation, NearPlane);
+		WarpShader->setFloat(FarPlaneLocation, FarPlane);
+		WarpShader->setFloat(DepthDiscontinuityLocation, DepthDiscontinuity);
+
+		GLState::BindTexture(0, Source.ColorTexture);
+		GLState::BindTexture(1, Source.DepthTexture);
+
+		GLState::BindVertexArray(EmptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, GridWidth * GridHeight * 6);
+		DrawCounter::Count((unsigned long long)GridWidth * GridHeight * 2);
+
+		RenderTarget::BindScreen();
+	}
+
+	// resolve holes of a warped target into the currently bound framebuffer/viewport
+	// ------------------------------------------------------------------------
+	void FillHoles(RenderTarget& Warped)
+	{
+		GLState::Disable(GL_DEPTH_TEST);
+
+		HoleFillShader->use();
+		HoleFillShader->setInt(MaxSearchLocation, MaxHoleSearch);
+
+		GLState::BindTexture(0, Warped.ColorTexture);
+		GLState::BindTexture(1, Warped.DepthTexture);
+
+		GLState::BindVertexArray(EmptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		DrawCounter::Count(1);
+
+		GLState::Enable(GL_DEPTH_TEST);
+	}
+
+	// peak signal-to-noise ratio over the RGB channels of two RGBA8 images, in dB
+	// ------------------------------------------------------------------------
+	static double ComputePSNR(const std::vector<unsigned char>& Reference, const std::vector<unsigned char>& Test)
+	{
+		double SquaredError = 0.0;
+		size_t Samples = 0;
+		for (size_t i = 0; i + 3 < Reference.size() && i + 3 < Test.size(); i += 4)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				double diff = (double)Reference[i + c] - (double)Test[i + c];
+				SquaredError += diff * diff;
+			}
+			Samples += 3;
+		}
+
+		if (Samples == 0 || SquaredError == 0.0)
+			return INFINITY;
+
+		double MSE = SquaredError / (double)Samples;
+		return 10.0 * std::log10(255.0 * 255.0 / MSE);
+	}
+
+private:
+	Shader* WarpShader;
+	Shader* HoleFillShader;
+	unsigned int EmptyVAO;
+
+	int SrcInvViewProjectionLocation, DstViewProjectionLocation, GridSizeLocation;
+	int NearPlaneLocation, FarPlaneLocation, DepthDiscontinuityLocation;
+	int MaxSearchLocation;
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <chrono>
+
+// Monotonic seconds since the first call.
+// Replaces glfwGetTime so timing also works without a window system (headless runs).
+inline double GetTime()
+{
+	static const std::chrono::steady_clock::time_point Epoch = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - Epoch).count();
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "DrawCounter.h"
+#include "GLState.h"
+
+// binding points of the std140 blocks shared by the scene shaders
+enum UniformBinding {
+	UBO_CAMERA = 0,
+	UBO_LIGHTS = 1,
+	UBO_MATERIAL = 2,
+	UBO_SHADOWS = 3
+};
+
+// directional light shadow cascades, see ShadowMaps
+const int SHADOW_CASCADES = 3;
+
+// CPU mirrors of the GLSL blocks. Every vec3 is followed by a float in the shaders, so these
+// match std140 without explicit padding rules; the asserts catch any drift.
+struct CameraBlock
+{
+	glm::mat4 Projection;
+	glm::mat4 View;
+	glm::vec4 Position;
+};
+
+struct DirLightBlock
+{
+	glm::vec3 Direction; float Padding0;
+	glm::vec3 Ambient; float Padding1;
+	glm::vec3 Diffuse; float Padding2;
+	glm::vec3 Specular; float Padding3;
+};
+
+struct PointLightBlock
+{
+	glm::vec3 Position; float Constant;
+	glm::vec3 Ambient; float Linear;
+	glm::vec3 Diffuse; float Quadratic;
+	glm::vec3 Specular; float Range;
+};
+
+struct SpotLightBlock
+{
+	glm::vec3 Position; float CutOff;
+	glm::vec3 Direction; float OuterCutOff;
+	glm::vec3 Ambient; float Constant;
+	glm::vec3 Diffuse; float Linear;
+	glm::vec3 Specular; float Quadratic;
+};
+
+// point lights are not part of the block, see LightClusters
+struct LightsBlock
+{
+	DirLightBlock DirLight;
+	SpotLightBlock SpotLight;
+};
+
+struct MaterialBlock
+{
+	float Shininess;
+	float Padding[3];
+};
+
+// world to shadow map matrices, with what the lookups need to pick and filter a map
+struct ShadowsBlock
+{
+	glm::mat4 Cascades[SHADOW_CASCADES];
+	// view depth at which each cascade ends
+	glm::vec4 CascadeEnds;
+	// world space size of a texel of each cascade
+	glm::vec4 CascadeTexels;
+	glm::mat4 Spot;
+	// texel size in texture coordinates, x of the cascades and y of the spot light's map
+	glm::vec4 TexelSize;
+};
+
+static_assert(sizeof(CameraBlock) == 144, "Camera block does not match std140");
+static_assert(sizeof(DirLightBlock) == 64 && sizeof(PointLightBlock) == 64 && sizeof(SpotLightBlock) == 80, "Light structs do not match std140");
+static_assert(offsetof(LightsBlock, SpotLight) == 64 && sizeof(LightsBlock) == 144, "Lights block does not match std140");
+static_assert(sizeof(MaterialBlock) == 16, "Material block does not match std140");
+static_assert(offsetof(ShadowsBlock, Spot) == 224 && sizeof(ShadowsBlock) == 304, "Shadows block does not match std140");
+
+// A uniform buffer holding one std140 block, uploaded only when its contents changed.
+// Edit Data, then call Update before drawing. With several slots each change goes to the next
+// slot and is bound with glBindBufferRange, so data the GPU may still read from an earlier draw
+// is never overwritten; the buffer is orphaned when the slots wrap around.
+template <typename Block>
+class UniformBlock
+{
+public:
+	Block Data;
+
+	UniformBlock(unsigned int Binding, int Slots = 1) : Binding(Binding), Slots(Slots)
+	{
+		GLint Alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &Alignment);
+		Stride = (sizeof(Block) + Alignment - 1) / Alignment * Alignment;
+
+		memset((void*)&Data, 0, sizeof(Block));
+		glGenBuffers(1, &UBO);
+		GLState::BindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, Stride * Slots, NULL, GL_DYNAMIC_DRAW);
+	}
+
+	~UniformBlock()
+	{
+		GLState::DeleteBuffers(1, &UBO);
+	}
+
+	// upload and bind if Data differs from what the shaders currently see
+	// ------------------------------------------------------------------------
+	void Update()
+	{
+		if (bUploaded && memcmp(&Data, &Uploaded, sizeof(Block)) == 0)
+			return;
+
+		Slot = bUploaded ? (Slot + 1) % Slots : 0;
+
+		GLState::BindBuffer(GL_UNIFORM_BUFFER, UBO);
+		if (Slot == 0 && Slots > 1)
+			glBufferData(GL_UNIFORM_BUFFER, Stride * Slots, NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, Stride * Slot, sizeof(Block), &Data);
+		GLState::BindBufferRange(GL_UNIFORM_BUFFER, Binding, UBO, Stride * Slot, sizeof(Block));
+		DrawCounter::CountCalls(Slot == 0 && Slots > 1 ? 2 : 1);
+
+		Uploaded = Data;
+		bUploaded = true;
+	}
+
+private:
+	unsigned int UBO;
+	unsigned int Binding;
+	int Slots;
+	int Slot = 0;
+	size_t Stride;
+
+	Block Uploaded;
+	bool bUploaded = false;
+};
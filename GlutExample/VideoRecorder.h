@@ -0,0 +1,359 @@
+#pragma once
+
+#include "AsyncReadback.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VIDEORECORDER_SSE2 1
+#endif
+
+// Continuous recording of the presented frames to an uncompressed Y4M (YUV 4:2:0) stream.
+// Frames come back through AsyncReadback and are copied into a bounded pool of staging buffers.
+// Worker threads, started by the first recording like FrameCapture's, convert them to BT.601
+// YUV 4:2:0 in parallel and append them to the file strictly in frame order. When every staging buffer is taken the frame is either dropped
+// (default, the render loop never waits) or the render thread blocks until one frees up.
+// Frame sizes are cropped to even dimensions, as 4:2:0 subsampling requires.
+class VideoRecorder
+{
+public:
+	// drop frames instead of stalling the render loop when the encoders fall behind
+	bool bDropWhenFull = true;
+
+	VideoRecorder(int Workers = 0, int StagingBuffers = 6)
+	{
+		Readback.OnReady = [this](const unsigned char* Pixels, int Width, int Height, unsigned int Frame) { Stage(Pixels, Width, Height); };
+
+		Staging.resize(StagingBuffers);
+		for (int i = 0; i < StagingBuffers; i++)
+			FreeStaging.push_back(i);
+
+		if (Workers <= 0)
+			Workers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+		WorkerCount = Workers;
+	}
+
+	~VideoRecorder()
+	{
+		Stop();
+
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			bQuit = true;
+		}
+		JobReady.notify_all();
+		for (std::thread& Thread : Threads)
+			Thread.join();
+	}
+
+	bool IsRecording() const
+	{
+		return File != NULL;
+	}
+
+	// open the stream, every frame passed to Record must have this size
+	// ------------------------------------------------------------------------
+	bool Start(const std::string& Path, int Width, int Height, int FPS)
+	{
+		Stop();
+
+		File = fopen(Path.c_str(), "wb");
+		if (File == NULL)
+		{
+			std::cout << "ERROR::RECORDER::FILE_NOT_SUCCESFULLY_OPENED " << Path << std::endl;
+			return false;
+		}
+
+		// the workers stay for later recordings once started
+		if (Threads.empty())
+		{
+			for (int i = 0; i < WorkerCount; i++)
+				Threads.push_back(std::thread([this]() { RunWorker(); }));
+		}
+
+		FrameWidth = Width & ~1;
+		FrameHeight = Height & ~1;
+		fprintf(File, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", FrameWidth, FrameHeight, std::max(FPS, 1));
+
+		Submitted = Written = Dropped = 0;
+		Sequence = NextToWrite = 0;
+		ConvertMicroseconds = 0;
+		StartTime = std::chrono::steady_clock::now();
+		std::cout << "Recording " << FrameWidth << "x" << FrameHeight << " to " << Path << std::endl;
+		return true;
+	}
+
+	// flush everything in flight, close the file and print the sustained throughput
+	// ------------------------------------------------------------------------
+	void Stop()
+	{
+		if (File == NULL)
+			return;
+
+		Readback.Flush();
+		{
+			std::unique_lock<std::mutex> Lock(Mutex);
+			FrameWritten.wait(Lock, [this]() { return Jobs.empty() && Busy == 0; });
+		}
+
+		double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+		double FrameBytes = FrameWidth * FrameHeight * 1.5;
+		std::cout << "Recorded " << Written << " frames " << FrameWidth << "x" << FrameHeight << ", " << Dropped << " dropped"
+			<< ", sustained " << Written / Seconds << " fps / " << Written * FrameBytes / Seconds / (1024.0 * 1024.0) << " MB/s"
+			<< ", convert " << (Written > 0 ? ConvertMicroseconds / 1000.0 / Written : 0.0) << "ms/frame on "
+			<< Threads.size() << " threads" << std::endl;
+
+		fclose(File);
+		File = NULL;
+	}
+
+	// queue a readback of the bound read framebuffer, call after the frame was drawn
+	// ------------------------------------------------------------------------
+	void Record()
+	{
+		if (File == NULL)
+			return;
+
+		if (!bDropWhenFull)
+		{
+			// a staging buffer must be free by the time this read resolves
+			std::unique_lock<std::mutex> Lock(Mutex);
+			StagingFree.wait(Lock, [this]() { return (int)FreeStaging.size() >= AsyncReadback::RingSize; });
+		}
+
+		Readback.Read(FrameWidth, FrameHeight, Submitted++);
+	}
+
+	// hand finished readbacks to the workers, never waits for the GPU
+	void Poll()
+	{
+		Readback.Poll();
+	}
+
+	// BT.601 limited range RGBA to planar 4:2:0, source rows bottom-up; Width and Height must be even
+	// ------------------------------------------------------------------------
+	static void ConvertRGBAToYUV420(const unsigned char* RGBA, int Width, int Height, unsigned char* Y, unsigned char* U, unsigned char* V)
+	{
+		int Stride = Width * 4;
+		for (int Row = 0; Row < Height; Row += 2)
+		{
+			// image row Row comes from the bottom-up source row Height - 1 - Row
+			const unsigned char* Top = RGBA + (size_t)(Height - 1 - Row) * Stride;
+			const unsigned char* Bottom = Top - Stride;
+			unsigned char* YTop = Y + (size_t)Row * Width;
+			unsigned char* YBottom = YTop + Width;
+			unsigned char* URow = U + (size_t)(Row / 2) * (Width / 2);
+			unsigned char* VRow = V + (size_t)(Row / 2) * (Width / 2);
+
+			int x = 0;
+#ifdef VIDEORECORDER_SSE2
+			for (; x + 8 <= Width; x += 8)
+				ConvertBlockSSE2(Top + x * 4, Bottom + x * 4, YTop + x, YBottom + x, URow + x / 2, VRow + x / 2);
+#endif
+			for (; x < Width; x += 2)
+				ConvertBlock(Top + x * 4, Bottom + x * 4, YTop + x, YBottom + x, URow + x / 2, VRow + x / 2);
+		}
+	}
+
+private:
+	struct Job
+	{
+		int Buffer;
+		unsigned int Sequence;
+	};
+
+	AsyncReadback Readback;
+
+	FILE* File = NULL;
+	int FrameWidth = 0;
+	int FrameHeight = 0;
+
+	// staging buffers and conversion queue, shared with the workers
+	std::vector<std::vector<unsigned char>> Staging;
+	std::vector<int> FreeStaging;
+	std::deque<Job> Jobs;
+	int Busy = 0;
+	bool bQuit = false;
+	std::mutex Mutex;
+	std::condition_variable JobReady;
+	std::condition_variable StagingFree;
+	std::condition_variable FrameWritten;
+	std::vector<std::thread> Threads;
+	int WorkerCount;
+
+	// frames are numbered in the order they reach the workers and written in that order
+	unsigned int Sequence = 0;
+	unsigned int NextToWrite = 0;
+
+	unsigned int Submitted = 0;
+	unsigned int Dropped = 0;
+	unsigned int Written = 0;
+	std::atomic_llong ConvertMicroseconds{ 0 };
+	std::chrono::steady_clock::time_point StartTime;
+
+	void Stage(const unsigned char* Pixels, int Width, int Height)
+	{
+		std::unique_lock<std::mutex> Lock(Mutex);
+		if (Pixels == NULL || FreeStaging.empty())
+		{
+			if (Pixels == NULL)
+				std::cout << "ERROR::RECORDER:: Failed to map readback" << std::endl;
+			++Dropped;
+			return;
+		}
+
+		int Buffer = FreeStaging.back();
+		FreeStaging.pop_back();
+		Lock.unlock();
+
+		size_t Size = (size_t)Width * Height * 4;
+		Staging[Buffer].resize(Size);
+		memcpy(Staging[Buffer].data(), Pixels, Size);
+
+		Lock.lock();
+		Job NewJob = { Buffer, Sequence++ };
+		Jobs.push_back(NewJob);
+		Lock.unlock();
+		JobReady.notify_one();
+	}
+
+	void RunWorker()
+	{
+		std::vector<unsigned char> Frame;
+
+		while (true)
+		{
+			Job Current;
+			{
+				std::unique_lock<std::mutex> Lock(Mutex);
+				JobReady.wait(Lock, [this]() { return bQuit || !Jobs.empty(); });
+				if (Jobs.empty())
+					return;
+				Current = Jobs.front();
+				Jobs.pop_front();
+				++Busy;
+			}
+
+			std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+			size_t LumaSize = (size_t)FrameWidth * FrameHeight;
+			Frame.resize(LumaSize * 3 / 2);
+			ConvertRGBAToYUV420(Staging[Current.Buffer].data(), FrameWidth, FrameHeight,
+				&Frame[0], &Frame[LumaSize], &Frame[LumaSize + LumaSize / 4]);
+
+			ConvertMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count();
+
+			// the RGBA copy is no longer needed, only the write has to wait for its turn
+			std::unique_lock<std::mutex> Lock(Mutex);
+			FreeStaging.push_back(Current.Buffer);
+			StagingFree.notify_one();
+
+			FrameWritten.wait(Lock, [this, &Current]() { return NextToWrite == Current.Sequence; });
+			Lock.unlock();
+
+			fputs("FRAME\n", File);
+			fwrite(Frame.data(), 1, Frame.size(), File);
+
+			Lock.lock();
+			++NextToWrite;
+			++Written;
+			--Busy;
+			Lock.unlock();
+			FrameWritten.notify_all();
+		}
+	}
+
+	// one 2x2 block: four luma samples and one averaged chroma pair
+	static void ConvertBlock(const unsigned char* Top, const unsigned char* Bottom,
+		unsigned char* YTop, unsigned char* YBottom, unsigned char* U, unsigned char* V)
+	{
+		const unsigned char* Pixels[4] = { Top, Top + 4, Bottom, Bottom + 4 };
+		unsigned char* Lumas[4] = { YTop, YTop + 1, YBottom, YBottom + 1 };
+
+		int R = 0, G = 0, B = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			int r = Pixels[i][0], g = Pixels[i][1], b = Pixels[i][2];
+			*Lumas[i] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+			R += r;
+			G += g;
+			B += b;
+		}
+		R = (R + 2) >> 2;
+		G = (G + 2) >> 2;
+		B = (B + 2) >> 2;
+		*U = (unsigned char)(((-38 * R - 74 * G + 112 * B + 128) >> 8) + 128);
+		*V = (unsigned char)(((112 * R - 94 * G - 18 * B + 128) >> 8) + 128);
+	}
+
+#ifdef VIDEORECORDER_SSE2
+	// split 8 RGBA pixels into 16-bit R, G and B lanes
+	static void Deinterleave(const unsigned char* Pixels, __m128i& R, __m128i& G, __m128i& B)
+	{
+		const __m128i Mask = _mm_set1_epi32(0xFF);
+		__m128i Lo = _mm_loadu_si128((const __m128i*)Pixels);
+		__m128i Hi = _mm_loadu_si128((const __m128i*)(Pixels + 16));
+		R = _mm_packs_epi32(_mm_and_si128(Lo, Mask), _mm_and_si128(Hi, Mask));
+		G = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(Lo, 8), Mask), _mm_and_si128(_mm_srli_epi32(Hi, 8), Mask));
+		B = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(Lo, 16), Mask), _mm_and_si128(_mm_srli_epi32(Hi, 16), Mask));
+	}
+
+	// weighted sum + bias >> 8 on 16-bit lanes; every intermediate fits into 0..65535, so
+	// wrapping arithmetic and a logical shift give the exact result for negative weights too
+	static __m128i Weigh(__m128i R, __m128i G, __m128i B, short WR, short WG, short WB, short Bias)
+	{
+		__m128i Sum = _mm_add_epi16(_mm_mullo_epi16(R, _mm_set1_epi16(WR)), _mm_mullo_epi16(G, _mm_set1_epi16(WG)));
+		Sum = _mm_add_epi16(Sum, _mm_mullo_epi16(B, _mm_set1_epi16(WB)));
+		return _mm_srli_epi16(_mm_add_epi16(Sum, _mm_set1_epi16(Bias)), 8);
+	}
+
+	// average horizontal pairs of two rows, 8 lanes in, 4 lanes out (in the low half)
+	static __m128i Average2x2(__m128i Top, __m128i Bottom)
+	{
+		__m128i Sum = _mm_madd_epi16(_mm_add_epi16(Top, Bottom), _mm_set1_epi16(1));
+		Sum = _mm_srli_epi32(_mm_add_epi32(Sum, _mm_set1_epi32(2)), 2);
+		return _mm_packs_epi32(Sum, Sum);
+	}
+
+	// 8x2 pixels: 16 luma samples and 4 chroma pairs
+	static void ConvertBlockSSE2(const unsigned char* Top, const unsigned char* Bottom,
+		unsigned char* YTop, unsigned char* YBottom, unsigned char* U, unsigned char* V)
+	{
+		const __m128i Zero = _mm_setzero_si128();
+		const __m128i LumaOffset = _mm_set1_epi16(16);
+
+		__m128i RT, GT, BT, RB, GB, BB;
+		Deinterleave(Top, RT, GT, BT);
+		Deinterleave(Bottom, RB, GB, BB);
+
+		__m128i LumaTop = _mm_add_epi16(Weigh(RT, GT, BT, 66, 129, 25, 128), LumaOffset);
+		__m128i LumaBottom = _mm_add_epi16(Weigh(RB, GB, BB, 66, 129, 25, 128), LumaOffset);
+		_mm_storel_epi64((__m128i*)YTop, _mm_packus_epi16(LumaTop, Zero));
+		_mm_storel_epi64((__m128i*)YBottom, _mm_packus_epi16(LumaBottom, Zero));
+
+		__m128i R = Average2x2(RT, RB);
+		__m128i G = Average2x2(GT, GB);
+		__m128i B = Average2x2(BT, BB);
+
+		// +128 chroma offset folded into the bias: (128 << 8) + 128
+		__m128i Cb = Weigh(R, G, B, -38, -74, 112, (short)32896);
+		__m128i Cr = Weigh(R, G, B, 112, -94, -18, (short)32896);
+		int CbBytes = _mm_cvtsi128_si32(_mm_packus_epi16(Cb, Zero));
+		int CrBytes = _mm_cvtsi128_si32(_mm_packus_epi16(Cr, Zero));
+		memcpy(U, &CbBytes, 4);
+		memcpy(V, &CrBytes, 4);
+	}
+#endif
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent threads for splitting per-frame CPU work into jobs.
+// Run hands out job indices to the workers and the calling thread alike and returns once every
+// job is done, so it can be used like a parallel for loop without starting threads each frame.
+class WorkerPool
+{
+public:
+	// Workers is the number of extra threads, by default one less than the cores
+	WorkerPool(int Workers = -1)
+	{
+		if (Workers < 0)
+			Workers = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+		for (int i = 0; i < Workers; i++)
+			Threads.push_back(std::thread([this]() { RunWorker(); }));
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			bStop = true;
+		}
+		JobsReady.notify_all();
+		for (std::thread& Thread : Threads)
+			Thread.join();
+	}
+
+	// threads that take part in Run, the caller included
+	int Concurrency() const
+	{
+		return (int)Threads.size() + 1;
+	}
+
+	// call Job(0) .. Job(Jobs - 1), spread over the pool
+	// ------------------------------------------------------------------------
+	void Run(int Jobs, const std::function<void(int)>& Job)
+	{
+		if (Jobs <= 0)
+			return;
+		if (Threads.empty() || Jobs == 1)
+		{
+			for (int i = 0; i < Jobs; i++)
+				Job(i);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			Current = &Job;
+			JobCount = Jobs;
+			NextJob = 0;
+			Remaining = Jobs;
+			++Generation;
+		}
+		JobsReady.notify_all();
+
+		int Finished = Work(Job, Jobs);
+
+		// workers still holding the job have to let go of it before it goes out of scope
+		std::unique_lock<std::mutex> Lock(Mutex);
+		Remaining -= Finished;
+		JobsDone.wait(Lock, [this]() { return Remaining == 0 && Busy == 0; });
+		Current = nullptr;
+	}
+
+private:
+	std::vector<std::thread> Threads;
+	std::mutex Mutex;
+	std::condition_variable JobsReady;
+	std::condition_variable JobsDone;
+	const std::function<void(int)>* Current = nullptr;
+	int JobCount = 0;
+	std::atomic_int NextJob{ 0 };
+	int Remaining = 0;
+	int Busy = 0;
+	unsigned int Generation = 0;
+	bool bStop = false;
+
+	// take jobs until none are left, returns how many this thread did
+	int Work(const std::function<void(int)>& Job, int Jobs)
+	{
+		int Finished = 0;
+		for (int i = NextJob++; i < Jobs; i = NextJob++)
+		{
+			Job(i);
+			++Finished;
+		}
+		return Finished;
+	}
+
+	void RunWorker()
+	{
+		unsigned int Seen = 0;
+		for (;;)
+		{
+			const std::function<void(int)>* Job;
+			int Jobs;
+			{
+				std::unique_lock<std::mutex> Lock(Mutex);
+				JobsReady.wait(Lock, [&]() { return bStop || Generation != Seen; });
+				if (bStop)
+					return;
+				Seen = Generation;
+				// woke up after Run already returned
+				if (Current == nullptr)
+					continue;
+				Job = Current;
+				Jobs = JobCount;
+				++Busy;
+			}
+			int Finished = Work(*Job, Jobs);
+
+			std::lock_guard<std::mutex> Lock(Mutex);
+			Remaining -= Finished;
+			--Busy;
+			if (Remaining == 0 && Busy == 0)
+				JobsDone.notify_all();
+		}
+	}
+};
@@ -0,0 +1,7 @@
+// per eye camera, std140 block at binding 0
+layout(std140) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPosition;
+};
\ No newline at end of file
@@ -0,0 +1,29 @@
+// light clusters of the eye being drawn, the grid layout matches LightClusters.h
+
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+// depth slices are exponential, the first reaches from the eye and the last to infinity
+#define CLUSTER_SLICE_NEAR 0.5
+#define CLUSTER_SLICE_FAR 100.0
+
+// offset and count of each cluster's lights
+uniform usamplerBuffer clusterGrid;
+// light indices of all clusters back to back
+uniform usamplerBuffer clusterLights;
+
+// offset and count of the lights of the cluster a clip space position falls into
+uvec2 FetchCluster(vec4 clipPosition)
+{
+	vec2 ndc = clipPosition.xy / clipPosition.w;
+	ivec2 tile = clamp(ivec2((ndc * 0.5 + 0.5) * vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y)), ivec2(0), ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+	// w is the view depth for a perspective projection
+	float sliceScale = float(CLUSTER_SLICES) / log(CLUSTER_SLICE_FAR / CLUSTER_SLICE_NEAR);
+	int slice = clamp(int(floor(log(clipPosition.w / CLUSTER_SLICE_NEAR) * sliceScale)), 0, CLUSTER_SLICES - 1);
+	return texelFetch(clusterGrid, (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x).xy;
+}
+
+int ClusterLight(uvec2 cluster, uint i)
+{
+	return int(texelFetch(clusterLights, int(cluster.x + i)).r);
+}
\ No newline at end of file
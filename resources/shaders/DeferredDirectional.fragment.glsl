@@ -0,0 +1,47 @@
+#version 330 core
+// directional and spot light of the deferred path over the whole eye, also writes the G-buffer
+// depth to the target so forward passes after it are depth tested against the scene
+out vec4 FragColor;
+
+#include "Camera.include.glsl"
+#include "Lights.include.glsl"
+#include "GBuffer.include.glsl"
+#include "Shadows.include.glsl"
+
+in vec2 TexCoords;
+
+// the cascades and the spot map darken diffuse and specular like the forward path's SHADOWS
+#ifndef SHADOWS
+#define SHADOWS 0
+#endif
+
+void main()
+{
+	Surface surface;
+	if (!FetchSurface(surface))
+		discard;
+
+#if SHADOWS
+	float viewDepth = -(view * vec4(surface.position, 1.0)).z;
+	float dirShadow = DirShadow(surface.position, surface.normal, viewDepth);
+	float spotShadow = SpotShadow(surface.position);
+#else
+	float dirShadow = 1.0;
+	float spotShadow = 1.0;
+#endif
+
+	vec3 result = ShadeSurface(surface, normalize(-dirLight.direction), dirLight.ambient, dirLight.diffuse * dirShadow, dirLight.specular * dirShadow);
+
+	// spot light, attenuated and faded between the cones like CalcSpotLight
+	vec3 toLight = spotLight.position - surface.position;
+	float distance = length(toLight);
+	vec3 lightDir = toLight / distance;
+	float attenuation = 1.0 / (spotLight.constant + spotLight.linear * distance + spotLight.quadratic * (distance * distance));
+	float theta = dot(lightDir, normalize(-spotLight.direction));
+	float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+	float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
+	result += ShadeSurface(surface, lightDir, spotLight.ambient, spotLight.diffuse * spotShadow, spotLight.specular * spotShadow) * attenuation * intensity;
+
+	FragColor = vec4(result, 1.0);
+	gl_FragDepth = surface.depth;
+}
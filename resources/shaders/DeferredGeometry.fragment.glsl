@@ -0,0 +1,22 @@
+#version 330 core
+// geometry pass of the deferred path, runs after Main.vertex.glsl
+layout(location = 0) out vec4 AlbedoSpecular;
+layout(location = 1) out vec2 OctahedralNormal;
+
+#include "Camera.include.glsl"
+#include "GBuffer.include.glsl"
+
+uniform sampler2D diffuseMap;
+// the container's specular map is grey, one channel of it is kept
+uniform sampler2D specularMap;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+in vec4 ClipPosition;
+
+void main()
+{
+	AlbedoSpecular = vec4(texture(diffuseMap, TexCoords).rgb, texture(specularMap, TexCoords).r);
+	OctahedralNormal = EncodeNormal(normalize(Normal));
+}
@@ -0,0 +1,26 @@
+#version 330 core
+// one point light added to the pixels its volume covers
+out vec4 FragColor;
+
+#include "Camera.include.glsl"
+#include "Lights.include.glsl"
+#include "GBuffer.include.glsl"
+
+flat in int LightIndex;
+
+void main()
+{
+	Surface surface;
+	if (!FetchSurface(surface))
+		discard;
+
+	// attenuation and range cut off like CalcPointLight
+	PointLight light = FetchPointLight(LightIndex);
+	vec3 toLight = light.position - surface.position;
+	float distance = length(toLight);
+	if (distance > light.range)
+		discard;
+	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+	FragColor = vec4(ShadeSurface(surface, toLight / distance, light.ambient, light.diffuse, light.specular) * attenuation, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+
+#include "Camera.include.glsl"
+#include "Lights.include.glsl"
+
+// one instance per point light
+flat out int LightIndex;
+
+void main()
+{
+	// the unit cube stretched over the light's range, whatever it covers on screen may be lit
+	PointLight light = FetchPointLight(gl_InstanceID);
+	LightIndex = gl_InstanceID;
+	gl_Position = projection * view * vec4(light.position + aPos * 2.0 * light.range, 1.0);
+}
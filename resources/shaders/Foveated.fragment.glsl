@@ -0,0 +1,27 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D periphery;
+uniform sampler2D inset;
+uniform vec4 insetRect; // x0, y0, x1, y1 in texture space
+uniform vec2 gaze;
+uniform float aspect;
+uniform float radius;
+uniform float falloff;
+
+void main()
+{
+	vec3 color = texture(periphery, TexCoords).rgb;
+
+	// distance to the gaze point in units of the eye height
+	float dist = length((TexCoords - gaze) * vec2(aspect, 1.0));
+	float weight = 1.0 - smoothstep(radius - falloff, radius, dist);
+
+	vec2 insetCoords = (TexCoords - insetRect.xy) / (insetRect.zw - insetRect.xy);
+	if (weight > 0.0 && all(greaterThanEqual(insetCoords, vec2(0.0))) && all(lessThanEqual(insetCoords, vec2(1.0))))
+		color = mix(color, texture(inset, insetCoords).rgb, weight);
+
+	FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,72 @@
+// compact G-buffer of the deferred path, the layout matches DeferredRenderer.h:
+// RGBA8 albedo and specular intensity, RG16 octahedral normal and 24 bit depth, 12 bytes a pixel
+
+// unit vector folded onto an octahedron and flattened into [0, 1]^2
+vec2 EncodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 folded = n.xy;
+	if (n.z < 0.0)
+		folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return folded * 0.5 + 0.5;
+}
+
+vec3 DecodeNormal(vec2 encoded)
+{
+	vec2 folded = encoded * 2.0 - 1.0;
+	vec3 n = vec3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+	float unfold = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -unfold : unfold;
+	n.y += n.y >= 0.0 ? -unfold : unfold;
+	return normalize(n);
+}
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+// of the eye being lit: clip space back to world space, and where its viewport starts
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportOrigin;
+
+// material constants, std140 block at binding 2, shared with the forward path
+layout(std140) uniform Material
+{
+	float shininess;
+} material;
+
+struct Surface {
+	vec3 position;
+	vec3 normal;
+	vec3 albedo;
+	float specular;
+	float depth;
+};
+
+// the G-buffer texel under this fragment, false where no geometry was drawn
+bool FetchSurface(out Surface surface)
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy - viewportOrigin);
+	surface.depth = texelFetch(gDepth, pixel, 0).r;
+	if (surface.depth == 1.0)
+		return false;
+
+	vec2 ndc = (vec2(pixel) + 0.5) / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0;
+	vec4 position = inverseViewProjection * vec4(ndc, surface.depth * 2.0 - 1.0, 1.0);
+	surface.position = position.xyz / position.w;
+	surface.normal = DecodeNormal(texelFetch(gNormal, pixel, 0).rg);
+	vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+	surface.albedo = albedoSpecular.rgb;
+	surface.specular = albedoSpecular.a;
+	return true;
+}
+
+// the forward path's Phong terms for one light reaching a surface, before attenuation
+vec3 ShadeSurface(Surface surface, vec3 lightDir, vec3 ambient, vec3 diffuse, vec3 specular)
+{
+	vec3 viewDir = normalize(cameraPosition.xyz - surface.position);
+	float diff = max(dot(surface.normal, lightDir), 0.0);
+	vec3 reflectDir = reflect(-lightDir, surface.normal);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+	return (ambient + diffuse * diff) * surface.albedo + specular * spec * surface.specular;
+}
@@ -0,0 +1,52 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D warpedColor;
+uniform sampler2D warpedDepth;
+uniform int maxSearch;
+
+void main()
+{
+	ivec2 size = textureSize(warpedColor, 0);
+	ivec2 pixel = ivec2(TexCoords * vec2(size));
+
+	vec4 color = texelFetch(warpedColor, pixel, 0);
+	if (color.a > 0.5)
+	{
+		FragColor = vec4(color.rgb, 1.0);
+		return;
+	}
+
+	// disocclusions open up horizontally between the eyes, so search the scanline
+	// and take the background side (larger depth) of the hole
+	vec4 left = vec4(0.0);
+	vec4 right = vec4(0.0);
+	float leftDepth = 0.0;
+	float rightDepth = 0.0;
+	for (int i = 1; i <= maxSearch; i++)
+	{
+		if (left.a < 0.5)
+		{
+			ivec2 p = ivec2(max(pixel.x - i, 0), pixel.y);
+			left = texelFetch(warpedColor, p, 0);
+			leftDepth = texelFetch(warpedDepth, p, 0).r;
+		}
+		if (right.a < 0.5)
+		{
+			ivec2 p = ivec2(min(pixel.x + i, size.x - 1), pixel.y);
+			right = texelFetch(warpedColor, p, 0);
+			rightDepth = texelFetch(warpedDepth, p, 0).r;
+		}
+		if (left.a > 0.5 && right.a > 0.5)
+			break;
+	}
+
+	if (left.a > 0.5 && right.a > 0.5)
+		FragColor = vec4(leftDepth > rightDepth ? left.rgb : right.rgb, 1.0);
+	else if (left.a > 0.5)
+		FragColor = vec4(left.rgb, 1.0);
+	else
+		FragColor = vec4(right.rgb, 1.0);
+}
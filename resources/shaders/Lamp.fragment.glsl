@@ -1,7 +1,21 @@
 #version 330 core
 out vec4 FragColor;
 
+#include "Lights.include.glsl"
+
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
+// point light this lamp stands for
+#if INSTANCED
+flat in int InstanceLamp;
+#define lamp InstanceLamp
+#else
+uniform int lamp;
+#endif
+
 void main()
 {
-	FragColor = vec4(1.0); // set alle 4 vector values to 1.0
+	FragColor = vec4(FetchPointLight(lamp).specular, 1.0); // the light's specular colour
 }
\ No newline at end of file
@@ -1,11 +1,32 @@
 #version 330 core
 layout(location = 0) in vec3 aPos;
 
+#include "Camera.include.glsl"
+
+// every lamp from one draw, its position per instance
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
+#if INSTANCED
+layout(location = 3) in vec3 instancePosition;
+
+// size of every lamp cube
+uniform float lampScale;
+// lamps cycle through this many point lights
+uniform int lampLights;
+
+flat out int InstanceLamp;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
 
 void main()
 {
+#if INSTANCED
+	InstanceLamp = gl_InstanceID % lampLights;
+	gl_Position = projection * view * vec4(instancePosition + aPos * lampScale, 1.0);
+#else
 	gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+#endif
+}
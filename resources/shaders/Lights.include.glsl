@@ -0,0 +1,79 @@
+// scene lights shared by the lighting and lamp shaders, included by both
+
+// light structs are laid out so every vec3 is followed by a float: std140 then packs them
+// without hidden padding and the CPU mirror in UniformBlocks.h is a plain struct
+struct DirLight {
+	vec3 direction;
+	float padding0;
+
+	vec3 ambient;
+	float padding1;
+	vec3 diffuse;
+	float padding2;
+	vec3 specular;
+	float padding3;
+};
+
+struct PointLight {
+	vec3 position;
+	float constant;
+
+	vec3 ambient;
+	float linear;
+	vec3 diffuse;
+	float quadratic;
+	vec3 specular;
+	// beyond this the light is below visibility and cut off, set by LightClusters
+	float range;
+};
+
+struct SpotLight {
+	vec3 position;
+	float cutOff;
+	vec3 direction;
+	float outerCutOff;
+
+	vec3 ambient;
+	float constant;
+	vec3 diffuse;
+	float linear;
+	vec3 specular;
+	float quadratic;
+};
+
+// most point lights a draw can list by index, more go through the light clusters
+#define MAX_POINT_LIGHTS 4
+
+// std140 block at binding 1, one buffer read by every shader that includes this
+layout(std140) uniform Lights
+{
+	DirLight dirLight;
+	SpotLight spotLight;
+};
+
+// every point light of the scene, 4 texels per light in the order of the PointLight members
+uniform samplerBuffer pointLightData;
+
+int PointLightCount()
+{
+	return textureSize(pointLightData) / 4;
+}
+
+PointLight FetchPointLight(int index)
+{
+	vec4 texel0 = texelFetch(pointLightData, index * 4);
+	vec4 texel1 = texelFetch(pointLightData, index * 4 + 1);
+	vec4 texel2 = texelFetch(pointLightData, index * 4 + 2);
+	vec4 texel3 = texelFetch(pointLightData, index * 4 + 3);
+
+	PointLight light;
+	light.position = texel0.xyz;
+	light.constant = texel0.w;
+	light.ambient = texel1.xyz;
+	light.linear = texel1.w;
+	light.diffuse = texel2.xyz;
+	light.quadratic = texel2.w;
+	light.specular = texel3.xyz;
+	light.range = texel3.w;
+	return light;
+}
\ No newline at end of file
@@ -1,69 +1,91 @@
 #version 330 core
 out vec4 FragColor;
 
-struct Material {
-	sampler2D diffuse;
-	sampler2D specular;
+#include "Camera.include.glsl"
+#include "Lights.include.glsl"
+#include "Clusters.include.glsl"
+#include "Shadows.include.glsl"
+
+// feature switches, injected per variant by the renderer; the defaults light with everything
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS MAX_POINT_LIGHTS
+#endif
+#ifndef DIR_LIGHT
+#define DIR_LIGHT 1
+#endif
+#ifndef SPOT_LIGHT
+#define SPOT_LIGHT 1
+#endif
+#ifndef SPECULAR_MAP
+#define SPECULAR_MAP 1
+#endif
+// point lights from the fragment's cluster instead of the per draw list
+#ifndef CLUSTERED
+#define CLUSTERED 0
+#endif
+// every point light of the scene, the reference the clusters are measured against
+#ifndef EVERY_POINT_LIGHT
+#define EVERY_POINT_LIGHT 0
+#endif
+// the point lights culled for this draw on the CPU, read from the list buffer
+#ifndef LIGHT_LIST
+#define LIGHT_LIST 0
+#endif
+// directional and spot light shadows from the shadow maps
+#ifndef SHADOWS
+#define SHADOWS 0
+#endif
+
+// the containers' placement and lights come per instance
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
+// which point lights light this draw, the first NR_POINT_LIGHTS are used
+#if INSTANCED
+flat in ivec4 InstancePointLights;
+#define pointLightIndices InstancePointLights
+#else
+uniform ivec4 pointLightIndices;
+#endif
+#if LIGHT_LIST
+// light indices of every draw, this draw's run of them as offset and count
+uniform usamplerBuffer drawLights;
+#if INSTANCED
+flat in ivec2 InstanceLightList;
+#define drawLightRange InstanceLightList
+#else
+uniform ivec2 drawLightRange;
+#endif
+#endif
+
+// material constants, std140 block at binding 2; samplers cannot live in a block
+layout(std140) uniform Material
+{
 	float shininess;
-};
-
-struct DirLight {
-	vec3 direction;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-
-struct PointLight {
-	vec3 position;
-
-	float constant;
-	float linear;
-	float quadratic;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
+} material;
 
-struct SpotLight {
-	vec3 position;
-	vec3 direction;
-	float cutOff;
-	float outerCutOff;
-
-	float constant;
-	float linear;
-	float quadratic;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-
-#define NR_POINT_LIGHTS 4
+uniform sampler2D diffuseMap;
+#if SPECULAR_MAP
+uniform sampler2D specularMap;
+#endif
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
-
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-uniform Material material;
+in vec4 ClipPosition;
 
 // function prototypes
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
+vec3 CalcSpecular(vec3 color, vec3 lightDir, vec3 normal, vec3 viewDir);
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow);
 
 void main()
 {
 	// properties
 	vec3 norm = normalize(Normal);
-	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 viewDir = normalize(cameraPosition.xyz - FragPos);
 
 	// == =====================================================
 	// Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
@@ -71,31 +93,68 @@ void main()
 	// per lamp. In the main() function we take all the calculated colors and sum them up for
 	// this fragment's final color.
 	// == =====================================================
+	// phases a variant does not need are compiled out
+	vec3 result = vec3(0.0);
 	// phase 1: directional lighting
-	vec3 result = CalcDirLight(dirLight, norm, viewDir);
+#if DIR_LIGHT
+#if SHADOWS
+	float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+	result += CalcDirLight(dirLight, norm, viewDir, DirShadow(FragPos, norm, viewDepth));
+#else
+	result += CalcDirLight(dirLight, norm, viewDir, 1.0);
+#endif
+#endif
 	// phase 2: point lights
+#if CLUSTERED
+	uvec2 cluster = FetchCluster(ClipPosition);
+	for (uint i = 0u; i < cluster.y; i++)
+		result += CalcPointLight(FetchPointLight(ClusterLight(cluster, i)), norm, FragPos, viewDir);
+#elif LIGHT_LIST
+	for (int i = 0; i < drawLightRange.y; i++)
+		result += CalcPointLight(FetchPointLight(int(texelFetch(drawLights, drawLightRange.x + i).r)), norm, FragPos, viewDir);
+#elif EVERY_POINT_LIGHT
+	int count = PointLightCount();
+	for (int i = 0; i < count; i++)
+		result += CalcPointLight(FetchPointLight(i), norm, FragPos, viewDir);
+#else
 	for (int i = 0; i < NR_POINT_LIGHTS; i++)
-		result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+		result += CalcPointLight(FetchPointLight(pointLightIndices[i]), norm, FragPos, viewDir);
+#endif
 	// phase 3: spot light
-	result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+#if SPOT_LIGHT
+#if SHADOWS
+	result += CalcSpotLight(spotLight, norm, FragPos, viewDir, SpotShadow(FragPos));
+#else
+	result += CalcSpotLight(spotLight, norm, FragPos, viewDir, 1.0);
+#endif
+#endif
 
 	FragColor = vec4(result, 1.0);
 }
 
-// calculates the color when using a directional light.
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
+// specular term of one light, variants without a specular map have none
+vec3 CalcSpecular(vec3 color, vec3 lightDir, vec3 normal, vec3 viewDir)
+{
+#if SPECULAR_MAP
+	vec3 reflectDir = reflect(-lightDir, normal);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+	return color * spec * vec3(texture(specularMap, TexCoords));
+#else
+	return vec3(0.0);
+#endif
+}
+
+// calculates the color when using a directional light, shadow only darkens diffuse and specular
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow)
 {
 	vec3 lightDir = normalize(-light.direction);
 	// diffuse shading
 	float diff = max(dot(normal, lightDir), 0.0);
-	// specular shading
-	vec3 reflectDir = reflect(-lightDir, normal);
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 	// combine results
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-	return (ambient + diffuse + specular);
+	vec3 ambient = light.ambient * vec3(texture(diffuseMap, TexCoords));
+	vec3 diffuse = light.diffuse * diff * vec3(texture(diffuseMap, TexCoords));
+	vec3 specular = CalcSpecular(light.specular, lightDir, normal, viewDir);
+	return (ambient + shadow * (diffuse + specular));
 }
 
 // calculates the color when using a point light.
@@ -104,31 +163,27 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 	vec3 lightDir = normalize(light.position - fragPos);
 	// diffuse shading
 	float diff = max(dot(normal, lightDir), 0.0);
-	// specular shading
-	vec3 reflectDir = reflect(-lightDir, normal);
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 	// attenuation
 	float distance = length(light.position - fragPos);
 	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+	// nothing past the range, so lights outside a cluster are really missing nothing
+	attenuation *= step(distance, light.range);
 	// combine results
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+	vec3 ambient = light.ambient * vec3(texture(diffuseMap, TexCoords));
+	vec3 diffuse = light.diffuse * diff * vec3(texture(diffuseMap, TexCoords));
+	vec3 specular = CalcSpecular(light.specular, lightDir, normal, viewDir);
 	ambient *= attenuation;
 	diffuse *= attenuation;
 	specular *= attenuation;
 	return (ambient + diffuse + specular);
 }
 
-// calculates the color when using a spot light.
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+// calculates the color when using a spot light, shadow only darkens diffuse and specular
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
 {
 	vec3 lightDir = normalize(light.position - fragPos);
 	// diffuse shading
 	float diff = max(dot(normal, lightDir), 0.0);
-	// specular shading
-	vec3 reflectDir = reflect(-lightDir, normal);
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 	// attenuation
 	float distance = length(light.position - fragPos);
 	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
@@ -137,11 +192,11 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 	float epsilon = light.cutOff - light.outerCutOff;
 	float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 	// combine results
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+	vec3 ambient = light.ambient * vec3(texture(diffuseMap, TexCoords));
+	vec3 diffuse = light.diffuse * diff * vec3(texture(diffuseMap, TexCoords));
+	vec3 specular = CalcSpecular(light.specular, lightDir, normal, viewDir);
 	ambient *= attenuation * intensity;
-	diffuse *= attenuation * intensity;
-	specular *= attenuation * intensity;
+	diffuse *= attenuation * intensity * shadow;
+	specular *= attenuation * intensity * shadow;
 	return (ambient + diffuse + specular);
 }
\ No newline at end of file
@@ -6,16 +6,58 @@ layout(location = 2) in vec2 aTexCoords;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+// for the light cluster lookup
+out vec4 ClipPosition;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// inverse transpose of the model's upper 3x3 from NormalMatrices.h, or just that 3x3 when rigid
+uniform mat3 normalMatrix;
+
+#include "Camera.include.glsl"
+
+// invert the model per vertex instead, the reference the normal matrix benchmark is measured against
+#ifndef VERTEX_INVERSE
+#define VERTEX_INVERSE 0
+#endif
+// placement and point lights per instance from the instance buffer instead of per draw uniforms
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
+#if INSTANCED
+// position and uniform scale, then the rotation as a quaternion
+layout(location = 3) in vec4 instancePositionScale;
+layout(location = 4) in vec4 instanceRotation;
+layout(location = 5) in ivec4 instancePointLights;
+layout(location = 6) in ivec2 instanceLightList;
+
+flat out ivec4 InstancePointLights;
+flat out ivec2 InstanceLightList;
+
+vec3 Rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+#endif
 
 void main()
 {
+#if INSTANCED
+	FragPos = instancePositionScale.xyz + Rotate(instanceRotation, aPos * instancePositionScale.w);
+	// the scale is uniform, the rotation alone is the normal matrix
+	Normal = Rotate(instanceRotation, aNormal);
+	InstancePointLights = instancePointLights;
+	InstanceLightList = instanceLightList;
+#else
 	FragPos = vec3(model * vec4(aPos, 1.0));
+#if VERTEX_INVERSE
 	Normal = mat3(transpose(inverse(model))) * aNormal;
+#else
+	Normal = normalMatrix * aNormal;
+#endif
+#endif
 	TexCoords = aTexCoords;
 
 	gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+	ClipPosition = gl_Position;
+}
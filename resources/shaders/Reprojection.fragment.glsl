@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D srcColor;
+
+void main()
+{
+	// alpha marks covered pixels, everything left at zero is a disocclusion hole
+	FragColor = vec4(texture(srcColor, TexCoords).rgb, 1.0);
+}
@@ -0,0 +1,46 @@
+#version 330 core
+out vec2 TexCoords;
+
+uniform sampler2D srcDepth;
+uniform mat4 srcInvViewProjection;
+uniform mat4 dstViewProjection;
+uniform ivec2 gridSize;
+uniform float nearPlane;
+uniform float farPlane;
+uniform float depthDiscontinuity;
+
+// two triangles per grid cell, generated from gl_VertexID
+const ivec2 corners[6] = ivec2[](ivec2(0, 0), ivec2(1, 0), ivec2(1, 1), ivec2(1, 1), ivec2(0, 1), ivec2(0, 0));
+
+float LinearDepth(float depth)
+{
+	float z = depth * 2.0 - 1.0;
+	return (2.0 * nearPlane * farPlane) / (farPlane + nearPlane - z * (farPlane - nearPlane));
+}
+
+void main()
+{
+	int cell = gl_VertexID / 6;
+	ivec2 cellCoord = ivec2(cell % gridSize.x, cell / gridSize.x);
+	vec2 uv = vec2(cellCoord + corners[gl_VertexID % 6]) / vec2(gridSize);
+
+	// cells spanning a depth edge would stretch foreground over background, drop them to leave a hole
+	vec2 cellMin = vec2(cellCoord) / vec2(gridSize);
+	vec2 cellMax = vec2(cellCoord + 1) / vec2(gridSize);
+	float d0 = LinearDepth(textureLod(srcDepth, cellMin, 0.0).r);
+	float d1 = LinearDepth(textureLod(srcDepth, vec2(cellMax.x, cellMin.y), 0.0).r);
+	float d2 = LinearDepth(textureLod(srcDepth, cellMax, 0.0).r);
+	float d3 = LinearDepth(textureLod(srcDepth, vec2(cellMin.x, cellMax.y), 0.0).r);
+	float nearest = min(min(d0, d1), min(d2, d3));
+	float farthest = max(max(d0, d1), max(d2, d3));
+
+	float depth = textureLod(srcDepth, uv, 0.0).r;
+	vec4 world = srcInvViewProjection * vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	world /= world.w;
+
+	TexCoords = uv;
+	gl_Position = dstViewProjection * world;
+
+	if ((farthest - nearest) > depthDiscontinuity * nearest)
+		gl_Position = vec4(0.0, 0.0, 2.0, 1.0); // outside the clip volume
+}
@@ -0,0 +1,32 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+
+// depth of a caster as seen from a light, see ShadowMaps.h
+uniform mat4 lightSpace;
+
+// placement per instance from the caster instance buffer instead of a model per draw
+#ifndef INSTANCED
+#define INSTANCED 0
+#endif
+
+#if INSTANCED
+// position and uniform scale, then the rotation as a quaternion
+layout(location = 3) in vec4 instancePositionScale;
+layout(location = 4) in vec4 instanceRotation;
+
+vec3 Rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+#else
+uniform mat4 model;
+#endif
+
+void main()
+{
+#if INSTANCED
+	gl_Position = lightSpace * vec4(instancePositionScale.xyz + Rotate(instanceRotation, aPos * instancePositionScale.w), 1.0);
+#else
+	gl_Position = lightSpace * model * vec4(aPos, 1.0);
+#endif
+}
@@ -0,0 +1,55 @@
+// shadow maps of the directional and spot light, rendered once per frame by ShadowMaps.h
+
+#define SHADOW_CASCADES 3
+
+// std140 block at binding 3, matrices from world space to shadow map coordinates and depth
+layout(std140) uniform Shadows
+{
+	mat4 cascadeMatrices[SHADOW_CASCADES];
+	// view depth at which each cascade ends
+	vec4 cascadeEnds;
+	// world space size of a texel of each cascade
+	vec4 cascadeTexels;
+	mat4 spotShadowMatrix;
+	// texel size in texture coordinates, x of the cascades and y of the spot light's map
+	vec4 shadowTexelSize;
+};
+
+uniform sampler2DArrayShadow dirShadowMap;
+uniform sampler2DShadow spotShadowMap;
+
+// lit fraction of a world position for the directional light, 3x3 compared taps of the cascade
+// its view depth falls into; beyond the last cascade everything is lit
+float DirShadow(vec3 worldPosition, vec3 normal, float viewDepth)
+{
+	if (viewDepth >= cascadeEnds[SHADOW_CASCADES - 1])
+		return 1.0;
+	int cascade = 0;
+	for (int i = 0; i < SHADOW_CASCADES - 1; i++)
+		cascade += viewDepth >= cascadeEnds[i] ? 1 : 0;
+
+	// pushed off the surface by a texel and a half against acne on slopes
+	vec3 position = worldPosition + normal * (1.5 * cascadeTexels[cascade]);
+	vec3 coords = (cascadeMatrices[cascade] * vec4(position, 1.0)).xyz;
+
+	float lit = 0.0;
+	for (int y = -1; y <= 1; y++)
+		for (int x = -1; x <= 1; x++)
+			lit += texture(dirShadowMap, vec4(coords.xy + vec2(x, y) * shadowTexelSize.x, float(cascade), coords.z));
+	return lit / 9.0;
+}
+
+// lit fraction of a world position for the spot light
+float SpotShadow(vec3 worldPosition)
+{
+	vec4 coords = spotShadowMatrix * vec4(worldPosition, 1.0);
+	if (coords.w <= 0.0)
+		return 1.0;
+	coords.xyz /= coords.w;
+
+	float lit = 0.0;
+	for (int y = -1; y <= 1; y++)
+		for (int x = -1; x <= 1; x++)
+			lit += texture(spotShadowMap, vec3(coords.xy + vec2(x, y) * shadowTexelSize.y, coords.z));
+	return lit / 9.0;
+}